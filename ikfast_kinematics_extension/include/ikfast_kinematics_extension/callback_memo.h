@@ -0,0 +1,260 @@
+/*
+ * Memo table of the verdicts of the solution callback of searchPositionIK()
+ *
+ * The same joint configurations reach the callback again and again, across queries for close poses
+ * and across the random restarts of MoveIt. The memo keys each checked configuration by its joint
+ * values quantized to cells of a given resolution plus a scene version set by the user, so configurations
+ * of the same cell share the verdict of the first one checked and a new scene version invalidates all
+ * entries. The verdict must only depend on the joint values, not on the pose passed to the callback.
+ *
+ * The table has a fixed number of entries in buckets of two, the most recently used one first, so a new
+ * configuration evicts the least recently used entry of its bucket. The buckets are guarded by a fixed
+ * set of mutexes, each one locking every CALLBACK_MEMO_STRIPES-th bucket.
+ */
+
+#ifndef CALLBACK_MEMO_H
+#define CALLBACK_MEMO_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include <ikfast_kinematics_extension/ikfast_kinematics_extension.h>
+
+namespace ikfast_kinematics_plugin
+{
+
+const std::size_t CALLBACK_MEMO_STRIPES = 64;      // mutexes guarding the buckets
+const std::size_t CALLBACK_MEMO_MAX_DOF = 8;       // configurations of more joints aren't memoized
+
+/// \brief Bounded memo of callback verdicts per quantized joint configuration, safe to use from several threads
+class CallbackMemo
+{
+public:
+  CallbackMemo():
+    dof_(0),
+    inverse_resolution_(0.0),
+    scene_version_(0)
+  {
+    for(std::size_t i = 0; i < CALLBACK_MEMO_STRIPES; ++i)
+      pthread_mutex_init(&stripes_[i].mutex, NULL);
+    pthread_mutex_init(&scene_mutex_, NULL);
+  }
+
+  ~CallbackMemo()
+  {
+    for(std::size_t i = 0; i < CALLBACK_MEMO_STRIPES; ++i)
+      pthread_mutex_destroy(&stripes_[i].mutex);
+    pthread_mutex_destroy(&scene_mutex_);
+  }
+
+  /**
+   * @brief Sets the joints of the configurations, the cell size and the number of entries, clears the memo
+   *
+   * Not safe while other threads use the memo. The size is rounded up to a power of two, 0 disables the memo.
+   */
+  void configure(std::size_t dof, double resolution, std::size_t size)
+  {
+    bool enabled = size > 0 && resolution > 0.0 && dof > 0 && dof <= CALLBACK_MEMO_MAX_DOF;
+    std::size_t num_entries = 2 * CALLBACK_MEMO_STRIPES;
+    while(enabled && num_entries < size)
+      num_entries *= 2;
+
+    dof_ = enabled ? dof : 0;
+    inverse_resolution_ = enabled ? 1.0 / resolution : 0.0;
+    entries_.assign(enabled ? num_entries : 0, Entry());
+    cells_.assign(entries_.size() * dof_, 0);
+    for(std::size_t i = 0; i < CALLBACK_MEMO_STRIPES; ++i)
+      stripes_[i].stats = CallbackMemoStats();
+  }
+
+  bool configured() const { return dof_ > 0; }
+
+  std::size_t size() const { return entries_.size(); }
+
+  /// \brief Sets the version of the scene the callback checks against, the verdicts of other versions are ignored
+  void setSceneVersion(uint64_t version)
+  {
+    pthread_mutex_lock(&scene_mutex_);
+    scene_version_ = version;
+    pthread_mutex_unlock(&scene_mutex_);
+  }
+
+  /// \brief Gets the scene version once per query, so that a query sees a single version
+  uint64_t getSceneVersion() const
+  {
+    pthread_mutex_lock(&scene_mutex_);
+    uint64_t version = scene_version_;
+    pthread_mutex_unlock(&scene_mutex_);
+    return version;
+  }
+
+  /**
+   * @brief Looks up the verdict of the cell of a configuration of dof() joints
+   * @return False if no verdict is known for the scene version
+   */
+  bool lookup(const double *joint_values, uint64_t scene_version, int32_t &verdict) const
+  {
+    Key key;
+    if(!quantize(joint_values, scene_version, key))
+      return false;
+
+    std::size_t bucket = key.hash & (entries_.size() / 2 - 1);
+    Stripe &stripe = stripes_[bucket % CALLBACK_MEMO_STRIPES];
+    pthread_mutex_lock(&stripe.mutex);
+    int way = find(bucket, key);
+    if(way == 1)
+      swapWays(bucket);
+    if(way >= 0)
+    {
+      verdict = entries_[2 * bucket].verdict;
+      stripe.stats.hits++;
+    }
+    else
+    {
+      stripe.stats.misses++;
+    }
+    pthread_mutex_unlock(&stripe.mutex);
+    return way >= 0;
+  }
+
+  /// \brief Records the verdict of the callback for the cell of a configuration of dof() joints
+  void store(const double *joint_values, uint64_t scene_version, int32_t verdict)
+  {
+    Key key;
+    if(!quantize(joint_values, scene_version, key))
+      return;
+
+    std::size_t bucket = key.hash & (entries_.size() / 2 - 1);
+    Stripe &stripe = stripes_[bucket % CALLBACK_MEMO_STRIPES];
+    pthread_mutex_lock(&stripe.mutex);
+    int way = find(bucket, key);
+    if(way == 1)
+      swapWays(bucket);
+    if(way < 0)
+    {
+      // the most recently used entry becomes the second one, the second one is evicted
+      swapWays(bucket);
+      Entry &entry = entries_[2 * bucket];
+      if(entry.used && entry.scene_version == scene_version)
+        stripe.stats.evictions++;
+      entry.used = true;
+      entry.hash = key.hash;
+      entry.scene_version = scene_version;
+      std::copy(key.cells, key.cells + dof_, &cells_[2 * bucket * dof_]);
+    }
+    entries_[2 * bucket].verdict = verdict;
+    pthread_mutex_unlock(&stripe.mutex);
+  }
+
+  /// \brief Sums the counters of all stripes
+  CallbackMemoStats getStats() const
+  {
+    CallbackMemoStats stats;
+    for(std::size_t i = 0; i < CALLBACK_MEMO_STRIPES; ++i)
+    {
+      pthread_mutex_lock(&stripes_[i].mutex);
+      stats.hits += stripes_[i].stats.hits;
+      stats.misses += stripes_[i].stats.misses;
+      stats.evictions += stripes_[i].stats.evictions;
+      pthread_mutex_unlock(&stripes_[i].mutex);
+    }
+    return stats;
+  }
+
+  /// \brief Forgets all verdicts and resets the counters
+  void clear()
+  {
+    for(std::size_t i = 0; i < CALLBACK_MEMO_STRIPES; ++i)
+    {
+      pthread_mutex_lock(&stripes_[i].mutex);
+      for(std::size_t bucket = i; bucket < entries_.size() / 2; bucket += CALLBACK_MEMO_STRIPES)
+        entries_[2 * bucket].used = entries_[2 * bucket + 1].used = false;
+      stripes_[i].stats = CallbackMemoStats();
+      pthread_mutex_unlock(&stripes_[i].mutex);
+    }
+  }
+
+private:
+  struct Entry
+  {
+    Entry(): used(false), verdict(0), hash(0), scene_version(0) {}
+
+    bool used;
+    int32_t verdict;
+    uint64_t hash;
+    uint64_t scene_version;
+  };
+
+  struct Key
+  {
+    uint64_t hash;
+    uint64_t scene_version;
+    int32_t cells[CALLBACK_MEMO_MAX_DOF];
+  };
+
+  struct Stripe
+  {
+    pthread_mutex_t mutex;
+    CallbackMemoStats stats;
+  };
+
+  /// \brief Gets the cells of the joint values and their hash, false if the memo is disabled
+  bool quantize(const double *joint_values, uint64_t scene_version, Key &key) const
+  {
+    if(dof_ == 0)
+      return false;
+
+    // FNV-1a over the scene version and the cells
+    key.scene_version = scene_version;
+    key.hash = 14695981039346656037ull;
+    for(int i = 0; i < 8; ++i)
+      key.hash = (key.hash ^ ((scene_version >> (8 * i)) & 0xff)) * 1099511628211ull;
+    for(std::size_t j = 0; j < dof_; ++j)
+    {
+      key.cells[j] = (int32_t)floor(joint_values[j] * inverse_resolution_);
+      const unsigned char *bytes = reinterpret_cast<const unsigned char*>(&key.cells[j]);
+      for(std::size_t i = 0; i < sizeof(int32_t); ++i)
+        key.hash = (key.hash ^ bytes[i]) * 1099511628211ull;
+    }
+
+    // the low bits select the bucket, they only depend on the low bits of the bytes without mixing
+    key.hash ^= key.hash >> 33;
+    key.hash *= 0xff51afd7ed558ccdull;
+    key.hash ^= key.hash >> 33;
+    return true;
+  }
+
+  /// \brief Gets the way of the bucket holding the key, -1 if none, the caller holds the lock of the bucket
+  int find(std::size_t bucket, const Key &key) const
+  {
+    for(int way = 0; way < 2; ++way)
+    {
+      const Entry &entry = entries_[2 * bucket + way];
+      if(entry.used && entry.hash == key.hash && entry.scene_version == key.scene_version &&
+         std::equal(key.cells, key.cells + dof_, &cells_[(2 * bucket + way) * dof_]))
+        return way;
+    }
+    return -1;
+  }
+
+  /// \brief Exchanges the two entries of a bucket, the caller holds the lock of the bucket
+  void swapWays(std::size_t bucket) const
+  {
+    std::swap(entries_[2 * bucket], entries_[2 * bucket + 1]);
+    std::swap_ranges(&cells_[2 * bucket * dof_], &cells_[(2 * bucket + 1) * dof_], &cells_[(2 * bucket + 1) * dof_]);
+  }
+
+  std::size_t dof_;
+  double inverse_resolution_;
+  mutable std::vector<Entry> entries_;   // buckets of two entries, the most recently used one first
+  mutable std::vector<int32_t> cells_;   // dof_ cells per entry
+  mutable Stripe stripes_[CALLBACK_MEMO_STRIPES];
+  mutable pthread_mutex_t scene_mutex_;
+  uint64_t scene_version_;
+};
+
+} // end namespace
+
+#endif
@@ -0,0 +1,249 @@
+/*
+ * Learned prior over the free joint values that solved similar poses
+ *
+ * Poses are binned into coarse cells of position and orientation, each cell keeps a histogram of
+ * the free joint values of the solutions returned for its poses. searchPositionIK() tries the
+ * most frequent values of the cell first and then sweeps as usual, so the prior only changes the
+ * order of the sweep and never which values are searched. Cells are identified by a hash of their
+ * coordinates, a collision merges two histograms and again only affects the order.
+ *
+ * Prior file: a FreeJointPriorHeader followed by num_cells blocks, each one the uint64_t cell
+ * key and num_bins uint32_t counts.
+ */
+
+#ifndef FREE_JOINT_PRIOR_H
+#define FREE_JOINT_PRIOR_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ikfast_kinematics_plugin
+{
+
+const char FREE_JOINT_PRIOR_MAGIC[4] = {'I','K','F','P'};
+const uint32_t FREE_JOINT_PRIOR_VERSION = 1;
+const uint32_t FREE_JOINT_PRIOR_BINS = 64;          // histogram bins over the range of the free joint
+const std::size_t FREE_JOINT_PRIOR_MAX_CELLS = 65536; // new cells are ignored beyond this, 16 MB of histograms
+
+struct FreeJointPriorHeader
+{
+  char magic[4];
+  uint32_t version;
+  uint32_t num_bins;
+  uint32_t num_cells;
+  double lower;            // range of the free joint
+  double upper;
+  double position_cell;    // cell size in m
+  double orientation_cell; // cell size of the quaternion components
+};
+
+/// \brief Histograms of the successful free joint values per pose cell, safe to use from several threads
+class FreeJointPrior
+{
+public:
+  FreeJointPrior():
+    lower_(0.0),
+    upper_(0.0),
+    position_cell_(0.0),
+    orientation_cell_(0.0)
+  {
+    pthread_mutex_init(&mutex_, NULL);
+  }
+
+  ~FreeJointPrior()
+  {
+    pthread_mutex_destroy(&mutex_);
+  }
+
+  /// \brief Sets the range of the free joint and the cell sizes, clears the histograms
+  void configure(double lower, double upper, double position_cell, double orientation_cell)
+  {
+    pthread_mutex_lock(&mutex_);
+    lower_ = lower;
+    upper_ = upper;
+    position_cell_ = position_cell;
+    orientation_cell_ = orientation_cell;
+    cells_.clear();
+    pthread_mutex_unlock(&mutex_);
+  }
+
+  bool configured() const { return upper_ > lower_ && position_cell_ > 0.0 && orientation_cell_ > 0.0; }
+
+  /// \brief Gets the key of the cell of a pose given as x y z qx qy qz qw
+  uint64_t cell(const double *pose) const
+  {
+    // q and -q are the same orientation, qw follows from the other components up to its sign
+    double sign = pose[6] < 0.0 ? -1.0 : 1.0;
+    int32_t coordinates[6];
+    for(int i = 0; i < 3; ++i)
+    {
+      coordinates[i] = (int32_t)floor(pose[i] / position_cell_);
+      coordinates[3 + i] = (int32_t)floor(sign * pose[3 + i] / orientation_cell_);
+    }
+
+    // FNV-1a
+    uint64_t key = 14695981039346656037ull;
+    const unsigned char *bytes = reinterpret_cast<const unsigned char*>(coordinates);
+    for(std::size_t i = 0; i < sizeof(coordinates); ++i)
+      key = (key ^ bytes[i]) * 1099511628211ull;
+    return key;
+  }
+
+  /// \brief Counts a successful free joint value in a cell
+  void record(uint64_t cell, double value)
+  {
+    if(!configured() || !(value >= lower_ && value <= upper_))
+      return;
+
+    pthread_mutex_lock(&mutex_);
+    std::map<uint64_t, std::vector<uint32_t> >::iterator it = cells_.find(cell);
+    if(it == cells_.end() && cells_.size() < FREE_JOINT_PRIOR_MAX_CELLS)
+      it = cells_.insert(std::make_pair(cell, std::vector<uint32_t>(FREE_JOINT_PRIOR_BINS, 0))).first;
+    if(it != cells_.end())
+    {
+      std::vector<uint32_t> &counts = it->second;
+      uint32_t &count = counts[bin(value)];
+      if(count == (uint32_t)-1)
+      {
+        // halving keeps the order of the bins
+        for(std::size_t i = 0; i < counts.size(); ++i)
+          counts[i] /= 2;
+      }
+      count++;
+    }
+    pthread_mutex_unlock(&mutex_);
+  }
+
+  /**
+   * @brief Gets the centers of the most frequent bins of a cell, most frequent first
+   * @return The number of values, at most max_values and zero for unknown cells
+   */
+  int mostFrequent(uint64_t cell, double *values, int max_values) const
+  {
+    std::pair<uint32_t, int> best[FREE_JOINT_PRIOR_BINS];
+    int num_best = 0;
+
+    pthread_mutex_lock(&mutex_);
+    std::map<uint64_t, std::vector<uint32_t> >::const_iterator it = cells_.find(cell);
+    for(uint32_t i = 0; it != cells_.end() && i < FREE_JOINT_PRIOR_BINS; ++i)
+    {
+      if(it->second[i] > 0)
+        best[num_best++] = std::make_pair(it->second[i], -(int)i);
+    }
+    pthread_mutex_unlock(&mutex_);
+
+    // highest counts first, the lower bin first on ties
+    int num_values = std::min(num_best, max_values);
+    std::partial_sort(best, best + num_values, best + num_best, std::greater<std::pair<uint32_t, int> >());
+    double width = (upper_ - lower_) / FREE_JOINT_PRIOR_BINS;
+    for(int i = 0; i < num_values; ++i)
+      values[i] = lower_ + (0.5 - best[i].second) * width;
+    return num_values;
+  }
+
+  std::size_t size() const
+  {
+    pthread_mutex_lock(&mutex_);
+    std::size_t num_cells = cells_.size();
+    pthread_mutex_unlock(&mutex_);
+    return num_cells;
+  }
+
+  /**
+   * @brief Replaces the histograms with the ones of a prior file
+   * @return False if the file can't be read or was written for another joint range or other cell sizes
+   */
+  bool load(const std::string &path)
+  {
+    FILE *file = fopen(path.c_str(), "rb");
+    if(file == NULL)
+      return false;
+
+    FreeJointPriorHeader header;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+              memcmp(header.magic, FREE_JOINT_PRIOR_MAGIC, sizeof(header.magic)) == 0 &&
+              header.version == FREE_JOINT_PRIOR_VERSION && header.num_bins == FREE_JOINT_PRIOR_BINS &&
+              header.lower == lower_ && header.upper == upper_ && header.position_cell == position_cell_ &&
+              header.orientation_cell == orientation_cell_ && header.num_cells <= FREE_JOINT_PRIOR_MAX_CELLS;
+
+    std::map<uint64_t, std::vector<uint32_t> > cells;
+    for(uint32_t i = 0; ok && i < header.num_cells; ++i)
+    {
+      uint64_t key;
+      std::vector<uint32_t> counts(FREE_JOINT_PRIOR_BINS);
+      ok = fread(&key, sizeof(key), 1, file) == 1 &&
+           fread(&counts[0], sizeof(uint32_t), counts.size(), file) == counts.size();
+      if(ok)
+        cells[key].swap(counts);
+    }
+    fclose(file);
+
+    if(ok)
+    {
+      pthread_mutex_lock(&mutex_);
+      cells_.swap(cells);
+      pthread_mutex_unlock(&mutex_);
+    }
+    return ok;
+  }
+
+  /// \brief Writes the histograms into a prior file, see load()
+  bool save(const std::string &path) const
+  {
+    pthread_mutex_lock(&mutex_);
+    std::map<uint64_t, std::vector<uint32_t> > cells = cells_;
+    pthread_mutex_unlock(&mutex_);
+
+    FILE *file = fopen(path.c_str(), "wb");
+    if(file == NULL)
+      return false;
+
+    FreeJointPriorHeader header;
+    memcpy(header.magic, FREE_JOINT_PRIOR_MAGIC, sizeof(header.magic));
+    header.version = FREE_JOINT_PRIOR_VERSION;
+    header.num_bins = FREE_JOINT_PRIOR_BINS;
+    header.num_cells = cells.size();
+    header.lower = lower_;
+    header.upper = upper_;
+    header.position_cell = position_cell_;
+    header.orientation_cell = orientation_cell_;
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    for(std::map<uint64_t, std::vector<uint32_t> >::const_iterator it = cells.begin(); ok && it != cells.end(); ++it)
+    {
+      ok = fwrite(&it->first, sizeof(it->first), 1, file) == 1 &&
+           fwrite(&it->second[0], sizeof(uint32_t), it->second.size(), file) == it->second.size();
+    }
+
+    if(fclose(file) != 0)
+      ok = false;
+    return ok;
+  }
+
+private:
+  uint32_t bin(double value) const
+  {
+    uint32_t i = (uint32_t)((value - lower_) / (upper_ - lower_) * FREE_JOINT_PRIOR_BINS);
+    return std::min(i, FREE_JOINT_PRIOR_BINS - 1);
+  }
+
+  mutable pthread_mutex_t mutex_;
+  double lower_;
+  double upper_;
+  double position_cell_;
+  double orientation_cell_;
+  std::map<uint64_t, std::vector<uint32_t> > cells_;
+};
+
+} // end namespace
+
+#endif
@@ -0,0 +1,367 @@
+/*
+ * Methods the ikfast kinematics plugins add to kinematics::KinematicsBase
+ *
+ * The plugins are loaded through pluginlib as a kinematics::KinematicsBase, callers reach these methods by
+ * casting the loaded solver:
+ *
+ *   ikfast_kinematics_plugin::IKFastKinematicsExtension *ikfast =
+ *     dynamic_cast<ikfast_kinematics_plugin::IKFastKinematicsExtension*>(solver.get());
+ *
+ * The cast yields NULL for solvers that aren't ikfast plugins.
+ */
+
+#ifndef IKFAST_KINEMATICS_EXTENSION_H
+#define IKFAST_KINEMATICS_EXTENSION_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+#include <boost/function.hpp>
+#include <Eigen/Geometry>
+#include <moveit/kinematics_base/kinematics_base.h>
+
+namespace ikfast_kinematics_plugin
+{
+
+/// \brief Identifies the branch of the solver's solution tree a solution comes from, e.g. shoulder left/right,
+/// elbow up/down and wrist flip of a 6R arm
+///
+/// Holds BRANCH_BITS bits per joint, joint 0 in the lowest ones, with the index of the root the joint took, see
+/// IkSingleDOFSolutionBase::indices. Joints with a single root and free joints are always 0.
+typedef uint32_t ConfigurationId;
+const int BRANCH_BITS = 4;
+
+/// \brief True if every root of a configuration parameter is -1 or fits into BRANCH_BITS, see ConfigurationId
+inline bool isValidConfiguration(const std::vector<int> &configuration)
+{
+  for(std::size_t j = 0; j < configuration.size(); ++j)
+  {
+    if(configuration[j] < -1 || configuration[j] >= (1 << BRANCH_BITS))
+      return false;
+  }
+  return true;
+}
+
+/// \brief Gets the root of each joint of a configuration, the form of the configuration parameter
+inline void getConfiguration(ConfigurationId id, std::size_t num_joints, std::vector<int> &configuration)
+{
+  configuration.resize(num_joints);
+  for(std::size_t j = 0; j < num_joints; ++j)
+    configuration[j] = (id >> (BRANCH_BITS * j)) & ((1 << BRANCH_BITS) - 1);
+}
+
+/// \brief Receives the solutions of the streaming multi solution getPositionIK(), see there
+class SolutionStreamVisitor
+{
+public:
+  virtual ~SolutionStreamVisitor() {}
+
+  /**
+   * @brief Called with each solution within the joint limits, in solver order
+   * @param solution the joint values, only valid during the call
+   * @return False to stop the query
+   */
+  virtual bool visit(const double *solution, ConfigurationId configuration) = 0;
+};
+
+/// \brief Adapts a function pointer or functor bool(const double *solution, ConfigurationId configuration)
+template<class Function>
+class FunctionStreamVisitor : public SolutionStreamVisitor
+{
+public:
+  FunctionStreamVisitor(Function function):
+    function_(function)
+  {
+  }
+
+  virtual bool visit(const double *solution, ConfigurationId configuration)
+  {
+    return function_(solution, configuration);
+  }
+
+private:
+  Function function_;
+};
+
+/// \brief Writes the solutions into a caller owned buffer of max_solutions rows of dof values, stops once it is full
+class BufferSolutionsVisitor : public SolutionStreamVisitor
+{
+public:
+  BufferSolutionsVisitor(double *buffer, std::size_t max_solutions, std::size_t dof,
+                         ConfigurationId *configurations = NULL):
+    buffer_(buffer),
+    configurations_(configurations),
+    max_solutions_(max_solutions),
+    dof_(dof),
+    size_(0)
+  {
+  }
+
+  virtual bool visit(const double *solution, ConfigurationId configuration)
+  {
+    if(size_ == max_solutions_)
+      return false;
+
+    std::copy(solution, solution + dof_, buffer_ + size_ * dof_);
+    if(configurations_ != NULL)
+      configurations_[size_] = configuration;
+    return ++size_ < max_solutions_;
+  }
+
+  /// \brief Number of rows written
+  std::size_t size() const { return size_; }
+
+private:
+  double *buffer_;
+  ConfigurationId *configurations_;
+  std::size_t max_solutions_;
+  std::size_t dof_;
+  std::size_t size_;
+};
+
+/**
+ * @brief Checks count candidate solutions of dof joint values each, stored one after the other, in a single call
+ *
+ * Sets valid[i] to a non-zero value if candidate i passes, e.g. is collision free. Used by searchPositionIK()
+ * instead of calling an IKCallbackFn once per candidate, see there.
+ */
+typedef boost::function<void (const geometry_msgs::Pose &ik_pose, const double *candidates, std::size_t count,
+                              std::size_t dof, uint8_t *valid)> BatchIKCallbackFn;
+
+/// \brief Counters of the callback memo, see IKFastKinematicsExtension::getCallbackMemoStats()
+struct CallbackMemoStats
+{
+  CallbackMemoStats(): hits(0), misses(0), evictions(0) {}
+
+  /// \brief Fraction of the lookups answered by the memo, 0 without lookups
+  double hitRate() const { return hits + misses > 0 ? (double)hits / (hits + misses) : 0.0; }
+
+  uint64_t hits;      // lookups that found a verdict
+  uint64_t misses;    // lookups that didn't, the callback was called
+  uint64_t evictions; // verdicts replaced by the one of another configuration
+};
+
+/// \brief Interface of the ikfast kinematics plugins beyond kinematics::KinematicsBase
+class IKFastKinematicsExtension : public kinematics::KinematicsBase
+{
+public:
+  using kinematics::KinematicsBase::getPositionIK;
+  using kinematics::KinematicsBase::searchPositionIK;
+  using kinematics::KinematicsBase::getPositionFK;
+
+  virtual ~IKFastKinematicsExtension() {}
+
+  /**
+   * @brief Same as the multi solution getPositionIK() for a single configuration, returning the configuration
+   * of each solution
+   *
+   * The solver prunes the branches of the other configurations, so they are never computed.
+   * @param configuration the root each joint of the solver has to take, -1 for any, see getConfiguration(). Replaces
+   *                      the configuration parameter unless empty
+   * @param configurations receives the configuration of each solution
+   */
+  virtual bool getPositionIK(const std::vector<geometry_msgs::Pose> &ik_poses,
+                             const std::vector<double> &ik_seed_state,
+                             const std::vector<int> &configuration,
+                             std::vector< std::vector<double> >& solutions,
+                             std::vector<ConfigurationId> &configurations,
+                             kinematics::KinematicsResult& result,
+                             const kinematics::KinematicsQueryOptions &options) const = 0;
+
+  /**
+   * @brief Same as the multi solution getPositionIK() for a single configuration, streaming the solutions to a
+   * visitor instead of collecting them
+   *
+   * The solutions are passed in solver order, the order of the free joint samples, and aren't sorted by cost. The
+   * samples are solved a block at a time, so the memory in use doesn't grow with the discretization.
+   * With the duplicate_tolerance parameter set, solutions within that tolerance of an earlier one of the same
+   * configuration are dropped before they reach the visitor or count towards max_solutions.
+   * @param visitor receives the solutions until it returns false, see BufferSolutionsVisitor for writing them into a
+   *                caller owned buffer and FunctionStreamVisitor for functions
+   * @param max_solutions the query stops after this many solutions, 0 for no limit
+   * @return True if at least one solution was passed to the visitor
+   */
+  virtual bool getPositionIK(const std::vector<geometry_msgs::Pose> &ik_poses,
+                             const std::vector<double> &ik_seed_state,
+                             const std::vector<int> &configuration,
+                             SolutionStreamVisitor &visitor,
+                             std::size_t max_solutions,
+                             kinematics::KinematicsResult& result,
+                             const kinematics::KinematicsQueryOptions &options) const = 0;
+
+  /**
+   * @brief Same as searchPositionIK() with a callback, checking the candidates of each solver call, all branches of
+   * the pose for one set of free joint values, with a single call of batch_callback
+   *
+   * With several free joints the candidates of a whole shell of the free joint search are checked at once. The result
+   * is the one of checking the candidates one by one, but the callback sees every candidate that could be the result
+   * instead of stopping at the first that passes. Pass a BatchIKCallbackFn object, a plain function or bind
+   * expression is ambiguous with the IKCallbackFn overload.
+   */
+  virtual bool searchPositionIK(const geometry_msgs::Pose &ik_pose,
+                                const std::vector<double> &ik_seed_state,
+                                double timeout,
+                                const std::vector<double> &consistency_limits,
+                                std::vector<double> &solution,
+                                const BatchIKCallbackFn &batch_callback,
+                                moveit_msgs::MoveItErrorCodes &error_code,
+                                const kinematics::KinematicsQueryOptions &options = kinematics::KinematicsQueryOptions()) const = 0;
+
+  /**
+   * @brief Same as searchPositionIK() with a callback, reporting whether a failure is definitive
+   *
+   * A solver without free joints tries every solution of the pose within the joint limits, whatever the seed, so
+   * retrying the query from other seeds is pointless after it failed. The free joint sweep of other solvers steps
+   * from the seed values of the free joints, so other seeds sample other free joint values.
+   * @param definitive set to true if the query failed and would fail from any seed: the solver has no free joints and
+   *                   no solution of the pose within the joint limits passed the callback. Always false for solvers
+   *                   with free joints, and false if the query was invalid.
+   */
+  virtual bool searchPositionIK(const geometry_msgs::Pose &ik_pose,
+                                const std::vector<double> &ik_seed_state,
+                                double timeout,
+                                const std::vector<double> &consistency_limits,
+                                std::vector<double> &solution,
+                                const IKCallbackFn &solution_callback,
+                                moveit_msgs::MoveItErrorCodes &error_code,
+                                bool &definitive,
+                                const kinematics::KinematicsQueryOptions &options = kinematics::KinematicsQueryOptions()) const = 0;
+
+  /**
+   * @brief searchPositionIK() with a callback, retried from random seeds within the joint limits like the
+   * kinematics_solver_attempts of RobotState::setFromIK(), but stopping at the first definitive failure
+   * @param attempts the most queries, the first one from ik_seed_state
+   */
+  virtual bool searchPositionIKWithRestarts(const geometry_msgs::Pose &ik_pose,
+                                            const std::vector<double> &ik_seed_state,
+                                            double timeout,
+                                            const std::vector<double> &consistency_limits,
+                                            std::vector<double> &solution,
+                                            const IKCallbackFn &solution_callback,
+                                            moveit_msgs::MoveItErrorCodes &error_code,
+                                            unsigned int attempts,
+                                            const kinematics::KinematicsQueryOptions &options = kinematics::KinematicsQueryOptions()) const = 0;
+
+  /**
+   * @brief Sets the version of the scene the searchPositionIK() callbacks check against
+   *
+   * With the callback_memo_size parameter set, the verdicts of the callbacks are memoized per cell of
+   * callback_memo_resolution of the joint values and scene version. Change the version whenever the verdict of a
+   * configuration may change, e.g. when the planning scene changes.
+   */
+  virtual void setCallbackMemoSceneVersion(uint64_t version) = 0;
+
+  /// \brief Gets the hits and misses of the callback memo since it was configured or cleared
+  virtual CallbackMemoStats getCallbackMemoStats() const = 0;
+
+  /// \brief Forgets the memoized verdicts of the callbacks and resets the counters
+  virtual void clearCallbackMemo() = 0;
+
+  /**
+   * @brief Computes the pose of the tip link without any intermediate allocation or conversion
+   *
+   * @param joint_angles The state for which FK is being computed, getJointNames().size() values
+   * @param transform The resultant pose as a row major 3x4 matrix [R|t] (in the frame returned by getBaseFrame())
+   * @return True if FK is supported by the solver, false otherwise
+   */
+  virtual bool getPositionFK(const double *joint_angles, double *transform) const = 0;
+
+  /**
+   * @brief Computes the pose of the tip link without any intermediate allocation or conversion
+   *
+   * @param joint_angles The state for which FK is being computed, getJointNames().size() values
+   * @param pose The resultant pose (in the frame returned by getBaseFrame())
+   * @return True if FK is supported by the solver, false otherwise
+   */
+  virtual bool getPositionFK(const double *joint_angles, Eigen::Isometry3d &pose) const = 0;
+
+  /**
+   * @brief Computes the pose of the tip link for several states
+   *
+   * @param joint_angles count states stored contiguously, getJointNames().size() values each
+   * @param count The number of states
+   * @param transforms count row major 3x4 matrices [R|t] stored contiguously
+   * @return True if FK is supported by the solver, false otherwise
+   */
+  virtual bool getPositionFK(const double *joint_angles, std::size_t count, double *transforms) const = 0;
+
+  /**
+   * @brief Computes the pose of every link of the chain in a single pass from the base to the tip
+   *
+   * The pass chains the fixed origins and joint axes of the URDF segments, not the generated ComputeFk of the
+   * solver, which only yields the tip pose.
+   * @param joint_angles The state for which FK is being computed, getJointNames().size() values
+   * @param transforms getLinkNames().size() row major 3x4 matrices [R|t] stored contiguously in the order
+   *                   of getLinkNames() (in the frame returned by getBaseFrame())
+   * @return True if the chain was read from the URDF, false otherwise
+   */
+  virtual bool getChainFK(const double *joint_angles, double *transforms) const = 0;
+
+  /**
+   * @brief Computes the pose of every link of the chain for several states, one state after the other
+   *
+   * @param joint_angles count states stored contiguously, getJointNames().size() values each
+   * @param count The number of states
+   * @param transforms count * getLinkNames().size() row major 3x4 matrices [R|t] stored contiguously
+   * @return True if the chain was read from the URDF, false otherwise
+   */
+  virtual bool getChainFK(const double *joint_angles, std::size_t count, double *transforms) const = 0;
+
+  /**
+   * @brief Computes the Jacobian of the tip link in closed form from the joint axes of the chain
+   *
+   * The joint axes and origins come from the same pass over the URDF segments as getChainFK(), the solver
+   * doesn't generate a Jacobian.
+   * @param joint_angles The state for which the Jacobian is being computed, getJointNames().size() values
+   * @param jacobian The 6 x getJointNames().size() column major Jacobian relating the joint velocities to the
+   *                 linear and angular velocity [v w] of the tip link origin (in the frame returned by getBaseFrame())
+   * @return True if the chain was read from the URDF, false otherwise
+   */
+  virtual bool getJacobian(const double *joint_angles, double *jacobian) const = 0;
+
+  /**
+   * @brief Computes the Jacobian of the tip link for several states, one state after the other
+   *
+   * @param joint_angles count states stored contiguously, getJointNames().size() values each
+   * @param count The number of states
+   * @param jacobians count column major Jacobians stored contiguously, see getJacobian()
+   * @return True if the chain was read from the URDF, false otherwise
+   */
+  virtual bool getJacobian(const double *joint_angles, std::size_t count, double *jacobians) const = 0;
+
+  /**
+   * @brief Computes the manipulability measure sqrt(det(J*J^T)) of the tip link, zero at singularities
+   *
+   * @param joint_angles The state for which the manipulability is being computed, getJointNames().size() values
+   * @param manipulability The resultant measure
+   * @return True if the chain was read from the URDF, false otherwise
+   */
+  virtual bool getManipulability(const double *joint_angles, double &manipulability) const = 0;
+
+  /**
+   * @brief Computes the manipulability measure for several states, one state after the other
+   *
+   * @param joint_angles count states stored contiguously, getJointNames().size() values each
+   * @param count The number of states
+   * @param manipulability count resultant measures
+   * @return True if the chain was read from the URDF, false otherwise
+   */
+  virtual bool getManipulability(const double *joint_angles, std::size_t count, double *manipulability) const = 0;
+
+  /**
+   * @brief Computes the joint velocities realizing a twist of the tip link by damped least squares,
+   * qdot = J^T (J*J^T + damping^2*I)^-1 twist, which stays bounded close to singularities
+   *
+   * @param joint_angles The current state, getJointNames().size() values
+   * @param twist The desired linear and angular velocity [v w] of the tip link origin (in the frame returned by getBaseFrame())
+   * @param damping Damping factor, 0 gives the minimum norm solution
+   * @param joint_velocities The resultant getJointNames().size() joint velocities
+   * @return True if the chain was read from the URDF, false otherwise
+   */
+  virtual bool getVelocityIK(const double *joint_angles, const double *twist, double damping,
+                             double *joint_velocities) const = 0;
+};
+
+} // end namespace
+
+#endif
@@ -0,0 +1,172 @@
+/*
+ * Structured tracing of the IKFast plugin queries
+ *
+ * Events are stored as fixed size binary records in a ring buffer owned by the recording
+ * thread, so recording neither formats strings nor takes a lock. Tracing is compiled out with
+ * -DIKFAST_TRACE=0 and otherwise gated at run time by setTraceLevel(), at TRACE_OFF the hot
+ * paths only pay for one comparison per event. writeTrace() dumps the buffers of every thread
+ * into a file that is decoded with the ikfast_trace_dump tool.
+ *
+ * The trace level and the buffers are defined once in the ikfast_kinematics_extension library, so every plugin
+ * loaded into a process shares them.
+ *
+ * Trace file: a TraceFileHeader followed by num_threads blocks, each one a TraceThreadHeader
+ * and num_records TraceRecords, oldest first.
+ */
+
+#ifndef IKFAST_TRACE_H
+#define IKFAST_TRACE_H
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <string>
+
+#ifndef IKFAST_TRACE
+#define IKFAST_TRACE 1
+#endif
+
+/// \brief True if events of the given TRACE_LEVEL are recorded, constant false when compiled out
+#define IKFAST_TRACE_ENABLED(level) (IKFAST_TRACE && ikfast_trace::traceLevel() >= (level))
+
+namespace ikfast_trace
+{
+
+const char TRACE_FILE_MAGIC[4] = {'I','K','T','R'};
+const uint32_t TRACE_FILE_VERSION = 1;
+const int MAX_TRACE_VALUES = 8;           // enough for the joint values of MAX_CHAIN_JOINTS joints
+const uint32_t TRACE_BUFFER_SIZE = 4096;  // records per thread, a power of two
+
+/// \brief Each level records its events and the ones of the levels below
+enum TRACE_LEVEL { TRACE_OFF=0, TRACE_QUERIES=1, TRACE_SEARCH=2, TRACE_SOLUTIONS=3 };
+
+/// \brief The events and what their arg and values hold
+enum TRACE_EVENT
+{
+  QUERY_BEGIN=0,     ///< arg: QUERY_TYPE, values: x y z qx qy qz qw of the pose (TRACE_QUERIES)
+  QUERY_END=1,       ///< arg: 1 if solved, values: number of solutions, solver calls (TRACE_QUERIES)
+  FREE_JOINT_STEP=2, ///< arg: search counter, values: the free joint values (TRACE_SEARCH)
+  SOLVER_RESULT=3,   ///< arg: number of solutions of one solver call (TRACE_SEARCH)
+  SOLUTION=4,        ///< arg: solution index, values: the joint values (TRACE_SOLUTIONS)
+  CALLBACK_RESULT=5, ///< arg: error code returned by the callback, values: the joint values (TRACE_SOLUTIONS)
+  NUM_TRACE_EVENTS=6
+};
+
+enum QUERY_TYPE { GET_POSITION_IK=0, GET_POSITION_IK_MULTIPLE=1, SEARCH_POSITION_IK=2 };
+
+struct TraceRecord
+{
+  uint64_t time_ns;    // CLOCK_MONOTONIC
+  uint32_t query;      // per thread query number, incremented by every QUERY_BEGIN
+  uint16_t event;      // TRACE_EVENT
+  uint16_t num_values;
+  int32_t arg;
+  uint32_t reserved;
+  double values[MAX_TRACE_VALUES];
+};
+
+struct TraceFileHeader
+{
+  char magic[4];
+  uint32_t version;
+  uint32_t record_size;
+  uint32_t num_threads;
+};
+
+struct TraceThreadHeader
+{
+  uint32_t thread;      // order in which the threads recorded their first event
+  uint32_t num_records;
+  uint64_t num_dropped; // older records overwritten in the ring buffer
+};
+
+/// \brief Ring buffer of one thread, written by that thread only
+struct ThreadBuffer
+{
+  ThreadBuffer(uint32_t thread): thread(thread), head(0), query(0) {}
+
+  uint32_t thread;
+  volatile uint64_t head; // number of records written so far
+  uint32_t query;
+  TraceRecord records[TRACE_BUFFER_SIZE];
+};
+
+/// \brief The TRACE_LEVEL of the process, TRACE_OFF until setTraceLevel() is called
+extern volatile int trace_level;
+
+inline int traceLevel()
+{
+  return trace_level;
+}
+
+inline void setTraceLevel(int level)
+{
+  trace_level = level;
+}
+
+/// \brief Gets the buffer of the calling thread, allocated on its first event and kept after the thread exits
+ThreadBuffer& threadBuffer();
+
+/**
+ * @brief Appends an event to the buffer of the calling thread
+ *
+ * Callers check IKFAST_TRACE_ENABLED() first, values beyond MAX_TRACE_VALUES are dropped.
+ */
+inline void record(TRACE_EVENT event, int32_t arg, const double *values = NULL, int num_values = 0)
+{
+  ThreadBuffer &buffer = threadBuffer();
+  if(event == QUERY_BEGIN)
+    buffer.query++;
+
+  uint64_t head = buffer.head;
+  TraceRecord &record = buffer.records[head & (TRACE_BUFFER_SIZE - 1)];
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  record.time_ns = (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+  record.query = buffer.query;
+  record.event = event;
+  record.num_values = std::max(0, std::min(num_values, MAX_TRACE_VALUES));
+  record.arg = arg;
+  record.reserved = 0;
+  if(record.num_values > 0)
+    memcpy(record.values, values, record.num_values * sizeof(double));
+
+  // publishes the record to writeTrace()
+  __sync_synchronize();
+  buffer.head = head + 1;
+}
+
+/**
+ * @brief Writes the buffers of all threads into a trace file
+ *
+ * Safe to call while other threads record, records they overwrite during the copy are dropped.
+ * @return False if the file couldn't be written
+ */
+bool writeTrace(const std::string &path);
+
+inline const char* traceEventName(uint16_t event)
+{
+  static const char* names[NUM_TRACE_EVENTS] = {"query_begin", "query_end", "free_joint_step", "solver_result",
+                                                "solution", "callback_result"};
+  return event < NUM_TRACE_EVENTS ? names[event] : "unknown";
+}
+
+inline const char* queryTypeName(int32_t type)
+{
+  switch(type)
+  {
+    case GET_POSITION_IK:
+      return "getPositionIK";
+    case GET_POSITION_IK_MULTIPLE:
+      return "getPositionIK(multiple)";
+    case SEARCH_POSITION_IK:
+      return "searchPositionIK";
+    default:
+      return "unknown";
+  }
+}
+
+} // end namespace
+
+#endif
@@ -0,0 +1,145 @@
+/*
+ * Joint limits in the layout the ikfast plugins check them in
+ *
+ * Shared by the ikfast kinematics plugins and their offline batch tools, so that both prune the solution
+ * tree of the solver with the same limits.
+ */
+
+#ifndef IKFAST_JOINT_LIMITS_TABLE_H
+#define IKFAST_JOINT_LIMITS_TABLE_H
+
+#include <stdio.h>
+#include <algorithm>
+#include <limits>
+#include <vector>
+#include <Eigen/Core>
+#include <ikfast_kinematics_extension/ikfast_kinematics_extension.h>
+
+namespace ikfast_kinematics_plugin
+{
+
+// Upper bound on the joints of the chain, sizes the stack buffers of the Jacobian based methods
+const int MAX_CHAIN_JOINTS = 8;
+
+/// \brief Joint limits padded to MAX_CHAIN_JOINTS lanes and aligned, so that all joints are checked at once
+///
+/// Joints without limits and the lanes beyond the chain hold -inf/+inf, which every value passes,
+/// so the checks need neither a has-limits branch per joint nor an early exit. The solver also prunes
+/// the branches of its solution tree outside of branch_masks, see ConfigurationId.
+struct JointLimitsTable
+{
+  JointLimitsTable():
+    num_joints(0),
+    filter_branches(false)
+  {
+    for(int i = 0; i < MAX_CHAIN_JOINTS; ++i)
+    {
+      lower[i] = -std::numeric_limits<double>::infinity();
+      upper[i] = std::numeric_limits<double>::infinity();
+      branch_masks[i] = 0xffff;
+    }
+  }
+
+  typedef Eigen::Array<double, MAX_CHAIN_JOINTS, 1> Lanes;
+
+  bool withinLimits(std::size_t joint, double value) const
+  {
+    return value >= lower[joint] && value <= upper[joint];
+  }
+
+  /// \brief True if all num_joints values are within limits, NaN values are not
+  bool withinLimits(const double *joint_values) const
+  {
+    EIGEN_ALIGN16 double padded[MAX_CHAIN_JOINTS] = {0.0};
+    std::copy(joint_values, joint_values + num_joints, padded);
+
+    // the smallest margin to either limit of any lane computed with packet min, the sum only serves
+    // to reject NaN values, which compare false but may be dropped by the min
+    Eigen::Map<const Lanes, Eigen::Aligned> values(padded), lower_lanes(lower), upper_lanes(upper);
+    double margin = (values - lower_lanes).min(upper_lanes - values).minCoeff();
+    double sum = values.sum();
+    return margin >= 0.0 && sum == sum;
+  }
+
+  /**
+   * @brief Checks count candidates of num_joints values each, stored one after the other
+   * @param valid receives 1 for the candidates within limits and 0 for the others
+   * @return The number of candidates within limits
+   */
+  std::size_t withinLimits(const double *candidates, std::size_t count, unsigned char *valid) const
+  {
+    std::size_t num_valid = 0;
+    for(std::size_t i = 0; i < count; ++i)
+    {
+      valid[i] = withinLimits(candidates + i*num_joints) ? 1 : 0;
+      num_valid += valid[i];
+    }
+    return num_valid;
+  }
+
+  /// \brief Narrows each joint j to [center[j] - radius[j], center[j] + radius[j]]
+  void narrow(const double *center, const double *radius)
+  {
+    for(std::size_t j = 0; j < num_joints; ++j)
+    {
+      lower[j] = std::max(lower[j], center[j] - radius[j]);
+      upper[j] = std::min(upper[j], center[j] + radius[j]);
+    }
+  }
+
+  /**
+   * @brief Restricts the solver to one configuration
+   * @param configuration the root each joint has to take, -1 for any, an empty configuration allows all
+   */
+  void setConfiguration(const std::vector<int> &configuration)
+  {
+    filter_branches = false;
+    for(std::size_t j = 0; j < MAX_CHAIN_JOINTS; ++j)
+    {
+      bool any = j >= configuration.size() || configuration[j] < 0 || configuration[j] >= (1 << BRANCH_BITS);
+      branch_masks[j] = any ? 0xffff : (unsigned short)(1 << configuration[j]);
+      filter_branches = filter_branches || !any;
+    }
+  }
+
+  /// \brief The branch masks in the form expected by the solver, NULL when all branches are allowed
+  const unsigned short* branchMasks() const { return filter_branches ? branch_masks : NULL; }
+
+  /**
+   * @brief Reads the limits of the first num_joints joints from a text file
+   *
+   * The file holds a "lower upper" pair per joint in the joint order of the solver, "-inf inf" for
+   * joints without limits. The table is left unchanged on failure.
+   * @return False if the file can't be read or holds fewer than num_joints pairs
+   */
+  bool load(const char *path, std::size_t num_joints)
+  {
+    if(num_joints > (std::size_t)MAX_CHAIN_JOINTS)
+      return false;
+    FILE *file = fopen(path, "r");
+    if(file == NULL)
+      return false;
+
+    JointLimitsTable limits;
+    limits.num_joints = num_joints;
+    bool complete = true;
+    for(std::size_t j = 0; j < num_joints && complete; ++j)
+      complete = fscanf(file, "%lf %lf", &limits.lower[j], &limits.upper[j]) == 2;
+    fclose(file);
+
+    if(!complete)
+      return false;
+    *this = limits;
+    return true;
+  }
+
+  EIGEN_ALIGN16 double lower[MAX_CHAIN_JOINTS];
+  EIGEN_ALIGN16 double upper[MAX_CHAIN_JOINTS];
+  std::size_t num_joints;
+  unsigned short branch_masks[MAX_CHAIN_JOINTS]; // bit i of branch_masks[j] allows root i of joint j
+  bool filter_branches;
+};
+
+} // end namespace
+
+#endif
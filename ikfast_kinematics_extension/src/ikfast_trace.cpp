@@ -0,0 +1,87 @@
+/*
+ * The state of ikfast_trace.h shared by every plugin of a process
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <vector>
+
+#include <ikfast_kinematics_extension/ikfast_trace.h>
+
+namespace ikfast_trace
+{
+
+volatile int trace_level = TRACE_OFF;
+
+namespace
+{
+
+/// \brief The buffers of all threads that ever recorded, they are kept after the thread exits
+pthread_mutex_t registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+std::vector<ThreadBuffer*> registry_buffers;
+
+__thread ThreadBuffer *thread_buffer = NULL;
+
+} // end namespace
+
+ThreadBuffer& threadBuffer()
+{
+  if(thread_buffer == NULL)
+  {
+    pthread_mutex_lock(&registry_mutex);
+    thread_buffer = new ThreadBuffer(registry_buffers.size());
+    registry_buffers.push_back(thread_buffer);
+    pthread_mutex_unlock(&registry_mutex);
+  }
+  return *thread_buffer;
+}
+
+bool writeTrace(const std::string &path)
+{
+  pthread_mutex_lock(&registry_mutex);
+  std::vector<ThreadBuffer*> buffers = registry_buffers;
+  pthread_mutex_unlock(&registry_mutex);
+
+  FILE *file = fopen(path.c_str(), "wb");
+  if(file == NULL)
+    return false;
+
+  TraceFileHeader header;
+  memcpy(header.magic, TRACE_FILE_MAGIC, sizeof(header.magic));
+  header.version = TRACE_FILE_VERSION;
+  header.record_size = sizeof(TraceRecord);
+  header.num_threads = buffers.size();
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+  std::vector<TraceRecord> records;
+  for(std::size_t t = 0; ok && t < buffers.size(); ++t)
+  {
+    const ThreadBuffer &buffer = *buffers[t];
+    uint64_t end = buffer.head;
+    __sync_synchronize();
+    uint64_t begin = end > TRACE_BUFFER_SIZE ? end - TRACE_BUFFER_SIZE : 0;
+    records.clear();
+    for(uint64_t i = begin; i < end; ++i)
+      records.push_back(buffer.records[i & (TRACE_BUFFER_SIZE - 1)]);
+
+    // the slot of index i is reused by record i + TRACE_BUFFER_SIZE, the one being written may be torn
+    __sync_synchronize();
+    uint64_t head = buffer.head;
+    uint64_t first_valid = head + 1 > TRACE_BUFFER_SIZE ? head + 1 - TRACE_BUFFER_SIZE : 0;
+    std::size_t skip = first_valid > begin ? std::min<uint64_t>(first_valid - begin, records.size()) : 0;
+
+    TraceThreadHeader thread_header;
+    thread_header.thread = buffer.thread;
+    thread_header.num_records = records.size() - skip;
+    thread_header.num_dropped = begin + skip;
+    ok = fwrite(&thread_header, sizeof(thread_header), 1, file) == 1 &&
+         (thread_header.num_records == 0 ||
+          fwrite(&records[skip], sizeof(TraceRecord), thread_header.num_records, file) == thread_header.num_records);
+  }
+
+  if(fclose(file) != 0)
+    ok = false;
+  return ok;
+}
+
+} // end namespace
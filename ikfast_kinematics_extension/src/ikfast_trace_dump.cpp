@@ -0,0 +1,118 @@
+/*
+ * Decodes a trace file written by the IKFast plugins, see ikfast_trace.h
+ *
+ * Prints one line per record, grouped by thread and oldest first, with the time relative to
+ * the first record of the file.
+ *
+ * Usage: ikfast_trace_dump trace.bin [query]
+ *   query  only prints the records of this query number
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include <ikfast_kinematics_extension/ikfast_trace.h>
+
+using namespace ikfast_trace;
+
+struct ThreadTrace
+{
+  TraceThreadHeader header;
+  std::vector<TraceRecord> records;
+};
+
+bool readTrace(const char *path, std::vector<ThreadTrace> &threads)
+{
+  FILE *file = fopen(path, "rb");
+  if(file == NULL)
+  {
+    perror(path);
+    return false;
+  }
+
+  TraceFileHeader header;
+  bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+            memcmp(header.magic, TRACE_FILE_MAGIC, sizeof(header.magic)) == 0 &&
+            header.version == TRACE_FILE_VERSION && header.record_size == sizeof(TraceRecord);
+  if(!ok)
+    fprintf(stderr, "%s: not a trace file of version %u\n", path, TRACE_FILE_VERSION);
+
+  threads.resize(ok ? header.num_threads : 0);
+  for(std::size_t t = 0; ok && t < threads.size(); ++t)
+  {
+    ok = fread(&threads[t].header, sizeof(TraceThreadHeader), 1, file) == 1;
+    threads[t].records.resize(ok ? threads[t].header.num_records : 0);
+    ok = ok && (threads[t].records.empty() ||
+                fread(&threads[t].records[0], sizeof(TraceRecord), threads[t].records.size(), file) == threads[t].records.size());
+    if(!ok)
+      fprintf(stderr, "%s: truncated\n", path);
+  }
+
+  fclose(file);
+  return ok;
+}
+
+void printRecord(const TraceRecord &record, uint64_t start_ns)
+{
+  printf("  %12.3f us  query %6u  %-16s", (record.time_ns - start_ns) * 1e-3, record.query, traceEventName(record.event));
+  switch(record.event)
+  {
+    case QUERY_BEGIN:
+      printf(" %-24s", queryTypeName(record.arg));
+      break;
+    case QUERY_END:
+      printf(" %-24s", record.arg ? "solved" : "failed");
+      break;
+    case CALLBACK_RESULT:
+      printf(" error code %-13d", record.arg);
+      break;
+    default:
+      printf(" %-24d", record.arg);
+      break;
+  }
+
+  if(record.num_values > 0)
+  {
+    printf(" [");
+    for(int i = 0; i < record.num_values && i < MAX_TRACE_VALUES; ++i)
+      printf(i == 0 ? "%g" : " %g", record.values[i]);
+    printf("]");
+  }
+  printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+  if(argc < 2)
+  {
+    fprintf(stderr, "Usage: %s trace.bin [query]\n", argv[0]);
+    return 1;
+  }
+  long query = argc > 2 ? atol(argv[2]) : -1;
+
+  std::vector<ThreadTrace> threads;
+  if(!readTrace(argv[1], threads))
+    return 1;
+
+  uint64_t start_ns = (uint64_t)-1;
+  for(std::size_t t = 0; t < threads.size(); ++t)
+  {
+    if(!threads[t].records.empty())
+      start_ns = std::min(start_ns, threads[t].records[0].time_ns);
+  }
+
+  for(std::size_t t = 0; t < threads.size(); ++t)
+  {
+    const ThreadTrace &thread = threads[t];
+    printf("thread %u: %u records, %llu dropped\n", thread.header.thread, thread.header.num_records,
+           (unsigned long long)thread.header.num_dropped);
+    for(std::size_t i = 0; i < thread.records.size(); ++i)
+    {
+      if(query < 0 || thread.records[i].query == (uint32_t)query)
+        printRecord(thread.records[i], start_ns);
+    }
+  }
+  return 0;
+}
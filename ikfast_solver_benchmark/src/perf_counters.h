@@ -0,0 +1,112 @@
+/*
+ * Hardware performance counters of the calling thread through perf_event_open(2)
+ */
+
+#ifndef IKFAST_SOLVER_BENCHMARK_PERF_COUNTERS_H
+#define IKFAST_SOLVER_BENCHMARK_PERF_COUNTERS_H
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace ikfast_solver_benchmark
+{
+
+/// \brief The counters read by PerfCounters, in group order
+enum PERF_COUNTER { INSTRUCTIONS=0, CYCLES=1, BRANCH_MISSES=2, CACHE_MISSES=3, NUM_PERF_COUNTERS=4 };
+
+/**
+ * @brief Counts user space events of the calling thread as one group, so that all counters
+ * cover the same interval
+ *
+ * Opening the counters fails when the kernel doesn't expose them, e.g. in containers or with
+ * a restrictive /proc/sys/kernel/perf_event_paranoid, in which case available() is false and
+ * the benchmark falls back to timing only.
+ */
+class PerfCounters
+{
+public:
+  PerfCounters()
+  {
+    static const uint64_t configs[NUM_PERF_COUNTERS] = {PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CPU_CYCLES,
+                                                        PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_HW_CACHE_MISSES};
+    for(int i = 0; i < NUM_PERF_COUNTERS; ++i)
+      fds_[i] = -1;
+
+    for(int i = 0; i < NUM_PERF_COUNTERS; ++i)
+    {
+      struct perf_event_attr attr;
+      memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.config = configs[i];
+      attr.disabled = i == 0;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_GROUP;
+
+      fds_[i] = syscall(__NR_perf_event_open, &attr, 0, -1, i == 0 ? -1 : fds_[0], 0);
+      if(fds_[i] < 0)
+      {
+        close();
+        return;
+      }
+    }
+  }
+
+  ~PerfCounters()
+  {
+    close();
+  }
+
+  bool available() const { return fds_[0] >= 0; }
+
+  void start()
+  {
+    if(!available())
+      return;
+    ioctl(fds_[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(fds_[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  }
+
+  /**
+   * @brief Stops counting and gets the counts since start()
+   * @return False if the counters aren't available
+   */
+  bool stop(uint64_t counts[NUM_PERF_COUNTERS])
+  {
+    if(!available())
+      return false;
+    ioctl(fds_[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+    uint64_t values[1 + NUM_PERF_COUNTERS];
+    if(read(fds_[0], values, sizeof(values)) != (ssize_t)sizeof(values) || values[0] != NUM_PERF_COUNTERS)
+      return false;
+    for(int i = 0; i < NUM_PERF_COUNTERS; ++i)
+      counts[i] = values[1 + i];
+    return true;
+  }
+
+private:
+  PerfCounters(const PerfCounters&);
+  PerfCounters& operator=(const PerfCounters&);
+
+  void close()
+  {
+    for(int i = NUM_PERF_COUNTERS - 1; i >= 0; --i)
+    {
+      if(fds_[i] >= 0)
+        ::close(fds_[i]);
+      fds_[i] = -1;
+    }
+  }
+
+  int fds_[NUM_PERF_COUNTERS];
+};
+
+} // end namespace
+
+#endif
@@ -0,0 +1,277 @@
+/*
+ * Microbenchmarks of a generated IKFast solver in isolation
+ *
+ * Times ComputeFk, ComputeIk, PrepareIk + ComputeIkPrepared and ComputeIkVisit of the solver
+ * selected with IKFAST_SOLVER_SOURCE and reads the hardware performance counters of each loop,
+ * no ROS master, parameter server or plugin loading is involved. The poses are either read from
+ * a pose corpus (see kinematics_base_test/pose_corpus.h) or computed with ComputeFk from seeded
+ * random joint values, so runs are repeatable.
+ *
+ * Usage: <robot>_solver_benchmark [--check-allocations] [corpus.bin] [iterations]
+ *
+ * With --check-allocations the benchmark fails if an entry point declared in ZERO_ALLOCATION
+ * allocates on the heap.
+ */
+
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "perf_counters.h"
+#include <kinematics_base_test/pose_corpus.h>
+#include <kinematics_base_test/allocation_counter.h>
+
+#define IKFAST_NO_MAIN // Don't include main() from IKFast
+
+// Code generated by IKFast56/61
+#include IKFAST_SOLVER_SOURCE
+
+using namespace ikfast_solver_benchmark;
+using kinematics_base_test::PoseCorpus;
+using kinematics_base_test::PoseCorpusRecord;
+using kinematics_base_test::AllocationScope;
+
+const int DEFAULT_NUM_POSES = 1000;
+const int DEFAULT_ITERATIONS = 10;
+const unsigned short RANDOM_SEED[3] = {0x1234, 0x5678, 0x9abc};
+
+/// \brief Solver input of one pose
+struct BenchmarkPose
+{
+  IkReal eetrans[3];
+  IkReal eerot[9];
+  std::vector<IkReal> pfree;
+};
+
+/// \brief Counts the solutions without storing them
+class CountingVisitor : public IkSolutionVisitorBase<IkReal>
+{
+public:
+  CountingVisitor(): count(0), checksum(0.0) {}
+
+  virtual bool Visit(const IkReal* solution, const std::vector<IkSingleDOFSolutionBase<IkReal> >& /*vinfos*/)
+  {
+    count++;
+    checksum += solution[0];
+    return true;
+  }
+
+  size_t count;
+  double checksum;
+};
+
+/// \brief Accumulated cost of one entry point
+struct BenchmarkResult
+{
+  BenchmarkResult(): calls(0), solutions(0), allocations(0), bytes(0), nsec(0.0), counters_valid(false)
+  {
+    for(int i = 0; i < NUM_PERF_COUNTERS; ++i)
+      counts[i] = 0;
+  }
+
+  uint64_t calls;
+  uint64_t solutions;
+  uint64_t allocations;
+  uint64_t bytes;
+  double nsec;
+  bool counters_valid;
+  uint64_t counts[NUM_PERF_COUNTERS];
+};
+
+double wallNsec()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/// \brief Converts a corpus record, the free joints are taken from its joint values when known
+BenchmarkPose toBenchmarkPose(const PoseCorpus &corpus, std::size_t i)
+{
+  const PoseCorpusRecord &record = corpus.record(i);
+  const double *joint_values = corpus.jointValues(i);
+  double x = record.pose[3], y = record.pose[4], z = record.pose[5], w = record.pose[6];
+
+  BenchmarkPose pose;
+  pose.eetrans[0] = record.pose[0];
+  pose.eetrans[1] = record.pose[1];
+  pose.eetrans[2] = record.pose[2];
+  pose.eerot[0] = 1 - 2*(y*y + z*z); pose.eerot[1] = 2*(x*y - z*w);     pose.eerot[2] = 2*(x*z + y*w);
+  pose.eerot[3] = 2*(x*y + z*w);     pose.eerot[4] = 1 - 2*(x*x + z*z); pose.eerot[5] = 2*(y*z - x*w);
+  pose.eerot[6] = 2*(x*z - y*w);     pose.eerot[7] = 2*(y*z + x*w);     pose.eerot[8] = 1 - 2*(x*x + y*y);
+
+  pose.pfree.resize(GetNumFreeParameters());
+  for(int f = 0; f < GetNumFreeParameters(); ++f)
+  {
+    double value = joint_values[GetFreeParameters()[f]];
+    pose.pfree[f] = isnan(value) ? 0.0 : value;
+  }
+  return pose;
+}
+
+/// \brief FK of seeded random joint values, the free joints are the ones of the sampled state
+void generatePoses(int num_poses, std::vector<BenchmarkPose> &poses, std::vector<std::vector<IkReal> > &joint_values)
+{
+  unsigned short state[3] = {RANDOM_SEED[0], RANDOM_SEED[1], RANDOM_SEED[2]};
+  poses.resize(num_poses);
+  joint_values.resize(num_poses);
+  for(int i = 0; i < num_poses; ++i)
+  {
+    joint_values[i].resize(GetNumJoints());
+    for(int j = 0; j < GetNumJoints(); ++j)
+      joint_values[i][j] = (2.0 * erand48(state) - 1.0) * M_PI;
+
+    ComputeFk(&joint_values[i][0], poses[i].eetrans, poses[i].eerot);
+    poses[i].pfree.resize(GetNumFreeParameters());
+    for(int f = 0; f < GetNumFreeParameters(); ++f)
+      poses[i].pfree[f] = joint_values[i][GetFreeParameters()[f]];
+  }
+}
+
+enum ENTRY_POINT { COMPUTE_FK=0, COMPUTE_IK=1, COMPUTE_IK_PREPARED=2, COMPUTE_IK_VISIT=3, NUM_ENTRY_POINTS=4 };
+
+const char* ENTRY_POINT_NAMES[NUM_ENTRY_POINTS] = {"ComputeFk", "ComputeIk", "PrepareIk+ComputeIkPrepared", "ComputeIkVisit"};
+
+/// \brief Entry points that must not allocate, checked with --check-allocations
+const bool ZERO_ALLOCATION[NUM_ENTRY_POINTS] = {true, false, false, false};
+
+/**
+ * @brief Runs one entry point over all poses, iterations times
+ *
+ * ComputeFk runs on the generated joint values, the IK entry points on the poses. The counters
+ * only cover the solver calls and the containers they write into, which are reused across calls.
+ */
+BenchmarkResult runBenchmark(ENTRY_POINT entry_point, const std::vector<BenchmarkPose> &poses,
+                             const std::vector<std::vector<IkReal> > &joint_values, int iterations,
+                             PerfCounters &counters)
+{
+  BenchmarkResult result;
+  IkSolutionList<IkReal> solutions;
+  IkPreparedPose prepared;
+  CountingVisitor visitor;
+  IkReal eetrans[3], eerot[9];
+  double checksum = 0.0;
+  std::size_t count = entry_point == COMPUTE_FK ? joint_values.size() : poses.size();
+
+  AllocationScope allocation_scope;
+  double start = wallNsec();
+  counters.start();
+  for(int it = 0; it < iterations; ++it)
+  {
+    for(std::size_t i = 0; i < count; ++i)
+    {
+      if(entry_point == COMPUTE_FK)
+      {
+        ComputeFk(&joint_values[i][0], eetrans, eerot);
+        checksum += eetrans[0];
+        result.calls++;
+        continue;
+      }
+
+      const BenchmarkPose &pose = poses[i];
+      const IkReal *pfree = pose.pfree.empty() ? NULL : &pose.pfree[0];
+      switch(entry_point)
+      {
+        case COMPUTE_IK:
+          solutions.Clear();
+          ComputeIk(pose.eetrans, pose.eerot, pfree, solutions);
+          result.solutions += solutions.GetNumSolutions();
+          break;
+        case COMPUTE_IK_PREPARED:
+          solutions.Clear();
+          PrepareIk(pose.eetrans, pose.eerot, prepared);
+          ComputeIkPrepared(prepared, pfree, solutions);
+          result.solutions += solutions.GetNumSolutions();
+          break;
+        default:
+          PrepareIk(pose.eetrans, pose.eerot, prepared);
+          result.solutions += ComputeIkVisit(prepared, pfree, NULL, NULL, visitor);
+          break;
+      }
+      result.calls++;
+    }
+  }
+  result.counters_valid = counters.stop(result.counts);
+  result.nsec = wallNsec() - start;
+  result.allocations = allocation_scope.elapsed().allocations;
+  result.bytes = allocation_scope.elapsed().bytes;
+
+  // keeps the FK loop from being optimized away
+  if(checksum + visitor.checksum == 1e300)
+    printf("%f\n", checksum);
+  return result;
+}
+
+void printResult(const char *name, const BenchmarkResult &result)
+{
+  double calls = result.calls;
+  printf("%-28s %10llu %12.1f %10.2f %11.2f %11.1f", name, (unsigned long long)result.calls, result.nsec / calls,
+         result.solutions / calls, result.allocations / calls, result.bytes / calls);
+  if(result.counters_valid)
+  {
+    double cycles = result.counts[CYCLES];
+    printf(" %12.1f %12.1f %6.2f %12.2f %12.2f\n", result.counts[INSTRUCTIONS] / calls, cycles / calls,
+           cycles > 0 ? result.counts[INSTRUCTIONS] / cycles : 0.0, result.counts[BRANCH_MISSES] / calls,
+           result.counts[CACHE_MISSES] / calls);
+  }
+  else
+  {
+    printf(" %12s %12s %6s %12s %12s\n", "n/a", "n/a", "n/a", "n/a", "n/a");
+  }
+}
+
+int main(int argc, char **argv)
+{
+  std::vector<BenchmarkPose> poses;
+  std::vector<std::vector<IkReal> > joint_values;
+  bool check_allocations = argc > 1 && strcmp(argv[1], "--check-allocations") == 0;
+  if(check_allocations)
+  {
+    argc--;
+    argv++;
+  }
+  int iterations = argc > 2 ? atoi(argv[2]) : DEFAULT_ITERATIONS;
+
+  // the FK benchmark always runs on the generated joint values
+  generatePoses(DEFAULT_NUM_POSES, poses, joint_values);
+  if(argc > 1 && argv[1][0] != '\0')
+  {
+    PoseCorpus corpus;
+    if(!corpus.load(argv[1]))
+      return 1;
+    if(corpus.numJoints() != (std::size_t)GetNumJoints())
+    {
+      fprintf(stderr, "%s: the corpus has %d joints, the solver %d\n", argv[1], (int)corpus.numJoints(), GetNumJoints());
+      return 1;
+    }
+
+    poses.resize(corpus.size());
+    for(std::size_t i = 0; i < corpus.size(); ++i)
+      poses[i] = toBenchmarkPose(corpus, i);
+  }
+
+  PerfCounters counters;
+  printf("%s, %d poses, %d iterations%s\n", GetKinematicsHash(), (int)poses.size(), iterations,
+         counters.available() ? "" : ", hardware counters not available (see /proc/sys/kernel/perf_event_paranoid)");
+  printf("%-28s %10s %12s %10s %11s %11s %12s %12s %6s %12s %12s\n", "entry point", "calls", "ns/call", "sol/call",
+         "allocs/call", "bytes/call",
+         "instr/call", "cycles/call", "IPC", "br-miss/call", "$-miss/call");
+  int num_failures = 0;
+  for(int e = 0; e < NUM_ENTRY_POINTS; ++e)
+  {
+    // one untimed pass to warm up the caches and the branch predictors
+    runBenchmark(static_cast<ENTRY_POINT>(e), poses, joint_values, 1, counters);
+    BenchmarkResult result = runBenchmark(static_cast<ENTRY_POINT>(e), poses, joint_values, iterations, counters);
+    printResult(ENTRY_POINT_NAMES[e], result);
+
+    if(check_allocations && ZERO_ALLOCATION[e] && result.allocations > 0)
+    {
+      fprintf(stderr, "%s is declared zero allocation but made %llu allocations in %llu calls\n", ENTRY_POINT_NAMES[e],
+              (unsigned long long)result.allocations, (unsigned long long)result.calls);
+      num_failures++;
+    }
+  }
+  return num_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,52 @@
+/*
+ * Heap allocation counting for the kinematics tests and benchmarks
+ *
+ * allocation_counter.cpp replaces the global operator new and delete and counts every
+ * allocation of the calling thread, so it has to be compiled into the executable itself (not
+ * linked from a shared library) for the replacement to take effect. Allocations through
+ * malloc() directly aren't counted.
+ */
+
+#ifndef KINEMATICS_BASE_TEST_ALLOCATION_COUNTER_H
+#define KINEMATICS_BASE_TEST_ALLOCATION_COUNTER_H
+
+#include <stdint.h>
+
+namespace kinematics_base_test
+{
+
+struct AllocationCount
+{
+  AllocationCount(): allocations(0), bytes(0) {}
+
+  uint64_t allocations;
+  uint64_t bytes;       // bytes requested, not including the allocator overhead
+};
+
+/// \brief Gets the allocations made by the calling thread since it started
+AllocationCount threadAllocationCount();
+
+/// \brief Counts the allocations of the calling thread from its construction on
+class AllocationScope
+{
+public:
+  AllocationScope(): start_(threadAllocationCount()) {}
+
+  /// \brief Gets the allocations since construction or the last restart()
+  AllocationCount elapsed() const
+  {
+    AllocationCount now = threadAllocationCount();
+    now.allocations -= start_.allocations;
+    now.bytes -= start_.bytes;
+    return now;
+  }
+
+  void restart() { start_ = threadAllocationCount(); }
+
+private:
+  AllocationCount start_;
+};
+
+} // end namespace
+
+#endif
@@ -0,0 +1,78 @@
+/*
+ * Descartes style Cartesian path planning with the multi-solution getPositionIK of a kinematics plugin
+ *
+ * Every waypoint of the path is solved with the multi-solution getPositionIK, the solutions
+ * become the rungs of a LadderGraph and the path is the sequence of solutions with the least
+ * joint motion whose joints stay within their velocity limits between consecutive waypoints.
+ */
+
+#ifndef KINEMATICS_BASE_TEST_CARTESIAN_PATH_PLANNER_H
+#define KINEMATICS_BASE_TEST_CARTESIAN_PATH_PLANNER_H
+
+#include <moveit/kinematics_base/kinematics_base.h>
+#include <geometry_msgs/Pose.h>
+
+#include <kinematics_base_test/ladder_graph.h>
+
+namespace kinematics_base_test
+{
+
+class CartesianPathPlanner
+{
+public:
+  /// \brief The solver must outlive the planner, without velocity limits and on a single thread
+  explicit CartesianPathPlanner(const kinematics::KinematicsBase &solver);
+
+  /**
+   * @brief Reads the max_velocity of the solver joints from the joint_limits.yaml of the moveit config
+   *
+   * The limits are loaded into <robot_description>_planning/joint_limits by planning_context.launch,
+   * joints without velocity limits aren't limited.
+   * @return False if a joint has no velocity limit
+   */
+  bool loadVelocityLimits(const std::string &robot_description);
+
+  /// \brief Sets the velocity limit of each joint of the solver, empty for no limits
+  void setVelocityLimits(const std::vector<double> &max_velocities) { max_velocities_ = max_velocities; }
+
+  const std::vector<double>& getVelocityLimits() const { return max_velocities_; }
+
+  /// \brief Sets the number of threads solving the waypoints, 0 for all cores
+  void setNumThreads(int num_threads);
+
+  /// \brief Sets the options of the getPositionIK calls, e.g. the discretization of the free joints
+  void setQueryOptions(const kinematics::KinematicsQueryOptions &options) { options_ = options; }
+
+  /**
+   * @brief Solves every waypoint into a rung of the graph
+   * @return False if a waypoint has no solution, getGraph() then has an empty rung
+   */
+  bool buildGraph(const std::vector<geometry_msgs::Pose> &waypoints);
+
+  /**
+   * @brief Finds the joint path through the graph of the last buildGraph()
+   * @param time_step Time between consecutive waypoints, the joint steps are limited to max_velocity * time_step
+   * @param trajectory The joint values of each waypoint
+   * @return False if no path satisfies the velocity limits
+   */
+  bool searchGraph(double time_step, std::vector<std::vector<double> > &trajectory) const;
+
+  /// \brief buildGraph() followed by searchGraph()
+  bool plan(const std::vector<geometry_msgs::Pose> &waypoints, double time_step,
+            std::vector<std::vector<double> > &trajectory);
+
+  const LadderGraph& getGraph() const { return graph_; }
+
+private:
+  void solveRange(const std::vector<geometry_msgs::Pose> &waypoints, std::size_t begin, std::size_t end);
+
+  const kinematics::KinematicsBase &solver_;
+  kinematics::KinematicsQueryOptions options_;
+  std::vector<double> max_velocities_;
+  int num_threads_;
+  LadderGraph graph_;
+};
+
+} // end namespace
+
+#endif
@@ -0,0 +1,87 @@
+/*
+ * Ladder graph of the joint solutions of a sequence of waypoints, as used by Descartes
+ *
+ * Rung i holds the joint solutions of waypoint i and every point of a rung is connected to the
+ * points of the next rung that are reachable within the joint steps allowed between waypoints.
+ * The points of a rung are stored joint major, all values of joint 0 first, and sorted by their
+ * joint 0 value, so the points reachable from a point of the next rung are a contiguous range
+ * found by binary search and the joint distances to that range are computed over contiguous
+ * memory. Plain C++, see cartesian_path_planner.h for building the rungs with a kinematics plugin.
+ */
+
+#ifndef KINEMATICS_BASE_TEST_LADDER_GRAPH_H
+#define KINEMATICS_BASE_TEST_LADDER_GRAPH_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+
+namespace kinematics_base_test
+{
+
+class LadderGraph
+{
+public:
+  explicit LadderGraph(std::size_t dof = 0);
+
+  /// \brief Sets the number of joints and the number of rungs, all rungs are empty
+  void reset(std::size_t dof, std::size_t num_rungs);
+
+  std::size_t dof() const { return dof_; }
+
+  std::size_t size() const { return rungs_.size(); }
+
+  /**
+   * @brief Replaces the points of a rung, each one dof() joint values
+   *
+   * Different rungs may be set from different threads.
+   */
+  void setRung(std::size_t rung, const std::vector<std::vector<double> > &points);
+
+  std::size_t numPoints(std::size_t rung) const { return rungs_[rung].num_points; }
+
+  /// \brief The values of one joint of all points of a rung, in the order of the points
+  const double* jointValues(std::size_t rung, std::size_t joint) const
+  {
+    return &rungs_[rung].values[joint * rungs_[rung].num_points];
+  }
+
+  void getPoint(std::size_t rung, std::size_t point, std::vector<double> &joint_values) const;
+
+private:
+  struct Rung
+  {
+    Rung(): num_points(0) {}
+
+    std::size_t num_points;
+    std::vector<double> values; // dof blocks of num_points values
+  };
+
+  std::size_t dof_;
+  std::vector<Rung> rungs_;
+};
+
+/// \brief A path through a ladder graph, one point of each rung
+struct LadderGraphPath
+{
+  LadderGraphPath(): cost(0.0) {}
+
+  double cost;                 // sum of the joint distances between consecutive points
+  std::vector<uint32_t> points; // point index of each rung
+};
+
+/**
+ * @brief Finds the path with the lowest sum of joint distances, sum over the joints of |dq|
+ *
+ * Dynamic programming over the rungs, keeping the costs of the last rung and a predecessor per
+ * point only.
+ * @param max_steps Largest motion of each joint between consecutive rungs, empty for no limit
+ * @param failed_rung The first rung that is empty or can't be reached, if not NULL
+ * @return False if no path connects all rungs
+ */
+bool searchLadderGraph(const LadderGraph &graph, const std::vector<double> &max_steps, LadderGraphPath &path,
+                       std::size_t *failed_rung = NULL);
+
+} // end namespace
+
+#endif
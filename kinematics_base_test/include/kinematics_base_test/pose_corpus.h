@@ -0,0 +1,120 @@
+/*
+ * Pose corpora for repeatable kinematics tests and benchmarks
+ *
+ * A corpus file holds a PoseCorpusHeader followed by num_poses fixed size records, each one a
+ * PoseCorpusRecord followed by num_joints float64 joint values. The pose of each record is the
+ * pose of the tip link in the root link frame, the joint values are the state it was computed
+ * from or NaN when no such state is known (unreachable poses, inner points of Cartesian paths).
+ * The file is meant to be memory mapped, see PoseCorpus.
+ */
+
+#ifndef KINEMATICS_BASE_TEST_POSE_CORPUS_H
+#define KINEMATICS_BASE_TEST_POSE_CORPUS_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace kinematics_base_test
+{
+
+const char POSE_CORPUS_MAGIC[4] = {'I','K','P','C'};
+const uint32_t POSE_CORPUS_VERSION = 1;
+
+/// \brief How the poses of a corpus were generated
+enum POSE_CATEGORY
+{
+  UNIFORM=0,        ///< FK of joint values drawn uniformly within the joint limits
+  NEAR_SINGULAR=1,  ///< FK of the uniform samples with the lowest manipulability
+  NEAR_LIMIT=2,     ///< FK of joint values with some joints close to one of their limits
+  UNREACHABLE=3,    ///< uniform poses moved beyond the reach of the arm
+  CARTESIAN_PATH=4, ///< straight line paths of constant orientation starting at a uniform pose
+  NUM_POSE_CATEGORIES=5
+};
+
+struct PoseCorpusHeader
+{
+  char magic[4];
+  uint32_t version;
+  uint32_t num_joints;
+  uint32_t record_size; // bytes per record, including the joint values
+  uint64_t num_poses;
+  uint64_t seed;        // seed the corpus was generated with
+};
+
+struct PoseCorpusRecord
+{
+  uint32_t category; // POSE_CATEGORY
+  int32_t path_id;   // index of the Cartesian path the pose belongs to, -1 for other categories
+  double pose[7];    // x y z qx qy qz qw
+};
+
+/// \brief A pose to be written into a corpus
+struct PoseCorpusEntry
+{
+  POSE_CATEGORY category;
+  int path_id;
+  double pose[7];
+  std::vector<double> joint_values;
+};
+
+/**
+ * @brief Writes the entries into a corpus file
+ * @return False if the file couldn't be written or an entry doesn't have num_joints joint values
+ */
+bool writePoseCorpus(const std::string &path, uint32_t num_joints, uint64_t seed,
+                     const std::vector<PoseCorpusEntry> &entries);
+
+/// \brief Read only memory mapped view of a corpus file
+class PoseCorpus
+{
+public:
+  PoseCorpus();
+  ~PoseCorpus();
+
+  /**
+   * @brief Maps a corpus file, replacing the one previously loaded
+   * @return False if the file can't be mapped or isn't a corpus of the current version
+   */
+  bool load(const std::string &path);
+
+  void unload();
+
+  bool loaded() const { return data_ != NULL; }
+
+  std::size_t size() const { return loaded() ? header().num_poses : 0; }
+
+  std::size_t numJoints() const { return loaded() ? header().num_joints : 0; }
+
+  const PoseCorpusHeader& header() const { return *static_cast<const PoseCorpusHeader*>(data_); }
+
+  const PoseCorpusRecord& record(std::size_t i) const
+  {
+    return *reinterpret_cast<const PoseCorpusRecord*>(static_cast<const char*>(data_) + sizeof(PoseCorpusHeader) +
+                                                      i * header().record_size);
+  }
+
+  /// \brief The numJoints() joint values of record i
+  const double* jointValues(std::size_t i) const
+  {
+    return reinterpret_cast<const double*>(&record(i) + 1);
+  }
+
+  /// \brief Gets the indices of the records of a category in file order
+  std::vector<std::size_t> indices(POSE_CATEGORY category) const;
+
+private:
+  PoseCorpus(const PoseCorpus&);
+  PoseCorpus& operator=(const PoseCorpus&);
+
+  void *data_;
+  std::size_t size_;
+};
+
+/// \brief Printable name of a category
+const char* poseCategoryName(POSE_CATEGORY category);
+
+} // end namespace
+
+#endif
@@ -0,0 +1,109 @@
+#include <kinematics_base_test/allocation_counter.h>
+
+#include <stdlib.h>
+#include <new>
+
+// dynamic exception specifications are ill formed since C++17
+#if __cplusplus >= 201103L
+#define THROW_BAD_ALLOC
+#define NO_THROW noexcept
+#else
+#define THROW_BAD_ALLOC throw(std::bad_alloc)
+#define NO_THROW throw()
+#endif
+
+namespace
+{
+
+// plain thread local storage, the counters must not allocate themselves
+__thread uint64_t thread_allocations = 0;
+__thread uint64_t thread_bytes = 0;
+
+void* countedAllocate(std::size_t size)
+{
+  thread_allocations++;
+  thread_bytes += size;
+  return malloc(size == 0 ? 1 : size);
+}
+
+void* throwingAllocate(std::size_t size)
+{
+  for(;;)
+  {
+    void *p = countedAllocate(size);
+    if(p != NULL)
+      return p;
+
+    std::new_handler handler = std::set_new_handler(0);
+    std::set_new_handler(handler);
+    if(handler == NULL)
+      throw std::bad_alloc();
+    handler();
+  }
+}
+
+} // end namespace
+
+namespace kinematics_base_test
+{
+
+AllocationCount threadAllocationCount()
+{
+  AllocationCount count;
+  count.allocations = thread_allocations;
+  count.bytes = thread_bytes;
+  return count;
+}
+
+} // end namespace
+
+void* operator new(std::size_t size) THROW_BAD_ALLOC
+{
+  return throwingAllocate(size);
+}
+
+void* operator new[](std::size_t size) THROW_BAD_ALLOC
+{
+  return throwingAllocate(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) NO_THROW
+{
+  return countedAllocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) NO_THROW
+{
+  return countedAllocate(size);
+}
+
+void operator delete(void *p) NO_THROW
+{
+  free(p);
+}
+
+void operator delete[](void *p) NO_THROW
+{
+  free(p);
+}
+
+// sized deallocation of C++14, forwarded so that the compiler's choice doesn't matter
+void operator delete(void *p, std::size_t) NO_THROW
+{
+  operator delete(p);
+}
+
+void operator delete[](void *p, std::size_t) NO_THROW
+{
+  operator delete[](p);
+}
+
+void operator delete(void *p, const std::nothrow_t&) NO_THROW
+{
+  free(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t&) NO_THROW
+{
+  free(p);
+}
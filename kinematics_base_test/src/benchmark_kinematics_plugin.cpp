@@ -0,0 +1,359 @@
+/*
+ * Benchmarks the IK entry points of a kinematics plugin on a pose corpus, see pose_corpus.h
+ *
+ * Every category of the corpus is solved with getPositionIK, searchPositionIK and the multi
+ * solution getPositionIK, so timings are comparable across commits as long as the corpus is
+ * the same. Plugins implementing IKFastKinematicsExtension are also timed retrying a searchPositionIK whose callback
+ * rejects every solution, see the "Definitive failures" section of the README. Private parameters:
+ *   ik_plugin_name, group, root_link, tip_link  the plugin and the chain it is initialized for
+ *   pose_corpus                                 corpus file generated by generate_pose_corpus
+ *   repetitions                                 number of passes over the corpus
+ */
+
+#include <ros/ros.h>
+#include <pluginlib/class_loader.h>
+#include <moveit/kinematics_base/kinematics_base.h>
+#include <stdio.h>
+
+#include <kinematics_base_test/pose_corpus.h>
+#include <kinematics_base_test/allocation_counter.h>
+#include <kinematics_base_test/cartesian_path_planner.h>
+#include <ikfast_kinematics_extension/ikfast_kinematics_extension.h>
+
+using namespace kinematics_base_test;
+
+typedef pluginlib::ClassLoader<kinematics::KinematicsBase> KinematicsLoader;
+
+const std::string ROBOT_DESCRIPTION_PARAM = "robot_description";
+const double DEFAULT_SEARCH_DISCRETIZATION = 0.01f;
+
+/// \brief IK entry points of the benchmark
+enum ENTRY_POINT { GET_POSITION_IK=0, SEARCH_POSITION_IK=1, GET_POSITION_IK_MULTIPLE=2, NUM_ENTRY_POINTS=3 };
+
+const char* ENTRY_POINT_NAMES[NUM_ENTRY_POINTS] = {"getPositionIK", "searchPositionIK", "getPositionIK(multiple)"};
+
+/// \brief Ways of retrying a failed searchPositionIK, like the kinematics_solver_attempts of MoveIt
+enum RETRY_METHOD { PLAIN_ATTEMPTS=0, RESTARTS=1, NUM_RETRY_METHODS=2 };
+
+const char* RETRY_METHOD_NAMES[NUM_RETRY_METHODS] = {"searchPositionIK x10", "WithRestarts(10)"};
+
+const unsigned int RETRY_ATTEMPTS = 10;
+
+struct BenchmarkResult
+{
+  BenchmarkResult(): num_queries(0), num_solved(0), num_solutions(0), time(0.0) {}
+
+  unsigned int num_queries;
+  unsigned int num_solved;
+  unsigned int num_solutions;
+  double time;
+  AllocationCount allocations; // heap allocations of the entry point calls only
+};
+
+geometry_msgs::Pose toPoseMsg(const PoseCorpusRecord &record)
+{
+  geometry_msgs::Pose pose;
+  pose.position.x = record.pose[0];
+  pose.position.y = record.pose[1];
+  pose.position.z = record.pose[2];
+  pose.orientation.x = record.pose[3];
+  pose.orientation.y = record.pose[4];
+  pose.orientation.z = record.pose[5];
+  pose.orientation.w = record.pose[6];
+  return pose;
+}
+
+/**
+ * @brief Solves the records of one category with one entry point
+ *
+ * The poses of a Cartesian path are seeded with the solution of the previous pose of the path,
+ * all others with the zero state.
+ */
+BenchmarkResult runBenchmark(const kinematics::KinematicsBase &solver, const PoseCorpus &corpus,
+                             const std::vector<std::size_t> &indices, ENTRY_POINT entry_point)
+{
+  BenchmarkResult result;
+  const std::vector<double> zero_seed(solver.getJointNames().size(), 0.0);
+  std::vector<double> seed = zero_seed, solution;
+  std::vector< std::vector<double> > solutions;
+  std::vector<geometry_msgs::Pose> poses(1);
+  moveit_msgs::MoveItErrorCodes error_code;
+  kinematics::KinematicsResult kinematics_result;
+  kinematics::KinematicsQueryOptions options;
+  int path_id = -1;
+
+  ros::WallTime start_time = ros::WallTime::now();
+  for(std::size_t i = 0; i < indices.size(); ++i)
+  {
+    const PoseCorpusRecord &record = corpus.record(indices[i]);
+    if(record.path_id < 0 || record.path_id != path_id)
+      seed = zero_seed;
+    path_id = record.path_id;
+    poses[0] = toPoseMsg(record);
+    solutions.clear();
+
+    bool solved = false;
+    AllocationScope scope;
+    switch(entry_point)
+    {
+      case GET_POSITION_IK:
+        solved = solver.getPositionIK(poses[0], seed, solution, error_code);
+        result.num_solutions += solved ? 1 : 0;
+        break;
+      case SEARCH_POSITION_IK:
+        solved = solver.searchPositionIK(poses[0], seed, 5.0, solution, error_code);
+        result.num_solutions += solved ? 1 : 0;
+        break;
+      default:
+        solved = solver.getPositionIK(poses, seed, solutions, kinematics_result, options) && !solutions.empty();
+        result.num_solutions += solutions.size();
+        if(solved)
+          solution = solutions[0];
+        break;
+    }
+    result.allocations.allocations += scope.elapsed().allocations;
+    result.allocations.bytes += scope.elapsed().bytes;
+
+    result.num_queries++;
+    if(solved)
+    {
+      result.num_solved++;
+      if(path_id >= 0)
+        seed = solution;
+    }
+  }
+  result.time = (ros::WallTime::now() - start_time).toSec();
+  return result;
+}
+
+/// \brief Solution callback rejecting every solution, as a planning scene in collision would
+void rejectSolution(const geometry_msgs::Pose &/*ik_pose*/, const std::vector<double> &/*joint_values*/,
+                    moveit_msgs::MoveItErrorCodes &error_code)
+{
+  error_code.val = moveit_msgs::MoveItErrorCodes::NO_IK_SOLUTION;
+}
+
+/**
+ * @brief Retries searchPositionIK up to RETRY_ATTEMPTS times on the records of one category, with a callback
+ * rejecting every solution
+ *
+ * The plain attempts all start from the zero state, since the plugin tries the same solutions from any seed.
+ */
+BenchmarkResult runRetryBenchmark(const ikfast_kinematics_plugin::IKFastKinematicsExtension &solver, const PoseCorpus &corpus,
+                                  const std::vector<std::size_t> &indices, RETRY_METHOD method)
+{
+  BenchmarkResult result;
+  const std::vector<double> seed(solver.getJointNames().size(), 0.0);
+  const std::vector<double> consistency_limits;
+  const kinematics::KinematicsBase::IKCallbackFn callback = &rejectSolution;
+  std::vector<double> solution;
+  moveit_msgs::MoveItErrorCodes error_code;
+
+  ros::WallTime start_time = ros::WallTime::now();
+  for(std::size_t i = 0; i < indices.size(); ++i)
+  {
+    geometry_msgs::Pose pose = toPoseMsg(corpus.record(indices[i]));
+    bool solved = false;
+    AllocationScope scope;
+    if(method == RESTARTS)
+    {
+      solved = solver.searchPositionIKWithRestarts(pose, seed, 5.0, consistency_limits, solution, callback,
+                                                   error_code, RETRY_ATTEMPTS);
+    }
+    else
+    {
+      for(unsigned int a = 0; a < RETRY_ATTEMPTS && !solved; ++a)
+        solved = solver.searchPositionIK(pose, seed, 5.0, consistency_limits, solution, callback, error_code);
+    }
+    result.allocations.allocations += scope.elapsed().allocations;
+    result.allocations.bytes += scope.elapsed().bytes;
+
+    result.num_queries++;
+    result.num_solved += solved ? 1 : 0;
+    result.num_solutions += solved ? 1 : 0;
+  }
+  result.time = (ros::WallTime::now() - start_time).toSec();
+  return result;
+}
+
+/// \brief Outcome of planning the Cartesian paths of a corpus with the ladder graph planner
+struct LadderGraphResult
+{
+  LadderGraphResult(): num_paths(0), num_planned(0), num_waypoints(0), num_points(0), build_time(0.0), search_time(0.0) {}
+
+  unsigned int num_paths;
+  unsigned int num_planned;
+  unsigned int num_waypoints;
+  unsigned int num_points;  // IK solutions in the rungs
+  double build_time;        // solving the waypoints
+  double search_time;       // searching the graph
+};
+
+/// \brief Plans every Cartesian path of the corpus as a whole
+LadderGraphResult runLadderGraphBenchmark(CartesianPathPlanner &planner, const PoseCorpus &corpus, double time_step)
+{
+  LadderGraphResult result;
+  std::vector<std::size_t> indices = corpus.indices(CARTESIAN_PATH);
+  std::vector<geometry_msgs::Pose> waypoints;
+  std::vector< std::vector<double> > trajectory;
+  for(std::size_t i = 0; i < indices.size();)
+  {
+    // the poses of a path are consecutive in the corpus
+    int path_id = corpus.record(indices[i]).path_id;
+    waypoints.clear();
+    for(; i < indices.size() && corpus.record(indices[i]).path_id == path_id; ++i)
+      waypoints.push_back(toPoseMsg(corpus.record(indices[i])));
+
+    ros::WallTime start_time = ros::WallTime::now();
+    bool built = planner.buildGraph(waypoints);
+    ros::WallTime build_time = ros::WallTime::now();
+    bool planned = built && planner.searchGraph(time_step, trajectory);
+    result.build_time += (build_time - start_time).toSec();
+    result.search_time += (ros::WallTime::now() - build_time).toSec();
+
+    result.num_paths++;
+    result.num_planned += planned ? 1 : 0;
+    result.num_waypoints += waypoints.size();
+    for(std::size_t r = 0; r < planner.getGraph().size(); ++r)
+      result.num_points += planner.getGraph().numPoints(r);
+  }
+  return result;
+}
+
+int main(int argc, char **argv)
+{
+  ros::init(argc, argv, "benchmark_kinematics_plugin");
+  ros::NodeHandle ph("~");
+
+  std::string plugin_name, group_name, root_link, tip_link, corpus_path;
+  int repetitions, num_threads;
+  double path_time_step;
+  bool discretize_free_joints;
+  if(!(ph.getParam("ik_plugin_name", plugin_name) && ph.getParam("group", group_name) &&
+       ph.getParam("root_link", root_link) && ph.getParam("tip_link", tip_link) &&
+       ph.getParam("pose_corpus", corpus_path)))
+  {
+    ROS_ERROR_STREAM("The ik_plugin_name, group, root_link, tip_link and pose_corpus parameters are required");
+    return 1;
+  }
+  ph.param("repetitions", repetitions, 1);
+  ph.param("path_time_step", path_time_step, 0.01);
+  ph.param("discretize_free_joints", discretize_free_joints, false);
+  ph.param("num_threads", num_threads, 1);
+
+  PoseCorpus corpus;
+  if(!corpus.load(corpus_path))
+    return 1;
+
+  // loading plugin
+  KinematicsLoader kinematics_loader("moveit_core", "kinematics::KinematicsBase");
+  kinematics::KinematicsBasePtr kinematics_solver;
+  try
+  {
+    kinematics_solver = kinematics_loader.createInstance(plugin_name);
+  }
+  catch(pluginlib::PluginlibException& e)
+  {
+    ROS_ERROR_STREAM("Plugin failed to load: "<<e.what());
+    return 1;
+  }
+
+  if(!kinematics_solver->initialize(ROBOT_DESCRIPTION_PARAM, group_name, root_link, tip_link, DEFAULT_SEARCH_DISCRETIZATION))
+  {
+    ROS_ERROR_STREAM("Kinematics Solver failed to initialize");
+    return 1;
+  }
+
+  if(corpus.numJoints() != kinematics_solver->getJointNames().size())
+  {
+    ROS_ERROR_STREAM("The corpus has " << corpus.numJoints() << " joints, the plugin " << kinematics_solver->getJointNames().size());
+    return 1;
+  }
+
+  printf("%-16s %-24s %10s %10s %12s %14s %12s %12s\n", "category", "entry point", "queries", "solved", "solutions",
+         "queries/s", "allocs/query", "bytes/query");
+  for(int c = 0; c < NUM_POSE_CATEGORIES; ++c)
+  {
+    std::vector<std::size_t> indices = corpus.indices(static_cast<POSE_CATEGORY>(c));
+    if(indices.empty())
+      continue;
+
+    for(int e = 0; e < NUM_ENTRY_POINTS; ++e)
+    {
+      BenchmarkResult total;
+      for(int r = 0; r < repetitions; ++r)
+      {
+        BenchmarkResult result = runBenchmark(*kinematics_solver, corpus, indices, static_cast<ENTRY_POINT>(e));
+        total.num_queries += result.num_queries;
+        total.num_solved += result.num_solved;
+        total.num_solutions += result.num_solutions;
+        total.time += result.time;
+        total.allocations.allocations += result.allocations.allocations;
+        total.allocations.bytes += result.allocations.bytes;
+      }
+      printf("%-16s %-24s %10u %10u %12u %14.1f %12.2f %12.1f\n", poseCategoryName(static_cast<POSE_CATEGORY>(c)),
+             ENTRY_POINT_NAMES[e], total.num_queries, total.num_solved, total.num_solutions, total.num_queries / total.time,
+             (double)total.allocations.allocations / total.num_queries, (double)total.allocations.bytes / total.num_queries);
+    }
+  }
+
+  const ikfast_kinematics_plugin::IKFastKinematicsExtension *ikfast_extension =
+    dynamic_cast<const ikfast_kinematics_plugin::IKFastKinematicsExtension*>(kinematics_solver.get());
+  if(ikfast_extension)
+  {
+    printf("\n%-16s %-24s %10s %10s %14s %12s %12s\n", "category", "rejecting callback", "queries", "solved",
+           "ms/query", "allocs/query", "bytes/query");
+    for(int c = 0; c < NUM_POSE_CATEGORIES; ++c)
+    {
+      std::vector<std::size_t> indices = corpus.indices(static_cast<POSE_CATEGORY>(c));
+      if(indices.empty())
+        continue;
+
+      for(int m = 0; m < NUM_RETRY_METHODS; ++m)
+      {
+        BenchmarkResult total;
+        for(int r = 0; r < repetitions; ++r)
+        {
+          BenchmarkResult result = runRetryBenchmark(*ikfast_extension, corpus, indices, static_cast<RETRY_METHOD>(m));
+          total.num_queries += result.num_queries;
+          total.num_solved += result.num_solved;
+          total.time += result.time;
+          total.allocations.allocations += result.allocations.allocations;
+          total.allocations.bytes += result.allocations.bytes;
+        }
+        printf("%-16s %-24s %10u %10u %14.4f %12.2f %12.1f\n", poseCategoryName(static_cast<POSE_CATEGORY>(c)),
+               RETRY_METHOD_NAMES[m], total.num_queries, total.num_solved, 1e3 * total.time / total.num_queries,
+               (double)total.allocations.allocations / total.num_queries, (double)total.allocations.bytes / total.num_queries);
+      }
+    }
+  }
+
+  CartesianPathPlanner planner(*kinematics_solver);
+  planner.loadVelocityLimits(ROBOT_DESCRIPTION_PARAM);
+  planner.setNumThreads(num_threads);
+  kinematics::KinematicsQueryOptions options;
+  if(discretize_free_joints)
+    options.discretization_method = kinematics::DiscretizationMethods::ALL_DISCRETIZED;
+  planner.setQueryOptions(options);
+
+  printf("\n%-16s %10s %10s %12s %14s %14s %14s\n", "ladder graph", "paths", "planned", "waypoints", "points/rung",
+         "build ms/path", "search ms/path");
+  LadderGraphResult total;
+  for(int r = 0; r < repetitions; ++r)
+  {
+    LadderGraphResult result = runLadderGraphBenchmark(planner, corpus, path_time_step);
+    total.num_paths += result.num_paths;
+    total.num_planned += result.num_planned;
+    total.num_waypoints += result.num_waypoints;
+    total.num_points += result.num_points;
+    total.build_time += result.build_time;
+    total.search_time += result.search_time;
+  }
+  if(total.num_paths > 0)
+  {
+    printf("%-16s %10u %10u %12u %14.1f %14.3f %14.3f\n", poseCategoryName(CARTESIAN_PATH), total.num_paths, total.num_planned,
+           total.num_waypoints, (double)total.num_points / total.num_waypoints, 1e3 * total.build_time / total.num_paths,
+           1e3 * total.search_time / total.num_paths);
+  }
+  return 0;
+}
@@ -0,0 +1,124 @@
+#include <kinematics_base_test/cartesian_path_planner.h>
+
+#include <ros/ros.h>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <limits>
+
+namespace kinematics_base_test
+{
+
+CartesianPathPlanner::CartesianPathPlanner(const kinematics::KinematicsBase &solver):
+  solver_(solver),
+  num_threads_(1),
+  graph_(solver.getJointNames().size())
+{
+}
+
+bool CartesianPathPlanner::loadVelocityLimits(const std::string &robot_description)
+{
+  ros::NodeHandle planning_handle(robot_description + "_planning/joint_limits");
+  const std::vector<std::string> &joint_names = solver_.getJointNames();
+  max_velocities_.assign(joint_names.size(), std::numeric_limits<double>::infinity());
+
+  bool ok = true;
+  for(std::size_t i = 0; i < joint_names.size(); ++i)
+  {
+    bool has_velocity_limits = false;
+    double max_velocity;
+    if(planning_handle.getParam(joint_names[i] + "/has_velocity_limits", has_velocity_limits) && has_velocity_limits &&
+       planning_handle.getParam(joint_names[i] + "/max_velocity", max_velocity) && max_velocity > 0.0)
+    {
+      max_velocities_[i] = max_velocity;
+    }
+    else
+    {
+      ROS_WARN_STREAM("No velocity limit for " << joint_names[i] << ", its steps aren't limited");
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+void CartesianPathPlanner::setNumThreads(int num_threads)
+{
+  num_threads_ = num_threads > 0 ? num_threads : std::max(boost::thread::hardware_concurrency(), 1u);
+}
+
+void CartesianPathPlanner::solveRange(const std::vector<geometry_msgs::Pose> &waypoints, std::size_t begin, std::size_t end)
+{
+  // the seed only orders the solutions, the graph sorts them anyway
+  const std::vector<double> seed(graph_.dof(), 0.0);
+  std::vector<geometry_msgs::Pose> poses(1);
+  std::vector<std::vector<double> > solutions;
+  kinematics::KinematicsResult result;
+  for(std::size_t i = begin; i < end; ++i)
+  {
+    poses[0] = waypoints[i];
+    solutions.clear();
+    if(!solver_.getPositionIK(poses, seed, solutions, result, options_))
+      solutions.clear();
+    graph_.setRung(i, solutions);
+  }
+}
+
+bool CartesianPathPlanner::buildGraph(const std::vector<geometry_msgs::Pose> &waypoints)
+{
+  graph_.reset(solver_.getJointNames().size(), waypoints.size());
+
+  // each thread fills the rungs of a contiguous range of waypoints
+  std::size_t chunk = (waypoints.size() + num_threads_ - 1) / num_threads_;
+  if(num_threads_ > 1 && chunk > 0)
+  {
+    boost::thread_group threads;
+    for(std::size_t begin = 0; begin < waypoints.size(); begin += chunk)
+    {
+      threads.create_thread(boost::bind(&CartesianPathPlanner::solveRange, this, boost::cref(waypoints), begin,
+                                        std::min(begin + chunk, waypoints.size())));
+    }
+    threads.join_all();
+  }
+  else
+  {
+    solveRange(waypoints, 0, waypoints.size());
+  }
+
+  for(std::size_t i = 0; i < graph_.size(); ++i)
+  {
+    if(graph_.numPoints(i) == 0)
+    {
+      ROS_DEBUG_STREAM("Waypoint " << i << " has no IK solution");
+      return false;
+    }
+  }
+  return true;
+}
+
+bool CartesianPathPlanner::searchGraph(double time_step, std::vector<std::vector<double> > &trajectory) const
+{
+  std::vector<double> max_steps(max_velocities_.size());
+  for(std::size_t i = 0; i < max_velocities_.size(); ++i)
+    max_steps[i] = max_velocities_[i] * time_step;
+
+  LadderGraphPath path;
+  std::size_t failed_rung;
+  if(!searchLadderGraph(graph_, max_steps, path, &failed_rung))
+  {
+    ROS_DEBUG_STREAM("No joint path reaches waypoint " << failed_rung << " within the velocity limits");
+    trajectory.clear();
+    return false;
+  }
+
+  trajectory.resize(graph_.size());
+  for(std::size_t i = 0; i < graph_.size(); ++i)
+    graph_.getPoint(i, path.points[i], trajectory[i]);
+  return true;
+}
+
+bool CartesianPathPlanner::plan(const std::vector<geometry_msgs::Pose> &waypoints, double time_step,
+                                std::vector<std::vector<double> > &trajectory)
+{
+  return buildGraph(waypoints) && searchGraph(time_step, trajectory);
+}
+
+} // end namespace
@@ -0,0 +1,250 @@
+/*
+ * Generates a seeded pose corpus for the kinematics tests and benchmarks, see pose_corpus.h
+ *
+ * Needs the robot description (and semantic description) on the parameter server, e.g. from
+ * planning_context.launch of the robot's moveit config package. Private parameters:
+ *   group, root_link, tip_link  the chain the poses are generated for
+ *   output                      corpus file to write
+ *   seed                        seed of the random generator, the same seed gives the same corpus
+ *   num_poses                   number of poses of each category
+ *   path_length                 number of poses of each Cartesian path
+ *   path_step                   distance between consecutive poses of a Cartesian path
+ */
+
+#include <ros/ros.h>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_real_distribution.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+#include <boost/random/normal_distribution.hpp>
+#include <Eigen/Geometry>
+#include <Eigen/LU>
+#include <algorithm>
+#include <limits>
+
+// MoveIt!
+#include <moveit/robot_model/robot_model.h>
+#include <moveit/robot_state/robot_state.h>
+#include <moveit/rdf_loader/rdf_loader.h>
+#include <urdf/model.h>
+#include <srdfdom/model.h>
+
+#include <kinematics_base_test/pose_corpus.h>
+
+using namespace kinematics_base_test;
+
+const std::string ROBOT_DESCRIPTION_PARAM = "robot_description";
+const int SINGULAR_OVERSAMPLING = 10;    // uniform samples per near singular pose
+const double NEAR_LIMIT_FRACTION = 0.01; // distance to the limit relative to the joint range
+const double UNREACHABLE_SCALE = 1.5;    // unreachable poses are this far away relative to the reach
+
+class PoseCorpusGenerator
+{
+public:
+  PoseCorpusGenerator(const robot_model::RobotModelPtr &kinematic_model, const robot_model::JointModelGroup *group,
+                      const std::string &root_link, const std::string &tip_link, uint64_t seed):
+    kinematic_model_(kinematic_model),
+    group_(group),
+    root_link_(root_link),
+    tip_link_(tip_link),
+    kinematic_state_(kinematic_model),
+    generator_(static_cast<boost::uint32_t>(seed))
+  {
+    const std::vector<std::string> &variables = group_->getVariableNames();
+    for(std::size_t i = 0; i < variables.size(); ++i)
+    {
+      const robot_model::VariableBounds &bounds = kinematic_model_->getVariableBounds(variables[i]);
+      has_limits_.push_back(bounds.position_bounded_);
+      lower_.push_back(bounds.position_bounded_ ? bounds.min_position_ : -M_PI);
+      upper_.push_back(bounds.position_bounded_ ? bounds.max_position_ : M_PI);
+    }
+  }
+
+  std::size_t numJoints() const { return lower_.size(); }
+
+  /// \brief Draws joint values uniformly within the joint limits
+  void sampleUniform(std::vector<double> &joint_values)
+  {
+    joint_values.resize(numJoints());
+    for(std::size_t i = 0; i < numJoints(); ++i)
+      joint_values[i] = boost::random::uniform_real_distribution<double>(lower_[i], upper_[i])(generator_);
+  }
+
+  /// \brief Moves one to all of the joints with limits close to one of their limits
+  void moveNearLimit(std::vector<double> &joint_values)
+  {
+    int num_moved = boost::random::uniform_int_distribution<int>(1, numJoints())(generator_);
+    for(int n = 0; n < num_moved; ++n)
+    {
+      std::size_t i = boost::random::uniform_int_distribution<std::size_t>(0, numJoints() - 1)(generator_);
+      if(!has_limits_[i])
+        continue;
+
+      double margin = boost::random::uniform_real_distribution<double>(0.0, NEAR_LIMIT_FRACTION)(generator_) *
+                      (upper_[i] - lower_[i]);
+      joint_values[i] = boost::random::uniform_int_distribution<int>(0, 1)(generator_) ? upper_[i] - margin : lower_[i] + margin;
+    }
+  }
+
+  /// \brief Computes the pose of the tip link in the root link frame
+  Eigen::Affine3d computeFK(const std::vector<double> &joint_values)
+  {
+    kinematic_state_.setJointGroupPositions(group_, joint_values);
+    kinematic_state_.update();
+    return kinematic_state_.getGlobalLinkTransform(root_link_).inverse() * kinematic_state_.getGlobalLinkTransform(tip_link_);
+  }
+
+  /// \brief sqrt(det(J*J^T)) of the tip link for the state of the last computeFK() call
+  double manipulability()
+  {
+    Eigen::MatrixXd jacobian;
+    kinematic_state_.getJacobian(group_, kinematic_model_->getLinkModel(tip_link_), Eigen::Vector3d::Zero(), jacobian);
+    return std::sqrt(std::max((jacobian * jacobian.transpose()).determinant(), 0.0));
+  }
+
+  Eigen::Vector3d randomDirection()
+  {
+    boost::random::normal_distribution<double> normal;
+    Eigen::Vector3d direction(normal(generator_), normal(generator_), normal(generator_));
+    return direction.normalized();
+  }
+
+  static PoseCorpusEntry makeEntry(POSE_CATEGORY category, int path_id, const Eigen::Affine3d &pose,
+                                   const std::vector<double> &joint_values)
+  {
+    PoseCorpusEntry entry;
+    entry.category = category;
+    entry.path_id = path_id;
+    Eigen::Quaterniond q(pose.rotation());
+    entry.pose[0] = pose.translation().x();
+    entry.pose[1] = pose.translation().y();
+    entry.pose[2] = pose.translation().z();
+    entry.pose[3] = q.x();
+    entry.pose[4] = q.y();
+    entry.pose[5] = q.z();
+    entry.pose[6] = q.w();
+    entry.joint_values = joint_values;
+    return entry;
+  }
+
+  void generate(int num_poses, int path_length, double path_step, std::vector<PoseCorpusEntry> &entries)
+  {
+    std::vector<double> joint_values;
+    const std::vector<double> unknown(numJoints(), std::numeric_limits<double>::quiet_NaN());
+
+    // uniform, also gives the reach of the arm
+    double reach = 0.0;
+    std::size_t uniform_begin = entries.size();
+    for(int i = 0; i < num_poses; ++i)
+    {
+      sampleUniform(joint_values);
+      Eigen::Affine3d pose = computeFK(joint_values);
+      reach = std::max(reach, pose.translation().norm());
+      entries.push_back(makeEntry(UNIFORM, -1, pose, joint_values));
+    }
+
+    // near singular, the least manipulable of several uniform samples
+    std::vector<std::pair<double, std::vector<double> > > candidates(SINGULAR_OVERSAMPLING * num_poses);
+    for(std::size_t i = 0; i < candidates.size(); ++i)
+    {
+      sampleUniform(candidates[i].second);
+      computeFK(candidates[i].second);
+      candidates[i].first = manipulability();
+    }
+    std::sort(candidates.begin(), candidates.end());
+    for(int i = 0; i < num_poses; ++i)
+      entries.push_back(makeEntry(NEAR_SINGULAR, -1, computeFK(candidates[i].second), candidates[i].second));
+
+    // near limit
+    for(int i = 0; i < num_poses; ++i)
+    {
+      sampleUniform(joint_values);
+      moveNearLimit(joint_values);
+      entries.push_back(makeEntry(NEAR_LIMIT, -1, computeFK(joint_values), joint_values));
+    }
+
+    // unreachable, uniform poses pushed out beyond the reach along their own direction
+    for(int i = 0; i < num_poses; ++i)
+    {
+      Eigen::Affine3d pose = computeFK(entries[uniform_begin + i].joint_values);
+      Eigen::Vector3d direction = pose.translation().norm() > 0.0 ? pose.translation().normalized() : randomDirection();
+      pose.translation() = UNREACHABLE_SCALE * reach * direction;
+      entries.push_back(makeEntry(UNREACHABLE, -1, pose, unknown));
+    }
+
+    // Cartesian paths, only the start of each path is known to be reachable
+    path_length = std::max(path_length, 1);
+    int num_paths = (num_poses + path_length - 1) / path_length;
+    for(int path = 0; path < num_paths; ++path)
+    {
+      sampleUniform(joint_values);
+      Eigen::Affine3d pose = computeFK(joint_values);
+      Eigen::Vector3d step = path_step * randomDirection();
+      for(int i = 0; i < path_length; ++i)
+      {
+        entries.push_back(makeEntry(CARTESIAN_PATH, path, pose, i == 0 ? joint_values : unknown));
+        pose.translation() += step;
+      }
+    }
+  }
+
+private:
+  robot_model::RobotModelPtr kinematic_model_;
+  const robot_model::JointModelGroup *group_;
+  std::string root_link_;
+  std::string tip_link_;
+  robot_state::RobotState kinematic_state_;
+  boost::random::mt19937 generator_;
+  std::vector<bool> has_limits_;
+  std::vector<double> lower_;
+  std::vector<double> upper_;
+};
+
+int main(int argc, char **argv)
+{
+  ros::init(argc, argv, "generate_pose_corpus");
+  ros::NodeHandle ph("~");
+
+  std::string group_name, root_link, tip_link, output;
+  int seed, num_poses, path_length;
+  double path_step;
+  if(!(ph.getParam("group", group_name) && ph.getParam("root_link", root_link) && ph.getParam("tip_link", tip_link) &&
+       ph.getParam("output", output)))
+  {
+    ROS_ERROR_STREAM("The group, root_link, tip_link and output parameters are required");
+    return 1;
+  }
+  ph.param("seed", seed, 0);
+  ph.param("num_poses", num_poses, 1000);
+  ph.param("path_length", path_length, 100);
+  ph.param("path_step", path_step, 0.001);
+
+  // loading robot model
+  rdf_loader::RDFLoader rdf_loader(ROBOT_DESCRIPTION_PARAM);
+  const boost::shared_ptr<srdf::Model> &srdf = rdf_loader.getSRDF();
+  const boost::shared_ptr<urdf::ModelInterface>& urdf_model = rdf_loader.getURDF();
+  if(!urdf_model || !srdf)
+  {
+    ROS_ERROR_STREAM("Failed to load the robot description");
+    return 1;
+  }
+  robot_model::RobotModelPtr kinematic_model(new robot_model::RobotModel(urdf_model, srdf));
+  const robot_model::JointModelGroup *group = kinematic_model->getJointModelGroup(group_name);
+  if(group == NULL)
+  {
+    ROS_ERROR_STREAM("Group " << group_name << " not found");
+    return 1;
+  }
+
+  PoseCorpusGenerator generator(kinematic_model, group, root_link, tip_link, seed);
+  std::vector<PoseCorpusEntry> entries;
+  generator.generate(num_poses, path_length, path_step, entries);
+
+  if(!writePoseCorpus(output, generator.numJoints(), seed, entries))
+  {
+    ROS_ERROR_STREAM("Failed to write " << output);
+    return 1;
+  }
+
+  ROS_INFO_STREAM("Wrote " << entries.size() << " poses of group " << group_name << " with seed " << seed << " to " << output);
+  return 0;
+}
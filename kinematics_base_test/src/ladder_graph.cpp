@@ -0,0 +1,153 @@
+#include <kinematics_base_test/ladder_graph.h>
+
+#include <math.h>
+#include <algorithm>
+#include <limits>
+
+namespace kinematics_base_test
+{
+
+const uint32_t NO_PREDECESSOR = (uint32_t)-1;
+
+/// \brief Orders point indices by the joint 0 value of the points
+struct JointZeroLess
+{
+  JointZeroLess(const std::vector<std::vector<double> > &points): points(points) {}
+
+  bool operator()(std::size_t a, std::size_t b) const { return points[a][0] < points[b][0]; }
+
+  const std::vector<std::vector<double> > &points;
+};
+
+LadderGraph::LadderGraph(std::size_t dof):
+  dof_(dof)
+{
+}
+
+void LadderGraph::reset(std::size_t dof, std::size_t num_rungs)
+{
+  dof_ = dof;
+  rungs_.assign(num_rungs, Rung());
+}
+
+void LadderGraph::setRung(std::size_t rung, const std::vector<std::vector<double> > &points)
+{
+  std::vector<std::size_t> order(points.size());
+  for(std::size_t i = 0; i < order.size(); ++i)
+    order[i] = i;
+  if(dof_ > 0)
+    std::sort(order.begin(), order.end(), JointZeroLess(points));
+
+  Rung &r = rungs_[rung];
+  r.num_points = points.size();
+  r.values.resize(dof_ * points.size());
+  for(std::size_t j = 0; j < dof_; ++j)
+  {
+    double *values = &r.values[j * r.num_points];
+    for(std::size_t i = 0; i < order.size(); ++i)
+      values[i] = points[order[i]][j];
+  }
+}
+
+void LadderGraph::getPoint(std::size_t rung, std::size_t point, std::vector<double> &joint_values) const
+{
+  joint_values.resize(dof_);
+  for(std::size_t j = 0; j < dof_; ++j)
+    joint_values[j] = jointValues(rung, j)[point];
+}
+
+bool searchLadderGraph(const LadderGraph &graph, const std::vector<double> &max_steps, LadderGraphPath &path,
+                       std::size_t *failed_rung)
+{
+  const double infinity = std::numeric_limits<double>::infinity();
+  const std::size_t dof = graph.dof();
+  path.cost = 0.0;
+  path.points.clear();
+  if(graph.size() == 0)
+    return true;
+
+  std::vector<double> steps(dof, infinity);
+  for(std::size_t j = 0; j < dof && j < max_steps.size(); ++j)
+    steps[j] = max_steps[j];
+
+  // the costs of the points of the last rung, the predecessors of every rung
+  std::vector<double> costs(graph.numPoints(0), 0.0), next_costs, distances;
+  std::vector<std::vector<uint32_t> > predecessors(graph.size());
+  std::vector<double> point(dof);
+  std::size_t rung = 1;
+  for(; rung < graph.size() && !costs.empty(); ++rung)
+  {
+    const std::size_t num_points = graph.numPoints(rung);
+    const std::size_t num_previous = graph.numPoints(rung - 1);
+    const double *previous_first = dof > 0 ? graph.jointValues(rung - 1, 0) : NULL;
+    next_costs.assign(num_points, infinity);
+    predecessors[rung].assign(num_points, NO_PREDECESSOR);
+
+    bool reached = false;
+    for(std::size_t i = 0; i < num_points; ++i)
+    {
+      graph.getPoint(rung, i, point);
+
+      // the previous points within the step of joint 0
+      std::size_t begin = 0, end = num_previous;
+      if(dof > 0)
+      {
+        begin = std::lower_bound(previous_first, previous_first + num_previous, point[0] - steps[0]) - previous_first;
+        end = std::upper_bound(previous_first + begin, previous_first + num_previous, point[0] + steps[0]) - previous_first;
+      }
+      if(begin == end)
+        continue;
+
+      // path costs through each of them, infinite beyond the step of any joint
+      const std::size_t count = end - begin;
+      distances.assign(costs.begin() + begin, costs.begin() + end);
+      double *distance = &distances[0];
+      for(std::size_t j = 0; j < dof; ++j)
+      {
+        const double *values = graph.jointValues(rung - 1, j) + begin;
+        const double value = point[j];
+        const double step = steps[j];
+        for(std::size_t k = 0; k < count; ++k)
+        {
+          double delta = fabs(values[k] - value);
+          distance[k] = delta <= step ? distance[k] + delta : infinity;
+        }
+      }
+
+      std::size_t best = std::min_element(distances.begin(), distances.end()) - distances.begin();
+      if(distance[best] < infinity)
+      {
+        next_costs[i] = distance[best];
+        predecessors[rung][i] = begin + best;
+        reached = true;
+      }
+    }
+
+    if(!reached)
+      break;
+    costs.swap(next_costs);
+  }
+
+  if(costs.empty())
+    rung = 0;
+  if(rung < graph.size())
+  {
+    if(failed_rung != NULL)
+      *failed_rung = rung;
+    return false;
+  }
+
+  // back from the cheapest point of the last rung
+  std::size_t point_index = std::min_element(costs.begin(), costs.end()) - costs.begin();
+  path.cost = costs[point_index];
+  path.points.resize(graph.size());
+  for(std::size_t r = graph.size(); r-- > 0;)
+  {
+    path.points[r] = point_index;
+    if(r > 0)
+      point_index = predecessors[r][point_index];
+  }
+  return true;
+}
+
+} // end namespace
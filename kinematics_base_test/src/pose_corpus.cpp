@@ -0,0 +1,147 @@
+#include <kinematics_base_test/pose_corpus.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace kinematics_base_test
+{
+
+bool writePoseCorpus(const std::string &path, uint32_t num_joints, uint64_t seed,
+                     const std::vector<PoseCorpusEntry> &entries)
+{
+  PoseCorpusHeader header;
+  memcpy(header.magic, POSE_CORPUS_MAGIC, sizeof(header.magic));
+  header.version = POSE_CORPUS_VERSION;
+  header.num_joints = num_joints;
+  header.record_size = sizeof(PoseCorpusRecord) + num_joints * sizeof(double);
+  header.num_poses = entries.size();
+  header.seed = seed;
+
+  FILE *file = fopen(path.c_str(), "wb");
+  if(file == NULL)
+  {
+    perror(path.c_str());
+    return false;
+  }
+
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+  for(std::size_t i = 0; ok && i < entries.size(); ++i)
+  {
+    const PoseCorpusEntry &entry = entries[i];
+    if(entry.joint_values.size() != num_joints)
+    {
+      fprintf(stderr, "%s: entry %d has %d joint values instead of %d\n", path.c_str(), (int)i,
+              (int)entry.joint_values.size(), (int)num_joints);
+      ok = false;
+      break;
+    }
+
+    PoseCorpusRecord record;
+    record.category = entry.category;
+    record.path_id = entry.path_id;
+    memcpy(record.pose, entry.pose, sizeof(record.pose));
+    ok = fwrite(&record, sizeof(record), 1, file) == 1 &&
+         (num_joints == 0 || fwrite(&entry.joint_values[0], sizeof(double), num_joints, file) == num_joints);
+  }
+
+  if(fclose(file) != 0)
+    ok = false;
+  return ok;
+}
+
+PoseCorpus::PoseCorpus():
+  data_(NULL),
+  size_(0)
+{
+}
+
+PoseCorpus::~PoseCorpus()
+{
+  unload();
+}
+
+bool PoseCorpus::load(const std::string &path)
+{
+  unload();
+
+  int fd = open(path.c_str(), O_RDONLY);
+  if(fd < 0)
+  {
+    perror(path.c_str());
+    return false;
+  }
+
+  struct stat st;
+  if(fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(PoseCorpusHeader))
+  {
+    fprintf(stderr, "%s: not a pose corpus\n", path.c_str());
+    close(fd);
+    return false;
+  }
+
+  void *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if(data == MAP_FAILED)
+  {
+    perror(path.c_str());
+    return false;
+  }
+
+  const PoseCorpusHeader *header = static_cast<const PoseCorpusHeader*>(data);
+  if(memcmp(header->magic, POSE_CORPUS_MAGIC, sizeof(header->magic)) != 0 || header->version != POSE_CORPUS_VERSION ||
+     header->record_size != sizeof(PoseCorpusRecord) + header->num_joints * sizeof(double) ||
+     (uint64_t)st.st_size != sizeof(PoseCorpusHeader) + header->num_poses * header->record_size)
+  {
+    fprintf(stderr, "%s: not a pose corpus of version %u\n", path.c_str(), POSE_CORPUS_VERSION);
+    munmap(data, st.st_size);
+    return false;
+  }
+
+  data_ = data;
+  size_ = st.st_size;
+  return true;
+}
+
+void PoseCorpus::unload()
+{
+  if(data_ != NULL)
+    munmap(data_, size_);
+  data_ = NULL;
+  size_ = 0;
+}
+
+std::vector<std::size_t> PoseCorpus::indices(POSE_CATEGORY category) const
+{
+  std::vector<std::size_t> result;
+  for(std::size_t i = 0; i < size(); ++i)
+  {
+    if(record(i).category == (uint32_t)category)
+      result.push_back(i);
+  }
+  return result;
+}
+
+const char* poseCategoryName(POSE_CATEGORY category)
+{
+  switch(category)
+  {
+    case UNIFORM:
+      return "uniform";
+    case NEAR_SINGULAR:
+      return "near_singular";
+    case NEAR_LIMIT:
+      return "near_limit";
+    case UNREACHABLE:
+      return "unreachable";
+    case CARTESIAN_PATH:
+      return "cartesian_path";
+    default:
+      return "unknown";
+  }
+}
+
+} // end namespace
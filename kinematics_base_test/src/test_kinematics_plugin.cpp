@@ -1,6 +1,7 @@
 #include <ros/ros.h>
 #include <gtest/gtest.h>
 #include <pluginlib/class_loader.h>
+#include <boost/thread.hpp>
 
 // MoveIt!
 #include <moveit/kinematics_base/kinematics_base.h>
@@ -10,6 +11,11 @@
 #include <urdf/model.h>
 #include <srdfdom/model.h>
 
+#include <kinematics_base_test/pose_corpus.h>
+#include <kinematics_base_test/allocation_counter.h>
+#include <kinematics_base_test/cartesian_path_planner.h>
+#include <ikfast_kinematics_extension/ikfast_kinematics_extension.h>
+
 #define IK_NEAR 1e-4
 #define IK_NEAR_TRANSLATE 1e-5
 
@@ -25,7 +31,23 @@ const std::string NUM_FK_TESTS = "num_fk_tests";
 const std::string NUM_IK_CB_TESTS = "num_ik_cb_tests";
 const std::string NUM_IK_TESTS = "num_ik_tests";
 const std::string NUM_IK_MULTIPLE_TESTS = "num_ik_multiple_tests";
+const std::string NUM_THREADS = "num_threads";
+const std::string POSE_CORPUS = "pose_corpus";
+const std::string NUM_ALLOCATION_TESTS = "num_allocation_tests";
+const std::string ZERO_ALLOCATION_ENTRY_POINTS = "zero_allocation_entry_points";
+const std::string NUM_PATH_TESTS = "num_path_tests";
+const std::string PATH_DISCRETIZE_FREE_JOINTS = "path_discretize_free_joints";
+const std::string IKFAST_EXTENSION = "ikfast_extension";
+const int NUM_PATH_WAYPOINTS = 200;
+const double PATH_TIME_STEP = 0.1;
 const double DEFAULT_SEARCH_DISCRETIZATION = 0.01f;
+const std::size_t MAX_STREAM_SOLUTIONS = 10000;
+// Scene versions of the callback memo, one per callback so that the verdicts of different callbacks don't mix
+const uint64_t HEIGHT_CALLBACK_SCENE = 1;        // KinematicsTest::searchIKCallback
+const uint64_t JOINT_VALUES_CALLBACK_SCENE = 2;  // jointValuesCallback and jointValuesBatchCallback
+const uint64_t MEMO_TEST_SCENE = 3;              // and the next one, see the callbackMemo test
+const uint64_t REJECTING_CALLBACK_SCENE = 5;     // rejectingCallback
+const uint64_t ACCEPTING_CALLBACK_SCENE = 6;     // acceptingCallback
 
 class KinematicsTest
 {
@@ -82,6 +104,13 @@ public:
       return false;
     }
 
+    // the ikfast plugins implement IKFastKinematicsExtension, the tests of its methods are skipped for other plugins
+    ikfast_extension_ = dynamic_cast<ikfast_kinematics_plugin::IKFastKinematicsExtension*>(kinematics_solver_.get());
+    bool expect_ikfast_extension;
+    ph.param(IKFAST_EXTENSION, expect_ikfast_extension, false);
+    EXPECT_EQ(expect_ikfast_extension, ikfast_extension_ != NULL) << "IKFastKinematicsExtension is " <<
+        (ikfast_extension_ != NULL ? "" : "not ") << "implemented by " << plugin_name;
+
     // loading test details parameters
     if(ph.getParam(NUM_FK_TESTS,num_fk_tests_) &&
         ph.getParam(NUM_IK_CB_TESTS,num_ik_cb_tests_) &&
@@ -96,9 +125,135 @@ public:
       EXPECT_TRUE(false);
     }
 
+    // 1 runs the tests serially, 0 uses all hardware threads
+    ph.param(NUM_THREADS, num_threads_, 1);
+    if(num_threads_ <= 0)
+      num_threads_ = std::max(boost::thread::hardware_concurrency(), 1u);
+
+    // entry points listed here fail the allocations test if they allocate
+    ph.param(NUM_ALLOCATION_TESTS, num_allocation_tests_, 100);
+    ph.getParam(ZERO_ALLOCATION_ENTRY_POINTS, zero_allocation_entry_points_);
+
+    // the Cartesian path planner needs the multi-solution getPositionIK, which not every plugin has
+    ph.param(NUM_PATH_TESTS, num_path_tests_, 0);
+    ph.param(PATH_DISCRETIZE_FREE_JOINTS, path_discretize_free_joints_, false);
+
+    // the test states come from the uniform poses of the corpus if one is given, random ones otherwise
+    std::string corpus_path;
+    if(ph.getParam(POSE_CORPUS, corpus_path))
+    {
+      if(!pose_corpus_.load(corpus_path) || pose_corpus_.numJoints() != kinematics_solver_->getJointNames().size())
+      {
+        ROS_ERROR_STREAM("Failed to load pose corpus " << corpus_path);
+        EXPECT_TRUE(false);
+        return false;
+      }
+      corpus_indices_ = pose_corpus_.indices(kinematics_base_test::UNIFORM);
+      ROS_INFO_STREAM("Loaded " << corpus_indices_.size() << " uniform poses from " << corpus_path);
+    }
+
+    // loading robot model
+    rdf_loader::RDFLoader rdf_loader(ROBOT_DESCRIPTION_PARAM);
+    const boost::shared_ptr<srdf::Model> &srdf = rdf_loader.getSRDF();
+    const boost::shared_ptr<urdf::ModelInterface>& urdf_model = rdf_loader.getURDF();
+    kinematic_model_.reset(new robot_model::RobotModel(urdf_model, srdf));
+
     return true;
   }
 
+  /// \brief Outcome of the runs of a test function
+  struct TestCounters
+  {
+    TestCounters(): success(0), num_ik_solutions(0) {}
+
+    unsigned int success;
+    unsigned int num_ik_solutions;
+  };
+
+  /// \brief Runs a single test with the given state, which each thread owns
+  typedef boost::function<void (robot_state::RobotState &kinematic_state,
+                                const robot_model::JointModelGroup *joint_model_group,
+                                unsigned int test_index,
+                                TestCounters &counters)> TestFunction;
+
+  /**
+   * @brief Runs test num_tests times, sharded across num_threads_ threads
+   *
+   * In parallel mode one thread's share is run serially first so that the scaling efficiency,
+   * the parallel throughput relative to num_threads_ times the serial one, can be reported.
+   * @return The counters aggregated over every run but the serial ones
+   */
+  TestCounters runTests(const std::string &name, unsigned int num_tests, const TestFunction &test)
+  {
+    unsigned int chunk = (num_tests + num_threads_ - 1) / num_threads_;
+    double serial_time = 0.0;
+    if(num_threads_ > 1)
+    {
+      TestCounters serial_counters;
+      ros::WallTime start_time = ros::WallTime::now();
+      runRange(test, 0, chunk, serial_counters);
+      serial_time = (ros::WallTime::now() - start_time).toSec();
+    }
+
+    std::vector<TestCounters> thread_counters(num_threads_);
+    boost::thread_group threads;
+    ros::WallTime start_time = ros::WallTime::now();
+    for(int t = 0; t < num_threads_; ++t)
+    {
+      unsigned int begin = std::min(t * chunk, num_tests);
+      unsigned int end = std::min(begin + chunk, num_tests);
+      threads.create_thread(boost::bind(&KinematicsTest::runRange, this, test, begin, end, boost::ref(thread_counters[t])));
+    }
+    threads.join_all();
+    double elapsed_time = (ros::WallTime::now() - start_time).toSec();
+
+    TestCounters counters;
+    for(int t = 0; t < num_threads_; ++t)
+    {
+      counters.success += thread_counters[t].success;
+      counters.num_ik_solutions += thread_counters[t].num_ik_solutions;
+    }
+
+    ROS_INFO_STREAM(name << " elapsed time: " << elapsed_time << " on " << num_threads_ << " threads, throughput: " <<
+                    num_tests / elapsed_time << " tests/s");
+    if(num_threads_ > 1)
+      ROS_INFO_STREAM(name << " scaling efficiency: " << serial_time / elapsed_time);
+
+    return counters;
+  }
+
+  /**
+   * @brief Gets the joint values of a test, from the pose corpus if loaded
+   */
+  void getTestState(robot_state::RobotState &kinematic_state, const robot_model::JointModelGroup *joint_model_group,
+                    unsigned int test_index, std::vector<double> &fk_values) const
+  {
+    if(!corpus_indices_.empty())
+    {
+      const double *joint_values = pose_corpus_.jointValues(corpus_indices_[test_index % corpus_indices_.size()]);
+      fk_values.assign(joint_values, joint_values + pose_corpus_.numJoints());
+      return;
+    }
+
+    kinematic_state.setToRandomPositions(joint_model_group);
+    kinematic_state.copyJointGroupPositions(joint_model_group, fk_values);
+  }
+
+  void runRange(const TestFunction &test, unsigned int begin, unsigned int end, TestCounters &counters)
+  {
+    robot_state::RobotState kinematic_state(kinematic_model_);
+    const robot_model::JointModelGroup* joint_model_group = kinematic_model_->getJointModelGroup(kinematics_solver_->getGroupName());
+    for(unsigned int i = begin; i < end; ++i)
+      test(kinematic_state, joint_model_group, i, counters);
+  }
+
+  /// \brief Sets the scene version of the callback memo of the ikfast plugins, see HEIGHT_CALLBACK_SCENE
+  void setCallbackMemoScene(uint64_t version)
+  {
+    if(ikfast_extension_ != NULL)
+      ikfast_extension_->setCallbackMemoSceneVersion(version);
+  }
+
   void searchIKCallback(const geometry_msgs::Pose &ik_pose,
                             const std::vector<double> &joint_state,
                             moveit_msgs::MoveItErrorCodes &error_code)
@@ -124,6 +279,7 @@ public:
 public:
 
   kinematics::KinematicsBasePtr kinematics_solver_;
+  ikfast_kinematics_plugin::IKFastKinematicsExtension *ikfast_extension_; // kinematics_solver_ if an ikfast plugin, NULL otherwise
   boost::shared_ptr<KinematicsLoader> kinematics_loader_;
   std::string root_link_;
   std::string tip_link_;
@@ -133,6 +289,14 @@ public:
   int num_ik_cb_tests_;
   int num_ik_tests_;
   int num_ik_multiple_tests_;
+  int num_threads_;
+  int num_allocation_tests_;
+  std::vector<std::string> zero_allocation_entry_points_;
+  int num_path_tests_;
+  bool path_discretize_free_joints_;
+  robot_model::RobotModelPtr kinematic_model_;
+  kinematics_base_test::PoseCorpus pose_corpus_;
+  std::vector<std::size_t> corpus_indices_;
 };
 
 KinematicsTest kinematics_test;
@@ -156,347 +320,1073 @@ TEST(IKFastPlugin, initialize)
 }
 
 
-TEST(IKFastPlugin, getFK)
+void testFK(robot_state::RobotState &kinematic_state, const robot_model::JointModelGroup *joint_model_group,
+            unsigned int test_index, KinematicsTest::TestCounters &counters)
 {
-  // loading robot model
-  rdf_loader::RDFLoader rdf_loader(ROBOT_DESCRIPTION_PARAM);
-  robot_model::RobotModelPtr kinematic_model;
-  const boost::shared_ptr<srdf::Model> &srdf = rdf_loader.getSRDF();
-  const boost::shared_ptr<urdf::ModelInterface>& urdf_model = rdf_loader.getURDF();
-  kinematic_model.reset(new robot_model::RobotModel(urdf_model, srdf));
-
-  // fk solution setup
-  robot_model::JointModelGroup* joint_model_group = kinematic_model->getJointModelGroup(kinematics_test.kinematics_solver_->getGroupName());
-  std::vector<double> seed, fk_values, solution;
-  moveit_msgs::MoveItErrorCodes error_code;
-  solution.resize(kinematics_test.kinematics_solver_->getJointNames().size(), 0.0);
+  std::vector<double> fk_values;
   std::vector<std::string> fk_names;
   fk_names.push_back(kinematics_test.kinematics_solver_->getTipFrame());
-  robot_state::RobotState kinematic_state(kinematic_model);
 
-  bool succeeded;
-  int success = 0;
-  ros::WallTime start_time = ros::WallTime::now();
-  for(unsigned int i=0; i < kinematics_test.num_fk_tests_; ++i)
+  fk_values.resize(kinematics_test.kinematics_solver_->getJointNames().size(), 0.0);
+  kinematics_test.getTestState(kinematic_state, joint_model_group, test_index, fk_values);
+  std::vector<geometry_msgs::Pose> poses;
+  poses.resize(1);
+  bool succeeded = kinematics_test.kinematics_solver_->getPositionFK(fk_names, fk_values, poses);
+  if(succeeded && (poses.size() == 1))
   {
-    seed.resize(kinematics_test.kinematics_solver_->getJointNames().size(), 0.0);
-    fk_values.resize(kinematics_test.kinematics_solver_->getJointNames().size(), 0.0);
-    kinematic_state.setToRandomPositions(joint_model_group);
-    kinematic_state.copyJointGroupPositions(joint_model_group, fk_values);
-    std::vector<geometry_msgs::Pose> poses;
-    poses.resize(1);
-    succeeded = kinematics_test.kinematics_solver_->getPositionFK(fk_names, fk_values, poses);
-    if(succeeded && (poses.size() == 1))
-    {
-      success++;
-    }
+    counters.success++;
   }
+}
 
-  ROS_INFO_STREAM("Success Rate: "<<(double)success/kinematics_test.num_fk_tests_);
-  EXPECT_GT(success , 0.99 * kinematics_test.num_fk_tests_);
-  ROS_INFO_STREAM("Elapsed time: "<< (ros::WallTime::now()-start_time).toSec());
+void expectSamePose(const geometry_msgs::Pose &pose, const geometry_msgs::Pose &new_pose)
+{
+  EXPECT_NEAR(pose.position.x, new_pose.position.x, IK_NEAR);
+  EXPECT_NEAR(pose.position.y, new_pose.position.y, IK_NEAR);
+  EXPECT_NEAR(pose.position.z, new_pose.position.z, IK_NEAR);
+  EXPECT_NEAR(pose.orientation.x, new_pose.orientation.x, IK_NEAR);
+  EXPECT_NEAR(pose.orientation.y, new_pose.orientation.y, IK_NEAR);
+  EXPECT_NEAR(pose.orientation.z, new_pose.orientation.z, IK_NEAR);
+  EXPECT_NEAR(pose.orientation.w, new_pose.orientation.w, IK_NEAR);
 }
 
+/// \brief Expects a row major 3x4 matrix [R|t] to be the given transform
+void expectSameTransform(const Eigen::Affine3d &expected, const double *transform)
+{
+  for(int r = 0; r < 3; ++r)
+    for(int c = 0; c < 4; ++c)
+      EXPECT_NEAR(expected(r, c), transform[4 * r + c], IK_NEAR);
+}
 
-TEST(IKFastPlugin, searchIK)
+/// \brief Expects a row major 3x4 matrix [R|t] to be the transform of a pose
+void expectSameTransform(const geometry_msgs::Pose &pose, const double *transform)
+{
+  Eigen::Affine3d expected = Eigen::Translation3d(pose.position.x, pose.position.y, pose.position.z) *
+                             Eigen::Quaterniond(pose.orientation.w, pose.orientation.x, pose.orientation.y,
+                                                pose.orientation.z);
+  expectSameTransform(expected, transform);
+}
+
+void testFKBuffers(robot_state::RobotState &kinematic_state, const robot_model::JointModelGroup *joint_model_group,
+                   unsigned int test_index, KinematicsTest::TestCounters &counters)
 {
-  rdf_loader::RDFLoader rdf_loader_(ROBOT_DESCRIPTION_PARAM);
-  robot_model::RobotModelPtr kinematic_model;
-  const boost::shared_ptr<srdf::Model> &srdf_model = rdf_loader_.getSRDF();
-  const boost::shared_ptr<urdf::ModelInterface>& urdf_model = rdf_loader_.getURDF();
-  kinematic_model.reset(new robot_model::RobotModel(urdf_model, srdf_model));
-  robot_model::JointModelGroup* joint_model_group = kinematic_model->getJointModelGroup(kinematics_test.kinematics_solver_->getGroupName());
+  const ikfast_kinematics_plugin::IKFastKinematicsExtension &solver = *kinematics_test.ikfast_extension_;
+  std::vector<std::string> fk_names(1, solver.getTipFrame());
+  std::size_t num_joints = solver.getJointNames().size();
+
+  // two test states one after the other, for the overload of several states
+  std::vector<double> fk_values, second_values;
+  kinematics_test.getTestState(kinematic_state, joint_model_group, 2 * test_index, fk_values);
+  kinematics_test.getTestState(kinematic_state, joint_model_group, 2 * test_index + 1, second_values);
+  fk_values.insert(fk_values.end(), second_values.begin(), second_values.end());
+
+  std::vector<geometry_msgs::Pose> poses(1), second_poses(1);
+  ASSERT_TRUE(solver.getPositionFK(fk_names, std::vector<double>(fk_values.begin(), fk_values.begin() + num_joints), poses));
+  ASSERT_TRUE(solver.getPositionFK(fk_names, second_values, second_poses));
+
+  double transform[12];
+  ASSERT_TRUE(solver.getPositionFK(&fk_values[0], transform));
+  expectSameTransform(poses[0], transform);
+
+  Eigen::Isometry3d isometry;
+  ASSERT_TRUE(solver.getPositionFK(&fk_values[0], isometry));
+  for(int r = 0; r < 3; ++r)
+    for(int c = 0; c < 4; ++c)
+      transform[4 * r + c] = isometry(r, c);
+  expectSameTransform(poses[0], transform);
+
+  double transforms[24];
+  ASSERT_TRUE(solver.getPositionFK(&fk_values[0], 2, transforms));
+  expectSameTransform(poses[0], transforms);
+  expectSameTransform(second_poses[0], transforms + 12);
+  counters.success++;
+}
 
-  //Test inverse kinematics
+void testChainFK(robot_state::RobotState &kinematic_state, const robot_model::JointModelGroup *joint_model_group,
+                 unsigned int test_index, KinematicsTest::TestCounters &counters)
+{
+  const ikfast_kinematics_plugin::IKFastKinematicsExtension &solver = *kinematics_test.ikfast_extension_;
+  const std::vector<std::string> &link_names = solver.getLinkNames();
+  std::size_t num_links = link_names.size();
+
+  std::vector<double> fk_values, second_values;
+  kinematics_test.getTestState(kinematic_state, joint_model_group, 2 * test_index, fk_values);
+  kinematics_test.getTestState(kinematic_state, joint_model_group, 2 * test_index + 1, second_values);
+
+  // the poses of the links relative to the base frame according to the robot model
+  kinematic_state.setJointGroupPositions(joint_model_group, fk_values);
+  kinematic_state.update();
+  Eigen::Affine3d base_inverse = kinematic_state.getGlobalLinkTransform(solver.getBaseFrame()).inverse();
+
+  std::vector<double> transforms(12 * num_links);
+  ASSERT_TRUE(solver.getChainFK(&fk_values[0], &transforms[0]));
+  for(std::size_t i = 0; i < num_links; ++i)
+    expectSameTransform(base_inverse * kinematic_state.getGlobalLinkTransform(link_names[i]), &transforms[12 * i]);
+
+  // several states give the transforms of each state one after the other
+  std::vector<double> second_transforms(12 * num_links), batch_transforms(24 * num_links);
+  ASSERT_TRUE(solver.getChainFK(&second_values[0], &second_transforms[0]));
+  fk_values.insert(fk_values.end(), second_values.begin(), second_values.end());
+  ASSERT_TRUE(solver.getChainFK(&fk_values[0], 2, &batch_transforms[0]));
+  for(std::size_t i = 0; i < 12 * num_links; ++i)
+  {
+    EXPECT_NEAR(transforms[i], batch_transforms[i], IK_NEAR);
+    EXPECT_NEAR(second_transforms[i], batch_transforms[12 * num_links + i], IK_NEAR);
+  }
+  counters.success++;
+}
+
+void testJacobian(robot_state::RobotState &kinematic_state, const robot_model::JointModelGroup *joint_model_group,
+                  unsigned int test_index, KinematicsTest::TestCounters &counters)
+{
+  const ikfast_kinematics_plugin::IKFastKinematicsExtension &solver = *kinematics_test.ikfast_extension_;
+  const std::vector<std::string> &link_names = solver.getLinkNames();
+  std::size_t num_joints = solver.getJointNames().size();
+  std::size_t num_links = link_names.size();
+  std::size_t tip = std::find(link_names.begin(), link_names.end(), solver.getTipFrame()) - link_names.begin();
+  ASSERT_LT(tip, num_links);
+
+  std::vector<double> fk_values, second_values;
+  kinematics_test.getTestState(kinematic_state, joint_model_group, 2 * test_index, fk_values);
+  kinematics_test.getTestState(kinematic_state, joint_model_group, 2 * test_index + 1, second_values);
+
+  std::vector<double> jacobian(6 * num_joints);
+  ASSERT_TRUE(solver.getJacobian(&fk_values[0], &jacobian[0]));
+
+  // central differences of the tip transform, the angular velocity is the vector of the skew matrix dR/dq R^T
+  const double step = 1e-6;
+  std::vector<double> values_plus, values_minus, transforms_plus(12 * num_links), transforms_minus(12 * num_links);
+  for(std::size_t j = 0; j < num_joints; ++j)
+  {
+    values_plus = values_minus = fk_values;
+    values_plus[j] += step;
+    values_minus[j] -= step;
+    ASSERT_TRUE(solver.getChainFK(&values_plus[0], &transforms_plus[0]));
+    ASSERT_TRUE(solver.getChainFK(&values_minus[0], &transforms_minus[0]));
+
+    Eigen::Map<const Eigen::Matrix<double, 3, 4, Eigen::RowMajor> > plus(&transforms_plus[12 * tip]);
+    Eigen::Map<const Eigen::Matrix<double, 3, 4, Eigen::RowMajor> > minus(&transforms_minus[12 * tip]);
+    Eigen::Vector3d linear = (plus.col(3) - minus.col(3)) / (2 * step);
+    Eigen::Matrix3d skew = (plus.leftCols<3>() - minus.leftCols<3>()) / (2 * step) *
+                           (0.5 * (plus.leftCols<3>() + minus.leftCols<3>())).transpose();
+    Eigen::Vector3d angular(skew(2, 1), skew(0, 2), skew(1, 0));
+    for(int r = 0; r < 3; ++r)
+    {
+      EXPECT_NEAR(linear[r], jacobian[6 * j + r], IK_NEAR);
+      EXPECT_NEAR(angular[r], jacobian[6 * j + 3 + r], IK_NEAR);
+    }
+  }
+
+  Eigen::Map<const Eigen::MatrixXd> jacobian_matrix(&jacobian[0], 6, num_joints);
+  double manipulability;
+  ASSERT_TRUE(solver.getManipulability(&fk_values[0], manipulability));
+  EXPECT_NEAR(sqrt(std::max((jacobian_matrix * jacobian_matrix.transpose()).determinant(), 0.0)), manipulability, IK_NEAR);
+
+  // without damping the joint velocities realize the twist exactly, unless the state is close to a singularity
+  const double twist[6] = {0.1, -0.2, 0.05, 0.1, 0.2, -0.1};
+  std::vector<double> joint_velocities(num_joints);
+  ASSERT_TRUE(solver.getVelocityIK(&fk_values[0], twist, 0.0, &joint_velocities[0]));
+  if(manipulability > 1e-3)
+  {
+    Eigen::VectorXd realized = jacobian_matrix * Eigen::Map<const Eigen::VectorXd>(&joint_velocities[0], num_joints);
+    for(int r = 0; r < 6; ++r)
+      EXPECT_NEAR(twist[r], realized[r], IK_NEAR);
+  }
+
+  // several states give the results of each state one after the other
+  std::vector<double> second_jacobian(6 * num_joints), batch_jacobians(12 * num_joints);
+  double second_manipulability, batch_manipulability[2];
+  ASSERT_TRUE(solver.getJacobian(&second_values[0], &second_jacobian[0]));
+  ASSERT_TRUE(solver.getManipulability(&second_values[0], second_manipulability));
+  fk_values.insert(fk_values.end(), second_values.begin(), second_values.end());
+  ASSERT_TRUE(solver.getJacobian(&fk_values[0], 2, &batch_jacobians[0]));
+  ASSERT_TRUE(solver.getManipulability(&fk_values[0], 2, batch_manipulability));
+  for(std::size_t i = 0; i < 6 * num_joints; ++i)
+  {
+    EXPECT_NEAR(jacobian[i], batch_jacobians[i], IK_NEAR);
+    EXPECT_NEAR(second_jacobian[i], batch_jacobians[6 * num_joints + i], IK_NEAR);
+  }
+  EXPECT_NEAR(manipulability, batch_manipulability[0], IK_NEAR);
+  EXPECT_NEAR(second_manipulability, batch_manipulability[1], IK_NEAR);
+  counters.success++;
+}
+
+void testSearchIK(robot_state::RobotState &kinematic_state, const robot_model::JointModelGroup *joint_model_group,
+                  unsigned int test_index, KinematicsTest::TestCounters &counters)
+{
   std::vector<double> seed, fk_values, solution;
   double timeout = 5.0;
   moveit_msgs::MoveItErrorCodes error_code;
-  solution.resize(kinematics_test.kinematics_solver_->getJointNames().size(), 0.0);
   std::vector<std::string> fk_names;
   fk_names.push_back(kinematics_test.kinematics_solver_->getTipFrame());
-  robot_state::RobotState kinematic_state(kinematic_model);
 
-  unsigned int success = 0;
-  ros::WallTime start_time = ros::WallTime::now();
-  for(unsigned int i=0; i < kinematics_test.num_ik_tests_; ++i)
+  seed.resize(kinematics_test.kinematics_solver_->getJointNames().size(), 0.0);
+  fk_values.resize(kinematics_test.kinematics_solver_->getJointNames().size(), 0.0);
+  kinematics_test.getTestState(kinematic_state, joint_model_group, test_index, fk_values);
+  std::vector<geometry_msgs::Pose> poses;
+  poses.resize(1);
+
+  bool result_fk = kinematics_test.kinematics_solver_->getPositionFK(fk_names, fk_values, poses);
+  EXPECT_TRUE(result_fk);
+  if(!result_fk)
+    return;
+
+  kinematics_test.kinematics_solver_->searchPositionIK(poses[0], seed, timeout, solution, error_code);
+  bool result = error_code.val == error_code.SUCCESS;
+
+  ROS_DEBUG("Pose: %f %f %f",poses[0].position.x, poses[0].position.y, poses[0].position.z);
+  ROS_DEBUG("Orient: %f %f %f %f",poses[0].orientation.x, poses[0].orientation.y, poses[0].orientation.z, poses[0].orientation.w);
+
+  if(result)
   {
-    seed.resize(kinematics_test.kinematics_solver_->getJointNames().size(), 0.0);
-    fk_values.resize(kinematics_test.kinematics_solver_->getJointNames().size(), 0.0);
-    kinematic_state.setToRandomPositions(joint_model_group);
-    kinematic_state.copyJointGroupPositions(joint_model_group, fk_values);
-    std::vector<geometry_msgs::Pose> poses;
-    poses.resize(1);
+    EXPECT_TRUE(kinematics_test.kinematics_solver_->getPositionIK(poses[0], solution, solution, error_code));
+    result = error_code.val == error_code.SUCCESS;
+  }
 
-    bool result_fk = kinematics_test.kinematics_solver_->getPositionFK(fk_names, fk_values, poses);
-    ASSERT_TRUE(result_fk);
-    solution.clear();
-    kinematics_test.kinematics_solver_->searchPositionIK(poses[0], seed, timeout, solution, error_code);
-    bool result = error_code.val == error_code.SUCCESS;
+  if(result)
+  {
+    counters.success++;
+  }
+  else
+  {
+    ROS_ERROR_STREAM("searchPositionIK failed on test "<<test_index+1);
+    return;
+  }
 
-    ROS_DEBUG("Pose: %f %f %f",poses[0].position.x, poses[0].position.y, poses[0].position.z);
-    ROS_DEBUG("Orient: %f %f %f %f",poses[0].orientation.x, poses[0].orientation.y, poses[0].orientation.z, poses[0].orientation.w);
+  std::vector<geometry_msgs::Pose> new_poses;
+  new_poses.resize(1);
+  result_fk = kinematics_test.kinematics_solver_->getPositionFK(fk_names, solution, new_poses);
+  expectSamePose(poses[0], new_poses[0]);
+}
 
-    if(result)
-    {
-      EXPECT_TRUE(kinematics_test.kinematics_solver_->getPositionIK(poses[0], solution, solution, error_code));
-      result = error_code.val == error_code.SUCCESS;
-    }
+void testSearchIKWithCallback(robot_state::RobotState &kinematic_state, const robot_model::JointModelGroup *joint_model_group,
+                              unsigned int test_index, KinematicsTest::TestCounters &counters)
+{
+  std::vector<double> fk_values, solution;
+  double timeout = 5.0;
+  moveit_msgs::MoveItErrorCodes error_code;
+  std::vector<std::string> fk_names;
+  fk_names.push_back(kinematics_test.kinematics_solver_->getTipFrame());
 
-    if(result)
-    {
-      success++;
-    }
-    else
-    {
-      ROS_ERROR_STREAM("searchPositionIK failed on test "<<i+1);
-      continue;
-    }
+  fk_values.resize(kinematics_test.kinematics_solver_->getJointNames().size(), 0.0);
+  kinematics_test.getTestState(kinematic_state, joint_model_group, test_index, fk_values);
+  std::vector<geometry_msgs::Pose> poses;
+  poses.resize(1);
+
+  bool result_fk = kinematics_test.kinematics_solver_->getPositionFK(fk_names, fk_values, poses);
+  EXPECT_TRUE(result_fk);
+  if(!result_fk)
+    return;
 
-    std::vector<geometry_msgs::Pose> new_poses;
-    new_poses.resize(1);
-    result_fk = kinematics_test.kinematics_solver_->getPositionFK(fk_names, solution, new_poses);
-    EXPECT_NEAR(poses[0].position.x, new_poses[0].position.x, IK_NEAR);
-    EXPECT_NEAR(poses[0].position.y, new_poses[0].position.y, IK_NEAR);
-    EXPECT_NEAR(poses[0].position.z, new_poses[0].position.z, IK_NEAR);
-    EXPECT_NEAR(poses[0].orientation.x, new_poses[0].orientation.x, IK_NEAR);
-    EXPECT_NEAR(poses[0].orientation.y, new_poses[0].orientation.y, IK_NEAR);
-    EXPECT_NEAR(poses[0].orientation.z, new_poses[0].orientation.z, IK_NEAR);
-    EXPECT_NEAR(poses[0].orientation.w, new_poses[0].orientation.w, IK_NEAR);
+  // check height
+  if(poses[0].position.z <= 0.0f)
+  {
+    return;
   }
 
+  kinematics_test.kinematics_solver_->searchPositionIK(poses[0], fk_values, timeout, solution,
+                                                       boost::bind(&KinematicsTest::searchIKCallback,&kinematics_test,
+                                                                   _1,_2,_3),error_code);
+  bool result = error_code.val == error_code.SUCCESS;
 
-  ROS_INFO_STREAM("Success Rate: "<<(double)success/kinematics_test.num_ik_tests_);
-  EXPECT_GT(success , 0.99 * kinematics_test.num_ik_tests_);
-  ROS_INFO_STREAM("Elapsed time: "<< (ros::WallTime::now()-start_time).toSec());
+  ROS_DEBUG("Pose: %f %f %f",poses[0].position.x, poses[0].position.y, poses[0].position.z);
+  ROS_DEBUG("Orient: %f %f %f %f",poses[0].orientation.x, poses[0].orientation.y, poses[0].orientation.z, poses[0].orientation.w);
+
+  if(result)
+  {
+    EXPECT_TRUE(kinematics_test.kinematics_solver_->getPositionIK(poses[0], solution, solution, error_code));
+    result = error_code.val == error_code.SUCCESS;
+  }
+
+  if(result)
+  {
+    counters.success++;
+  }
+  else
+  {
+    ROS_ERROR_STREAM("searchPositionIK failed on test "<<test_index+1);
+    return;
+  }
+
+  std::vector<geometry_msgs::Pose> new_poses;
+  new_poses.resize(1);
+  result_fk = kinematics_test.kinematics_solver_->getPositionFK(fk_names, solution, new_poses);
+  expectSamePose(poses[0], new_poses[0]);
 }
 
-TEST(IKFastPlugin, searchIKWithCallback)
+void testIK(robot_state::RobotState &kinematic_state, const robot_model::JointModelGroup *joint_model_group,
+            unsigned int test_index, KinematicsTest::TestCounters &counters)
 {
-  rdf_loader::RDFLoader rdf_loader_(ROBOT_DESCRIPTION_PARAM);
-  robot_model::RobotModelPtr kinematic_model;
-  const boost::shared_ptr<srdf::Model> &srdf_model = rdf_loader_.getSRDF();
-  const boost::shared_ptr<urdf::ModelInterface>& urdf_model = rdf_loader_.getURDF();
-  kinematic_model.reset(new robot_model::RobotModel(urdf_model, srdf_model));
-  robot_model::JointModelGroup* joint_model_group = kinematic_model->getJointModelGroup(kinematics_test.kinematics_solver_->getGroupName());
-
-  //Test inverse kinematics
-  std::vector<double> seed, fk_values, solution;
-  double timeout = 5.0;
+  std::vector<double> fk_values, solution;
   moveit_msgs::MoveItErrorCodes error_code;
-  solution.resize(kinematics_test.kinematics_solver_->getJointNames().size(), 0.0);
   std::vector<std::string> fk_names;
   fk_names.push_back(kinematics_test.kinematics_solver_->getTipFrame());
-  robot_state::RobotState kinematic_state(kinematic_model);
 
-  unsigned int success = 0;
-  ros::WallTime start_time = ros::WallTime::now();
-  for(unsigned int i=0; i < kinematics_test.num_ik_cb_tests_; ++i)
+  fk_values.resize(kinematics_test.kinematics_solver_->getJointNames().size(), 0.0);
+  kinematics_test.getTestState(kinematic_state, joint_model_group, test_index, fk_values);
+  std::vector<geometry_msgs::Pose> poses;
+  poses.resize(1);
+
+  bool result_fk = kinematics_test.kinematics_solver_->getPositionFK(fk_names, fk_values, poses);
+  EXPECT_TRUE(result_fk);
+  if(!result_fk)
+    return;
+
+  kinematics_test.kinematics_solver_->getPositionIK(poses[0], fk_values, solution, error_code);
+  ROS_DEBUG("Pose: %f %f %f",poses[0].position.x, poses[0].position.y, poses[0].position.z);
+  ROS_DEBUG("Orient: %f %f %f %f",poses[0].orientation.x, poses[0].orientation.y, poses[0].orientation.z, poses[0].orientation.w);
+
+  if(error_code.val == error_code.SUCCESS)
   {
-    seed.resize(kinematics_test.kinematics_solver_->getJointNames().size(), 0.0);
-    fk_values.resize(kinematics_test.kinematics_solver_->getJointNames().size(), 0.0);
-    kinematic_state.setToRandomPositions(joint_model_group);
-    kinematic_state.copyJointGroupPositions(joint_model_group, fk_values);
-    std::vector<geometry_msgs::Pose> poses;
-    poses.resize(1);
+    counters.success++;
+  }
+  else
+  {
+    ROS_ERROR_STREAM("getPositionIK failed on test "<<test_index+1<<" for group " <<kinematics_test.kinematics_solver_->getGroupName());
+    return;
+  }
 
-    bool result_fk = kinematics_test.kinematics_solver_->getPositionFK(fk_names, fk_values, poses);
-    ASSERT_TRUE(result_fk);
+  std::vector<geometry_msgs::Pose> new_poses;
+  new_poses.resize(1);
+  result_fk = kinematics_test.kinematics_solver_->getPositionFK(fk_names, solution, new_poses);
+  expectSamePose(poses[0], new_poses[0]);
+}
 
-    // check height
-    if(poses[0].position.z <= 0.0f)
-    {
-      continue;
-    }
+void testIKMultipleSolutions(robot_state::RobotState &kinematic_state, const robot_model::JointModelGroup *joint_model_group,
+                             unsigned int test_index, KinematicsTest::TestCounters &counters)
+{
+  std::vector<double> fk_values;
+  std::vector< std::vector<double> > solutions;
+  kinematics::KinematicsQueryOptions options;
+  kinematics::KinematicsResult result;
+  std::vector<std::string> fk_names;
+  fk_names.push_back(kinematics_test.kinematics_solver_->getTipFrame());
 
-    solution.clear();
-    kinematics_test.kinematics_solver_->searchPositionIK(poses[0], fk_values, timeout, solution,
-                                                                 boost::bind(&KinematicsTest::searchIKCallback,&kinematics_test,
-                                                                             _1,_2,_3),error_code);
-    bool result = error_code.val == error_code.SUCCESS;
+  fk_values.resize(kinematics_test.kinematics_solver_->getJointNames().size(), 0.0);
+  kinematics_test.getTestState(kinematic_state, joint_model_group, test_index, fk_values);
+  std::vector<geometry_msgs::Pose> poses;
+  poses.resize(1);
 
-    ROS_DEBUG("Pose: %f %f %f",poses[0].position.x, poses[0].position.y, poses[0].position.z);
-    ROS_DEBUG("Orient: %f %f %f %f",poses[0].orientation.x, poses[0].orientation.y, poses[0].orientation.z, poses[0].orientation.w);
+  bool result_fk = kinematics_test.kinematics_solver_->getPositionFK(fk_names, fk_values, poses);
+  EXPECT_TRUE(result_fk);
+  if(!result_fk)
+    return;
 
-    if(result)
-    {
-      EXPECT_TRUE(kinematics_test.kinematics_solver_->getPositionIK(poses[0], solution, solution, error_code));
-      result = error_code.val == error_code.SUCCESS;
-    }
+  kinematics_test.kinematics_solver_->getPositionIK(poses,fk_values, solutions, result,options);
+  ROS_DEBUG("Pose: %f %f %f",poses[0].position.x, poses[0].position.y, poses[0].position.z);
+  ROS_DEBUG("Orient: %f %f %f %f",poses[0].orientation.x, poses[0].orientation.y, poses[0].orientation.z, poses[0].orientation.w);
+
+  if(result.kinematic_error == kinematics::KinematicErrors::OK)
+  {
+    EXPECT_GT(solutions.size(),0)<<"Found "<<solutions.size()<<" ik solutions.";
+    counters.success = solutions.empty() ? counters.success : counters.success + 1;
+    counters.num_ik_solutions+=solutions.size();
+  }
+  else
+  {
+    ROS_ERROR_STREAM("getPositionIK with multiple solutions failed on test "<<test_index+1<<" for group " <<kinematics_test.kinematics_solver_->getGroupName());
+    return;
+  }
+
+  std::vector<geometry_msgs::Pose> new_poses;
+  new_poses.resize(1);
+
+  for(unsigned int i = 0; i < solutions.size();i++)
+  {
+    std::vector<double>& solution = solutions[i];
+    EXPECT_TRUE(kinematics_test.kinematics_solver_->getPositionFK(fk_names, solution, new_poses));
+    expectSamePose(poses[0], new_poses[0]);
+  }
+}
+
+TEST(IKFastPlugin, getFK)
+{
+  KinematicsTest::TestCounters counters = kinematics_test.runTests("getFK", kinematics_test.num_fk_tests_, &testFK);
+
+  ROS_INFO_STREAM("Success Rate: "<<(double)counters.success/kinematics_test.num_fk_tests_);
+  EXPECT_GT(counters.success , 0.99 * kinematics_test.num_fk_tests_);
+}
+
+TEST(IKFastPlugin, getFKBuffers)
+{
+  if(kinematics_test.ikfast_extension_ == NULL)
+    return;
+
+  KinematicsTest::TestCounters counters = kinematics_test.runTests("getFKBuffers", kinematics_test.num_fk_tests_,
+                                                                   &testFKBuffers);
+
+  ROS_INFO_STREAM("Success Rate: "<<(double)counters.success/kinematics_test.num_fk_tests_);
+  EXPECT_GT(counters.success , 0.99 * kinematics_test.num_fk_tests_);
+}
+
+TEST(IKFastPlugin, getChainFK)
+{
+  if(kinematics_test.ikfast_extension_ == NULL)
+    return;
+
+  KinematicsTest::TestCounters counters = kinematics_test.runTests("getChainFK", kinematics_test.num_fk_tests_,
+                                                                   &testChainFK);
+
+  ROS_INFO_STREAM("Success Rate: "<<(double)counters.success/kinematics_test.num_fk_tests_);
+  EXPECT_GT(counters.success , 0.99 * kinematics_test.num_fk_tests_);
+}
+
+TEST(IKFastPlugin, getJacobian)
+{
+  if(kinematics_test.ikfast_extension_ == NULL)
+    return;
+
+  KinematicsTest::TestCounters counters = kinematics_test.runTests("getJacobian", kinematics_test.num_fk_tests_,
+                                                                   &testJacobian);
+
+  ROS_INFO_STREAM("Success Rate: "<<(double)counters.success/kinematics_test.num_fk_tests_);
+  EXPECT_GT(counters.success , 0.99 * kinematics_test.num_fk_tests_);
+}
+
+TEST(IKFastPlugin, searchIK)
+{
+  KinematicsTest::TestCounters counters = kinematics_test.runTests("searchIK", kinematics_test.num_ik_tests_, &testSearchIK);
+
+  ROS_INFO_STREAM("Success Rate: "<<(double)counters.success/kinematics_test.num_ik_tests_);
+  EXPECT_GT(counters.success , 0.99 * kinematics_test.num_ik_tests_);
+}
+
+TEST(IKFastPlugin, searchIKWithCallback)
+{
+  kinematics_test.setCallbackMemoScene(HEIGHT_CALLBACK_SCENE);
+  KinematicsTest::TestCounters counters = kinematics_test.runTests("searchIKWithCallback", kinematics_test.num_ik_cb_tests_,
+                                                                   &testSearchIKWithCallback);
+
+  ROS_INFO_STREAM("Success Rate: "<<(double)counters.success/kinematics_test.num_ik_cb_tests_);
+  EXPECT_GT(counters.success , 0.99 * kinematics_test.num_ik_cb_tests_);
+}
+
+void acceptingCallback(const geometry_msgs::Pose &/*ik_pose*/, const std::vector<double> &/*joint_state*/,
+                       moveit_msgs::MoveItErrorCodes &error_code)
+{
+  error_code.val = error_code.SUCCESS;
+}
+
+void testSearchIKRanking(robot_state::RobotState &kinematic_state, const robot_model::JointModelGroup *joint_model_group,
+                         unsigned int test_index, KinematicsTest::TestCounters &counters)
+{
+  const kinematics::KinematicsBase &solver = *kinematics_test.kinematics_solver_;
+  std::vector<std::string> fk_names(1, solver.getTipFrame());
+  double timeout = 5.0;
+
+  std::vector<double> fk_values, seed(solver.getJointNames().size(), 0.0);
+  kinematics_test.getTestState(kinematic_state, joint_model_group, test_index, fk_values);
+  std::vector<geometry_msgs::Pose> poses(1);
+  ASSERT_TRUE(solver.getPositionFK(fk_names, fk_values, poses));
+
+  // the cost of IKFAST_SEARCH_MODE picks the solution whether or not a callback is passed
+  std::vector<double> solution, callback_solution;
+  moveit_msgs::MoveItErrorCodes error_code, callback_error_code;
+  bool solved = solver.searchPositionIK(poses[0], seed, timeout, solution, error_code);
+  bool callback_solved = solver.searchPositionIK(poses[0], seed, timeout, callback_solution,
+                                                 kinematics::KinematicsBase::IKCallbackFn(&acceptingCallback),
+                                                 callback_error_code);
+  EXPECT_EQ(solved, callback_solved);
+  EXPECT_EQ(error_code.val, callback_error_code.val);
+  if(solved && callback_solved)
+  {
+    ASSERT_EQ(solution.size(), callback_solution.size());
+    for(std::size_t j = 0; j < solution.size(); ++j)
+      EXPECT_NEAR(solution[j], callback_solution[j], IK_NEAR);
+  }
+  counters.success++;
+}
 
-    if(result)
+TEST(IKFastPlugin, searchIKRanking)
+{
+  if(kinematics_test.ikfast_extension_ == NULL)
+    return;
+
+  kinematics_test.setCallbackMemoScene(ACCEPTING_CALLBACK_SCENE);
+  KinematicsTest::TestCounters counters = kinematics_test.runTests("searchIKRanking", kinematics_test.num_ik_cb_tests_,
+                                                                   &testSearchIKRanking);
+
+  ROS_INFO_STREAM("Success Rate: "<<(double)counters.success/kinematics_test.num_ik_cb_tests_);
+  EXPECT_GT(counters.success , 0.99 * kinematics_test.num_ik_cb_tests_);
+}
+
+TEST(IKFastPlugin, getIK)
+{
+  KinematicsTest::TestCounters counters = kinematics_test.runTests("getIK", kinematics_test.num_ik_tests_, &testIK);
+
+  ROS_INFO_STREAM("Success Rate: "<<(double)counters.success/kinematics_test.num_ik_tests_);
+  EXPECT_GT(counters.success , 0.99 * kinematics_test.num_ik_tests_);
+}
+
+TEST(IKFastPlugin, getIKMultipleSolutions)
+{
+  KinematicsTest::TestCounters counters = kinematics_test.runTests("getIKMultipleSolutions", kinematics_test.num_ik_multiple_tests_,
+                                                                   &testIKMultipleSolutions);
+
+  ROS_INFO_STREAM("Success Rate: "<<(double)counters.success/kinematics_test.num_ik_multiple_tests_);
+  EXPECT_GT(counters.success , 0.99 * kinematics_test.num_ik_multiple_tests_)<<"A total of "<<counters.num_ik_solutions <<" ik solutions were found out of "
+      <<kinematics_test.num_ik_multiple_tests_<<" tests.";
+}
+
+void testIKConfigurations(robot_state::RobotState &kinematic_state, const robot_model::JointModelGroup *joint_model_group,
+                          unsigned int test_index, KinematicsTest::TestCounters &counters)
+{
+  const ikfast_kinematics_plugin::IKFastKinematicsExtension &solver = *kinematics_test.ikfast_extension_;
+  std::vector<std::string> fk_names(1, solver.getTipFrame());
+  std::size_t num_joints = solver.getJointNames().size();
+  kinematics::KinematicsQueryOptions options;
+  kinematics::KinematicsResult result;
+
+  std::vector<double> fk_values;
+  kinematics_test.getTestState(kinematic_state, joint_model_group, test_index, fk_values);
+  std::vector<geometry_msgs::Pose> poses(1), new_poses(1);
+  ASSERT_TRUE(solver.getPositionFK(fk_names, fk_values, poses));
+
+  std::vector< std::vector<double> > solutions;
+  std::vector<ikfast_kinematics_plugin::ConfigurationId> configurations;
+  if(!solver.getPositionIK(poses, fk_values, std::vector<int>(), solutions, configurations, result, options))
+  {
+    ROS_ERROR_STREAM("getPositionIK with configurations failed on test " << test_index + 1);
+    return;
+  }
+  ASSERT_EQ(solutions.size(), configurations.size());
+
+  // each configuration on its own gives the solutions of that configuration and no others
+  std::map<ikfast_kinematics_plugin::ConfigurationId, std::size_t> num_solutions;
+  for(std::size_t i = 0; i < configurations.size(); ++i)
+    num_solutions[configurations[i]]++;
+
+  std::vector<int> configuration;
+  std::map<ikfast_kinematics_plugin::ConfigurationId, std::size_t>::const_iterator it;
+  for(it = num_solutions.begin(); it != num_solutions.end(); ++it)
+  {
+    ikfast_kinematics_plugin::getConfiguration(it->first, num_joints, configuration);
+    solutions.clear();
+    configurations.clear();
+    EXPECT_TRUE(solver.getPositionIK(poses, fk_values, configuration, solutions, configurations, result, options));
+    EXPECT_EQ(it->second, solutions.size());
+    ASSERT_EQ(solutions.size(), configurations.size());
+    for(std::size_t i = 0; i < solutions.size(); ++i)
     {
-      success++;
+      EXPECT_EQ(it->first, configurations[i]);
+      EXPECT_TRUE(solver.getPositionFK(fk_names, solutions[i], new_poses));
+      expectSamePose(poses[0], new_poses[0]);
     }
-    else
+  }
+
+  // a root beyond the BRANCH_BITS of a ConfigurationId is rejected
+  configuration.assign(num_joints, -1);
+  configuration[0] = 1 << ikfast_kinematics_plugin::BRANCH_BITS;
+  EXPECT_FALSE(solver.getPositionIK(poses, fk_values, configuration, solutions, configurations, result, options));
+  counters.success++;
+}
+
+TEST(IKFastPlugin, getIKConfigurations)
+{
+  if(kinematics_test.ikfast_extension_ == NULL)
+    return;
+
+  KinematicsTest::TestCounters counters = kinematics_test.runTests("getIKConfigurations", kinematics_test.num_ik_multiple_tests_,
+                                                                   &testIKConfigurations);
+
+  ROS_INFO_STREAM("Success Rate: "<<(double)counters.success/kinematics_test.num_ik_multiple_tests_);
+  EXPECT_GT(counters.success , 0.99 * kinematics_test.num_ik_multiple_tests_);
+}
+
+void testIKStream(robot_state::RobotState &kinematic_state, const robot_model::JointModelGroup *joint_model_group,
+                  unsigned int test_index, KinematicsTest::TestCounters &counters)
+{
+  const ikfast_kinematics_plugin::IKFastKinematicsExtension &solver = *kinematics_test.ikfast_extension_;
+  std::vector<std::string> fk_names(1, solver.getTipFrame());
+  std::size_t num_joints = solver.getJointNames().size();
+  kinematics::KinematicsResult result;
+
+  // every discretized value of the free joints, many blocks of samples for the redundant plugin
+  kinematics::KinematicsQueryOptions options;
+  options.discretization_method = kinematics::DiscretizationMethods::ALL_DISCRETIZED;
+
+  std::vector<double> fk_values;
+  kinematics_test.getTestState(kinematic_state, joint_model_group, test_index, fk_values);
+  std::vector<geometry_msgs::Pose> poses(1);
+  ASSERT_TRUE(solver.getPositionFK(fk_names, fk_values, poses));
+
+  std::vector<double> buffer(MAX_STREAM_SOLUTIONS * num_joints);
+  std::vector<ikfast_kinematics_plugin::ConfigurationId> stream_configurations(MAX_STREAM_SOLUTIONS);
+  ikfast_kinematics_plugin::BufferSolutionsVisitor visitor(&buffer[0], MAX_STREAM_SOLUTIONS, num_joints,
+                                                           &stream_configurations[0]);
+  if(!solver.getPositionIK(poses, fk_values, std::vector<int>(), visitor, 0, result, options))
+  {
+    ROS_ERROR_STREAM("getPositionIK with a stream visitor failed on test " << test_index + 1);
+    return;
+  }
+  ASSERT_LT(visitor.size(), MAX_STREAM_SOLUTIONS);
+
+  // the query of a single configuration only computes the branches of that configuration, so each streamed
+  // solution has to be one of the solutions of the configuration it was streamed with
+  std::map<ikfast_kinematics_plugin::ConfigurationId, std::vector<std::size_t> > streamed;
+  for(std::size_t i = 0; i < visitor.size(); ++i)
+    streamed[stream_configurations[i]].push_back(i);
+
+  std::vector<int> configuration;
+  std::vector< std::vector<double> > solutions;
+  std::vector<ikfast_kinematics_plugin::ConfigurationId> configurations;
+  std::map<ikfast_kinematics_plugin::ConfigurationId, std::vector<std::size_t> >::const_iterator it;
+  for(it = streamed.begin(); it != streamed.end(); ++it)
+  {
+    ikfast_kinematics_plugin::getConfiguration(it->first, num_joints, configuration);
+    solutions.clear();
+    configurations.clear();
+    EXPECT_TRUE(solver.getPositionIK(poses, fk_values, configuration, solutions, configurations, result, options));
+    EXPECT_EQ(solutions.size(), it->second.size());
+
+    for(std::size_t i = 0; i < it->second.size(); ++i)
     {
-      ROS_ERROR_STREAM("searchPositionIK failed on test "<<i+1);
-      continue;
+      const double *solution = &buffer[it->second[i] * num_joints];
+      bool found = false;
+      for(std::size_t k = 0; k < solutions.size() && !found; ++k)
+      {
+        double distance = 0.0;
+        for(std::size_t j = 0; j < num_joints; ++j)
+          distance = std::max(distance, fabs(solutions[k][j] - solution[j]));
+        found = distance < IK_NEAR;
+      }
+      EXPECT_TRUE(found) << "Streamed solution " << it->second[i] << " isn't a solution of its configuration " <<
+          it->first;
     }
-
-    std::vector<geometry_msgs::Pose> new_poses;
-    new_poses.resize(1);
-    result_fk = kinematics_test.kinematics_solver_->getPositionFK(fk_names, solution, new_poses);
-    EXPECT_NEAR(poses[0].position.x, new_poses[0].position.x, IK_NEAR);
-    EXPECT_NEAR(poses[0].position.y, new_poses[0].position.y, IK_NEAR);
-    EXPECT_NEAR(poses[0].position.z, new_poses[0].position.z, IK_NEAR);
-    EXPECT_NEAR(poses[0].orientation.x, new_poses[0].orientation.x, IK_NEAR);
-    EXPECT_NEAR(poses[0].orientation.y, new_poses[0].orientation.y, IK_NEAR);
-    EXPECT_NEAR(poses[0].orientation.z, new_poses[0].orientation.z, IK_NEAR);
-    EXPECT_NEAR(poses[0].orientation.w, new_poses[0].orientation.w, IK_NEAR);
   }
 
+  // max_solutions stops the query early
+  ikfast_kinematics_plugin::BufferSolutionsVisitor limited_visitor(&buffer[0], MAX_STREAM_SOLUTIONS, num_joints);
+  EXPECT_TRUE(solver.getPositionIK(poses, fk_values, std::vector<int>(), limited_visitor, 1, result, options));
+  EXPECT_EQ(1u, limited_visitor.size());
+  counters.success++;
+}
+
+TEST(IKFastPlugin, getIKStream)
+{
+  if(kinematics_test.ikfast_extension_ == NULL)
+    return;
+
+  KinematicsTest::TestCounters counters = kinematics_test.runTests("getIKStream", kinematics_test.num_ik_multiple_tests_,
+                                                                   &testIKStream);
 
-  ROS_INFO_STREAM("Success Rate: "<<(double)success/kinematics_test.num_ik_cb_tests_);
-  EXPECT_GT(success , 0.99 * kinematics_test.num_ik_cb_tests_);
-  ROS_INFO_STREAM("Elapsed time: "<< (ros::WallTime::now()-start_time).toSec());
+  ROS_INFO_STREAM("Success Rate: "<<(double)counters.success/kinematics_test.num_ik_multiple_tests_);
+  EXPECT_GT(counters.success , 0.99 * kinematics_test.num_ik_multiple_tests_);
 }
 
+/// \brief Verdict of the callbacks of the extension tests, only depends on the joint values and rejects about half
+bool acceptJointValues(const double *joint_values, std::size_t dof)
+{
+  double sum = 0.0;
+  for(std::size_t j = 0; j < dof; ++j)
+    sum += (j + 1) * joint_values[j];
+  return sin(3.0 * sum) < 0.2;
+}
 
-TEST(IKFastPlugin, getIK)
+void jointValuesCallback(const geometry_msgs::Pose &/*ik_pose*/, const std::vector<double> &joint_state,
+                         moveit_msgs::MoveItErrorCodes &error_code)
 {
-  rdf_loader::RDFLoader rdf_loader_(ROBOT_DESCRIPTION_PARAM);
-  robot_model::RobotModelPtr kinematic_model;
-  const boost::shared_ptr<srdf::Model> &srdf_model = rdf_loader_.getSRDF();
-  const boost::shared_ptr<urdf::ModelInterface>& urdf_model = rdf_loader_.getURDF();
-  kinematic_model.reset(new robot_model::RobotModel(urdf_model, srdf_model));
-  robot_model::JointModelGroup* joint_model_group = kinematic_model->getJointModelGroup(kinematics_test.kinematics_solver_->getGroupName());
+  error_code.val = acceptJointValues(&joint_state[0], joint_state.size()) ? error_code.SUCCESS : error_code.NO_IK_SOLUTION;
+}
 
-  //Test inverse kinematics
-  std::vector<double> seed, fk_values, solution;
+void jointValuesBatchCallback(const geometry_msgs::Pose &/*ik_pose*/, const double *candidates, std::size_t count,
+                              std::size_t dof, uint8_t *valid)
+{
+  for(std::size_t i = 0; i < count; ++i)
+    valid[i] = acceptJointValues(candidates + i * dof, dof);
+}
+
+void testSearchIKBatchCallback(robot_state::RobotState &kinematic_state, const robot_model::JointModelGroup *joint_model_group,
+                               unsigned int test_index, KinematicsTest::TestCounters &counters)
+{
+  const ikfast_kinematics_plugin::IKFastKinematicsExtension &solver = *kinematics_test.ikfast_extension_;
+  std::vector<std::string> fk_names(1, solver.getTipFrame());
   double timeout = 5.0;
+
+  std::vector<double> fk_values, seed(solver.getJointNames().size(), 0.0);
+  kinematics_test.getTestState(kinematic_state, joint_model_group, test_index, fk_values);
+  std::vector<geometry_msgs::Pose> poses(1);
+  ASSERT_TRUE(solver.getPositionFK(fk_names, fk_values, poses));
+
+  // checking the candidates one by one or all at once finds the same solution
+  std::vector<double> consistency_limits, solution, batch_solution;
+  moveit_msgs::MoveItErrorCodes error_code, batch_error_code;
+  solver.searchPositionIK(poses[0], seed, timeout, consistency_limits, solution,
+                          kinematics::KinematicsBase::IKCallbackFn(&jointValuesCallback), error_code);
+  solver.searchPositionIK(poses[0], seed, timeout, consistency_limits, batch_solution,
+                          ikfast_kinematics_plugin::BatchIKCallbackFn(&jointValuesBatchCallback), batch_error_code);
+  EXPECT_EQ(error_code.val, batch_error_code.val);
+  if(error_code.val == error_code.SUCCESS && batch_error_code.val == batch_error_code.SUCCESS)
+  {
+    ASSERT_EQ(solution.size(), batch_solution.size());
+    for(std::size_t j = 0; j < solution.size(); ++j)
+      EXPECT_NEAR(solution[j], batch_solution[j], IK_NEAR);
+    EXPECT_TRUE(acceptJointValues(&batch_solution[0], batch_solution.size()));
+  }
+  counters.success++;
+}
+
+TEST(IKFastPlugin, searchIKBatchCallback)
+{
+  if(kinematics_test.ikfast_extension_ == NULL)
+    return;
+
+  kinematics_test.setCallbackMemoScene(JOINT_VALUES_CALLBACK_SCENE);
+  KinematicsTest::TestCounters counters = kinematics_test.runTests("searchIKBatchCallback", kinematics_test.num_ik_cb_tests_,
+                                                                   &testSearchIKBatchCallback);
+
+  ROS_INFO_STREAM("Success Rate: "<<(double)counters.success/kinematics_test.num_ik_cb_tests_);
+  EXPECT_GT(counters.success , 0.99 * kinematics_test.num_ik_cb_tests_);
+}
+
+void rejectingCallback(const geometry_msgs::Pose &/*ik_pose*/, const std::vector<double> &/*joint_state*/,
+                       moveit_msgs::MoveItErrorCodes &error_code)
+{
+  error_code.val = error_code.NO_IK_SOLUTION;
+}
+
+void testDefinitiveFailures(robot_state::RobotState &kinematic_state, const robot_model::JointModelGroup *joint_model_group,
+                            unsigned int test_index, KinematicsTest::TestCounters &counters)
+{
+  const ikfast_kinematics_plugin::IKFastKinematicsExtension &solver = *kinematics_test.ikfast_extension_;
+  std::vector<std::string> fk_names(1, solver.getTipFrame());
+  double timeout = 5.0;
+
+  std::vector<double> fk_values, seed(solver.getJointNames().size(), 0.0);
+  kinematics_test.getTestState(kinematic_state, joint_model_group, test_index, fk_values);
+  std::vector<geometry_msgs::Pose> poses(1);
+  ASSERT_TRUE(solver.getPositionFK(fk_names, fk_values, poses));
+
+  // without free joints every solution of the reachable pose was tried and rejected, other seeds would try the same
+  // ones, the free joint values sampled by the sweep depend on the seed
+  std::vector<unsigned int> redundant_joints;
+  solver.getRedundantJoints(redundant_joints);
+  const kinematics::KinematicsBase::IKCallbackFn callback(&rejectingCallback);
+  std::vector<double> consistency_limits, solution;
   moveit_msgs::MoveItErrorCodes error_code;
-  solution.resize(kinematics_test.kinematics_solver_->getJointNames().size(), 0.0);
-  std::vector<std::string> fk_names;
-  fk_names.push_back(kinematics_test.kinematics_solver_->getTipFrame());
-  robot_state::RobotState kinematic_state(kinematic_model);
+  bool definitive = false;
+  EXPECT_FALSE(solver.searchPositionIK(poses[0], seed, timeout, consistency_limits, solution, callback, error_code,
+                                       definitive));
+  EXPECT_EQ(redundant_joints.empty(), definitive);
+  EXPECT_FALSE(solver.searchPositionIKWithRestarts(poses[0], seed, timeout, consistency_limits, solution, callback,
+                                                   error_code, 10));
+  EXPECT_EQ(error_code.NO_IK_SOLUTION, error_code.val);
+  counters.success++;
+}
 
-  unsigned int success = 0;
-  ros::WallTime start_time = ros::WallTime::now();
-  for(unsigned int i=0; i < kinematics_test.num_ik_tests_; ++i)
+TEST(IKFastPlugin, definitiveFailures)
+{
+  if(kinematics_test.ikfast_extension_ == NULL)
+    return;
+
+  kinematics_test.setCallbackMemoScene(REJECTING_CALLBACK_SCENE);
+  KinematicsTest::TestCounters counters = kinematics_test.runTests("definitiveFailures", kinematics_test.num_ik_cb_tests_,
+                                                                   &testDefinitiveFailures);
+
+  ROS_INFO_STREAM("Success Rate: "<<(double)counters.success/kinematics_test.num_ik_cb_tests_);
+  EXPECT_GT(counters.success , 0.99 * kinematics_test.num_ik_cb_tests_);
+}
+
+void testSearchIKWithRestarts(robot_state::RobotState &kinematic_state, const robot_model::JointModelGroup *joint_model_group,
+                              unsigned int test_index, KinematicsTest::TestCounters &counters)
+{
+  const ikfast_kinematics_plugin::IKFastKinematicsExtension &solver = *kinematics_test.ikfast_extension_;
+  std::vector<std::string> fk_names(1, solver.getTipFrame());
+  double timeout = 5.0;
+
+  std::vector<double> fk_values, seed(solver.getJointNames().size(), 0.0);
+  kinematics_test.getTestState(kinematic_state, joint_model_group, test_index, fk_values);
+  std::vector<geometry_msgs::Pose> poses(1);
+  ASSERT_TRUE(solver.getPositionFK(fk_names, fk_values, poses));
+
+  // the first attempt starts from the seed, so the restarts solve the queries a single attempt solves, and the
+  // failures of a single attempt are definitive without free joints, with free joints other seeds may succeed
+  std::vector<unsigned int> redundant_joints;
+  solver.getRedundantJoints(redundant_joints);
+  const kinematics::KinematicsBase::IKCallbackFn callback(&jointValuesCallback);
+  std::vector<double> consistency_limits, solution, restarts_solution;
+  moveit_msgs::MoveItErrorCodes error_code, restarts_error_code;
+  bool definitive = false;
+  bool solved = solver.searchPositionIK(poses[0], seed, timeout, consistency_limits, solution, callback, error_code,
+                                        definitive);
+  bool restarts_solved = solver.searchPositionIKWithRestarts(poses[0], seed, timeout, consistency_limits,
+                                                             restarts_solution, callback, restarts_error_code, 10);
+  if(solved)
   {
-    seed.resize(kinematics_test.kinematics_solver_->getJointNames().size(), 0.0);
-    fk_values.resize(kinematics_test.kinematics_solver_->getJointNames().size(), 0.0);
-    kinematic_state.setToRandomPositions(joint_model_group);
-    kinematic_state.copyJointGroupPositions(joint_model_group, fk_values);
-    std::vector<geometry_msgs::Pose> poses;
-    poses.resize(1);
+    EXPECT_TRUE(restarts_solved);
+    EXPECT_EQ(error_code.val, restarts_error_code.val);
+  }
+  else
+  {
+    EXPECT_EQ(redundant_joints.empty(), definitive);
+  }
+  if(restarts_solved)
+  {
+    ASSERT_EQ(seed.size(), restarts_solution.size());
+    EXPECT_TRUE(acceptJointValues(&restarts_solution[0], restarts_solution.size()));
+  }
+  counters.success++;
+}
 
-    bool result_fk = kinematics_test.kinematics_solver_->getPositionFK(fk_names, fk_values, poses);
-    ASSERT_TRUE(result_fk);
-    solution.clear();
+TEST(IKFastPlugin, searchIKWithRestarts)
+{
+  if(kinematics_test.ikfast_extension_ == NULL)
+    return;
 
-    kinematics_test.kinematics_solver_->getPositionIK(poses[0], fk_values, solution, error_code);
-    ROS_DEBUG("Pose: %f %f %f",poses[0].position.x, poses[0].position.y, poses[0].position.z);
-    ROS_DEBUG("Orient: %f %f %f %f",poses[0].orientation.x, poses[0].orientation.y, poses[0].orientation.z, poses[0].orientation.w);
+  kinematics_test.setCallbackMemoScene(JOINT_VALUES_CALLBACK_SCENE);
+  KinematicsTest::TestCounters counters = kinematics_test.runTests("searchIKWithRestarts", kinematics_test.num_ik_cb_tests_,
+                                                                   &testSearchIKWithRestarts);
 
+  ROS_INFO_STREAM("Success Rate: "<<(double)counters.success/kinematics_test.num_ik_cb_tests_);
+  EXPECT_GT(counters.success , 0.99 * kinematics_test.num_ik_cb_tests_);
+}
+
+/// \brief jointValuesCallback counting its calls, pass it with boost::ref
+struct CountingCallback
+{
+  CountingCallback(): calls(0) {}
+
+  void operator()(const geometry_msgs::Pose &ik_pose, const std::vector<double> &joint_state,
+                  moveit_msgs::MoveItErrorCodes &error_code)
+  {
+    calls++;
+    jointValuesCallback(ik_pose, joint_state, error_code);
+  }
+
+  unsigned int calls;
+};
+
+TEST(IKFastPlugin, callbackMemo)
+{
+  if(kinematics_test.ikfast_extension_ == NULL)
+    return;
+
+  // runs serially on this thread, the memo counters are shared by all threads
+  ikfast_kinematics_plugin::IKFastKinematicsExtension &solver = *kinematics_test.ikfast_extension_;
+  robot_state::RobotState kinematic_state(kinematics_test.kinematic_model_);
+  const robot_model::JointModelGroup* joint_model_group = kinematics_test.kinematic_model_->getJointModelGroup(solver.getGroupName());
+  std::vector<std::string> fk_names(1, solver.getTipFrame());
+  std::vector<double> fk_values, seed(solver.getJointNames().size(), 0.0), consistency_limits;
+  std::vector<geometry_msgs::Pose> poses(kinematics_test.num_ik_cb_tests_), single_pose(1);
+  for(int i = 0; i < kinematics_test.num_ik_cb_tests_; ++i)
+  {
+    kinematics_test.getTestState(kinematic_state, joint_model_group, i, fk_values);
+    ASSERT_TRUE(solver.getPositionFK(fk_names, fk_values, single_pose));
+    poses[i] = single_pose[0];
+  }
+
+  solver.clearCallbackMemo();
+  solver.setCallbackMemoSceneVersion(MEMO_TEST_SCENE);
+
+  // every call of the callback follows a miss of the memo
+  CountingCallback first_callback;
+  std::vector< std::vector<double> > first_solutions(poses.size());
+  std::vector<moveit_msgs::MoveItErrorCodes> first_error_codes(poses.size());
+  for(std::size_t i = 0; i < poses.size(); ++i)
+    solver.searchPositionIK(poses[i], seed, 5.0, consistency_limits, first_solutions[i],
+                            kinematics::KinematicsBase::IKCallbackFn(boost::ref(first_callback)), first_error_codes[i]);
+  ikfast_kinematics_plugin::CallbackMemoStats first_stats = solver.getCallbackMemoStats();
+  ASSERT_GT(first_callback.calls, 0u) << "The callback memo needs the callback_memo_size parameter";
+  EXPECT_EQ(first_callback.calls, first_stats.misses);
+
+  // the same queries in the same scene look up the same configurations, the verdicts evicted since are the only
+  // misses, none with a memo large enough to keep every verdict
+  CountingCallback second_callback;
+  std::vector<double> solution;
+  moveit_msgs::MoveItErrorCodes error_code;
+  for(std::size_t i = 0; i < poses.size(); ++i)
+  {
+    solver.searchPositionIK(poses[i], seed, 5.0, consistency_limits, solution,
+                            kinematics::KinematicsBase::IKCallbackFn(boost::ref(second_callback)), error_code);
+    EXPECT_EQ(first_error_codes[i].val, error_code.val);
     if(error_code.val == error_code.SUCCESS)
     {
-      success++;
-    }
-    else
-    {
-      ROS_ERROR_STREAM("getPositionIK failed on test "<<i+1<<" for group " <<kinematics_test.kinematics_solver_->getGroupName());
-      continue;
+      EXPECT_TRUE(solution == first_solutions[i]);
     }
+  }
+  ikfast_kinematics_plugin::CallbackMemoStats second_stats = solver.getCallbackMemoStats();
+  EXPECT_EQ(second_callback.calls, second_stats.misses - first_stats.misses);
+  EXPECT_EQ(2 * (first_stats.hits + first_stats.misses), second_stats.hits + second_stats.misses);
+  EXPECT_LE(second_callback.calls, second_stats.evictions);
+  EXPECT_LT(second_callback.calls, first_callback.calls);
+  ROS_INFO_STREAM("callbackMemo hit rate: " << second_stats.hitRate());
+
+  // a new scene version ignores the verdicts of the old one
+  CountingCallback third_callback;
+  solver.setCallbackMemoSceneVersion(MEMO_TEST_SCENE + 1);
+  for(std::size_t i = 0; i < poses.size(); ++i)
+  {
+    solver.searchPositionIK(poses[i], seed, 5.0, consistency_limits, solution,
+                            kinematics::KinematicsBase::IKCallbackFn(boost::ref(third_callback)), error_code);
+    EXPECT_EQ(first_error_codes[i].val, error_code.val);
+  }
+  EXPECT_EQ(first_callback.calls, third_callback.calls);
 
-    std::vector<geometry_msgs::Pose> new_poses;
-    new_poses.resize(1);
-    result_fk = kinematics_test.kinematics_solver_->getPositionFK(fk_names, solution, new_poses);
-    EXPECT_NEAR(poses[0].position.x, new_poses[0].position.x, IK_NEAR);
-    EXPECT_NEAR(poses[0].position.y, new_poses[0].position.y, IK_NEAR);
-    EXPECT_NEAR(poses[0].position.z, new_poses[0].position.z, IK_NEAR);
-    EXPECT_NEAR(poses[0].orientation.x, new_poses[0].orientation.x, IK_NEAR);
-    EXPECT_NEAR(poses[0].orientation.y, new_poses[0].orientation.y, IK_NEAR);
-    EXPECT_NEAR(poses[0].orientation.z, new_poses[0].orientation.z, IK_NEAR);
-    EXPECT_NEAR(poses[0].orientation.w, new_poses[0].orientation.w, IK_NEAR);
+  solver.clearCallbackMemo();
+  ikfast_kinematics_plugin::CallbackMemoStats cleared_stats = solver.getCallbackMemoStats();
+  EXPECT_EQ(0u, cleared_stats.hits + cleared_stats.misses + cleared_stats.evictions);
+}
+
+void testCartesianPath(robot_state::RobotState &kinematic_state, const robot_model::JointModelGroup *joint_model_group,
+                       unsigned int test_index, KinematicsTest::TestCounters &counters)
+{
+  const kinematics::KinematicsBase &solver = *kinematics_test.kinematics_solver_;
+  std::vector<std::string> fk_names(1, solver.getTipFrame());
+
+  // the waypoints are the FK of a joint interpolation between two test states, so a path exists
+  std::vector<double> start, goal, joint_values;
+  kinematics_test.getTestState(kinematic_state, joint_model_group, 2 * test_index, start);
+  kinematics_test.getTestState(kinematic_state, joint_model_group, 2 * test_index + 1, goal);
+  std::vector<geometry_msgs::Pose> waypoints(NUM_PATH_WAYPOINTS), poses(1);
+  for(int i = 0; i < NUM_PATH_WAYPOINTS; ++i)
+  {
+    double t = (double)i / (NUM_PATH_WAYPOINTS - 1);
+    joint_values.resize(start.size());
+    for(std::size_t j = 0; j < start.size(); ++j)
+      joint_values[j] = start[j] + t * (goal[j] - start[j]);
+    ASSERT_TRUE(solver.getPositionFK(fk_names, joint_values, poses));
+    waypoints[i] = poses[0];
   }
 
+  kinematics_base_test::CartesianPathPlanner planner(solver);
+  planner.loadVelocityLimits(ROBOT_DESCRIPTION_PARAM);
+  kinematics::KinematicsQueryOptions options;
+  if(kinematics_test.path_discretize_free_joints_)
+    options.discretization_method = kinematics::DiscretizationMethods::ALL_DISCRETIZED;
+  planner.setQueryOptions(options);
 
-  ROS_INFO_STREAM("Success Rate: "<<(double)success/kinematics_test.num_ik_tests_);
-  EXPECT_GT(success , 0.99 * kinematics_test.num_ik_tests_);
-  ROS_INFO_STREAM("Elapsed time: "<< (ros::WallTime::now()-start_time).toSec());
+  std::vector< std::vector<double> > trajectory;
+  if(!planner.plan(waypoints, PATH_TIME_STEP, trajectory))
+  {
+    ROS_ERROR_STREAM("Cartesian path planning failed on test " << test_index + 1);
+    return;
+  }
+
+  ASSERT_EQ(waypoints.size(), trajectory.size());
+  const std::vector<double> &max_velocities = planner.getVelocityLimits();
+  for(std::size_t i = 0; i < trajectory.size(); ++i)
+  {
+    EXPECT_TRUE(solver.getPositionFK(fk_names, trajectory[i], poses));
+    expectSamePose(waypoints[i], poses[0]);
+    for(std::size_t j = 0; i > 0 && j < max_velocities.size(); ++j)
+      EXPECT_LE(fabs(trajectory[i][j] - trajectory[i - 1][j]), max_velocities[j] * PATH_TIME_STEP + 1e-9);
+  }
+  counters.success++;
 }
 
-TEST(IKFastPlugin, getIKMultipleSolutions)
+TEST(IKFastPlugin, planCartesianPath)
+{
+  KinematicsTest::TestCounters counters = kinematics_test.runTests("planCartesianPath", kinematics_test.num_path_tests_,
+                                                                   &testCartesianPath);
+
+  ROS_INFO_STREAM("Success Rate: "<<(double)counters.success/std::max(kinematics_test.num_path_tests_, 1));
+  EXPECT_GE(counters.success , 0.99 * kinematics_test.num_path_tests_);
+}
+
+/// \brief Heap allocations made by the calls of one entry point in the allocations test
+struct EntryPointAllocations
 {
-  rdf_loader::RDFLoader rdf_loader_(ROBOT_DESCRIPTION_PARAM);
-  robot_model::RobotModelPtr kinematic_model;
-  const boost::shared_ptr<srdf::Model> &srdf_model = rdf_loader_.getSRDF();
-  const boost::shared_ptr<urdf::ModelInterface>& urdf_model = rdf_loader_.getURDF();
-  kinematic_model.reset(new robot_model::RobotModel(urdf_model, srdf_model));
-  robot_model::JointModelGroup* joint_model_group = kinematic_model->getJointModelGroup(kinematics_test.kinematics_solver_->getGroupName());
+  EntryPointAllocations(const std::string &name): name(name), calls(0) {}
+
+  void add(const kinematics_base_test::AllocationScope &scope)
+  {
+    kinematics_base_test::AllocationCount count = scope.elapsed();
+    total.allocations += count.allocations;
+    total.bytes += count.bytes;
+    calls++;
+  }
 
-  //Test inverse kinematics
-  std::vector<double> seed, fk_values;
+  std::string name;
+  unsigned int calls;
+  kinematics_base_test::AllocationCount total;
+};
+
+TEST(IKFastPlugin, allocations)
+{
+  // runs serially on this thread, the counters are per thread
+  const kinematics::KinematicsBase &solver = *kinematics_test.kinematics_solver_;
+  robot_state::RobotState kinematic_state(kinematics_test.kinematic_model_);
+  const robot_model::JointModelGroup* joint_model_group = kinematics_test.kinematic_model_->getJointModelGroup(solver.getGroupName());
+  std::vector<std::string> fk_names(1, solver.getTipFrame());
+  std::vector<double> fk_values, seed(solver.getJointNames().size(), 0.0), solution(seed.size(), 0.0);
   std::vector< std::vector<double> > solutions;
-  double timeout = 5.0;
+  std::vector<geometry_msgs::Pose> poses(1), new_poses(1);
+  moveit_msgs::MoveItErrorCodes error_code;
   kinematics::KinematicsQueryOptions options;
   kinematics::KinematicsResult result;
 
-  std::vector<std::string> fk_names;
-  fk_names.push_back(kinematics_test.kinematics_solver_->getTipFrame());
-  robot_state::RobotState kinematic_state(kinematic_model);
+  std::vector<EntryPointAllocations> entry_points;
+  entry_points.push_back(EntryPointAllocations("getPositionFK"));
+  entry_points.push_back(EntryPointAllocations("getPositionIK"));
+  entry_points.push_back(EntryPointAllocations("searchPositionIK"));
+  entry_points.push_back(EntryPointAllocations("getPositionIK(multiple)"));
+
+  // the buffer overloads of the extension interface
+  const ikfast_kinematics_plugin::IKFastKinematicsExtension *extension = kinematics_test.ikfast_extension_;
+  std::vector<double> transforms(12 * std::max<std::size_t>(solver.getLinkNames().size(), 1)), jacobian(6 * seed.size());
+  double manipulability = 0.0;
+  if(extension != NULL)
+  {
+    entry_points.push_back(EntryPointAllocations("getPositionFK(buffer)"));
+    entry_points.push_back(EntryPointAllocations("getChainFK"));
+    entry_points.push_back(EntryPointAllocations("getJacobian"));
+    entry_points.push_back(EntryPointAllocations("getManipulability"));
+  }
 
-  unsigned int success = 0;
-  unsigned int num_ik_solutions = 0;
-  ros::WallTime start_time = ros::WallTime::now();
-  for(unsigned int i=0; i < kinematics_test.num_ik_multiple_tests_; ++i)
+  for(int i = 0; i < kinematics_test.num_allocation_tests_; ++i)
   {
-    seed.resize(kinematics_test.kinematics_solver_->getJointNames().size(), 0.0);
-    fk_values.resize(kinematics_test.kinematics_solver_->getJointNames().size(), 0.0);
-    kinematic_state.setToRandomPositions(joint_model_group);
-    kinematic_state.copyJointGroupPositions(joint_model_group, fk_values);
-    std::vector<geometry_msgs::Pose> poses;
-    poses.resize(1);
+    kinematics_test.getTestState(kinematic_state, joint_model_group, i, fk_values);
+    ASSERT_TRUE(solver.getPositionFK(fk_names, fk_values, poses));
 
-    ASSERT_TRUE(kinematics_test.kinematics_solver_->getPositionFK(fk_names, fk_values, poses));
+    // only the entry point calls are counted, the outputs keep their capacity across calls
+    kinematics_base_test::AllocationScope scope;
+    solver.getPositionFK(fk_names, fk_values, new_poses);
+    entry_points[0].add(scope);
 
-    solutions.clear();
-    kinematics_test.kinematics_solver_->getPositionIK(poses,fk_values, solutions, result,options);
-    ROS_DEBUG("Pose: %f %f %f",poses[0].position.x, poses[0].position.y, poses[0].position.z);
-    ROS_DEBUG("Orient: %f %f %f %f",poses[0].orientation.x, poses[0].orientation.y, poses[0].orientation.z, poses[0].orientation.w);
+    scope.restart();
+    solver.getPositionIK(poses[0], seed, solution, error_code);
+    entry_points[1].add(scope);
 
-    if(result.kinematic_error == kinematics::KinematicErrors::OK)
-    {
-      EXPECT_GT(solutions.size(),0)<<"Found "<<solutions.size()<<" ik solutions.";
-      success = solutions.empty() ? success : success + 1;
-      num_ik_solutions+=solutions.size();
-    }
-    else
-    {
-      ROS_ERROR_STREAM("getPositionIK with multiple solutions failed on test "<<i+1<<" for group " <<kinematics_test.kinematics_solver_->getGroupName());
-      continue;
-    }
+    scope.restart();
+    solver.searchPositionIK(poses[0], seed, 5.0, solution, error_code);
+    entry_points[2].add(scope);
 
-    std::vector<geometry_msgs::Pose> new_poses;
-    new_poses.resize(1);
+    solutions.clear();
+    scope.restart();
+    solver.getPositionIK(poses, seed, solutions, result, options);
+    entry_points[3].add(scope);
 
-    for(unsigned int i = 0; i < solutions.size();i++)
+    if(extension != NULL)
     {
-      std::vector<double>& solution = solutions[i];
-      EXPECT_TRUE(kinematics_test.kinematics_solver_->getPositionFK(fk_names, solution, new_poses));
-      EXPECT_NEAR(poses[0].position.x, new_poses[0].position.x, IK_NEAR);
-      EXPECT_NEAR(poses[0].position.y, new_poses[0].position.y, IK_NEAR);
-      EXPECT_NEAR(poses[0].position.z, new_poses[0].position.z, IK_NEAR);
-      EXPECT_NEAR(poses[0].orientation.x, new_poses[0].orientation.x, IK_NEAR);
-      EXPECT_NEAR(poses[0].orientation.y, new_poses[0].orientation.y, IK_NEAR);
-      EXPECT_NEAR(poses[0].orientation.z, new_poses[0].orientation.z, IK_NEAR);
-      EXPECT_NEAR(poses[0].orientation.w, new_poses[0].orientation.w, IK_NEAR);
-    }
+      scope.restart();
+      extension->getPositionFK(&fk_values[0], &transforms[0]);
+      entry_points[4].add(scope);
 
+      scope.restart();
+      extension->getChainFK(&fk_values[0], &transforms[0]);
+      entry_points[5].add(scope);
 
+      scope.restart();
+      extension->getJacobian(&fk_values[0], &jacobian[0]);
+      entry_points[6].add(scope);
+
+      scope.restart();
+      extension->getManipulability(&fk_values[0], manipulability);
+      entry_points[7].add(scope);
+    }
   }
 
+  for(std::size_t e = 0; e < entry_points.size(); ++e)
+  {
+    const EntryPointAllocations &entry_point = entry_points[e];
+    ROS_INFO_STREAM(entry_point.name << " allocations per call: " << (double)entry_point.total.allocations / entry_point.calls <<
+                    ", bytes per call: " << (double)entry_point.total.bytes / entry_point.calls);
 
-  ROS_INFO_STREAM("Success Rate: "<<(double)success/kinematics_test.num_ik_multiple_tests_);
-  EXPECT_GT(success , 0.99 * kinematics_test.num_ik_multiple_tests_)<<"A total of "<<num_ik_solutions <<" ik solutions were found out of "
-      <<kinematics_test.num_ik_multiple_tests_<<" tests.";
-  ROS_INFO_STREAM("Elapsed time: "<< (ros::WallTime::now()-start_time).toSec());
+    const std::vector<std::string> &zero_allocation = kinematics_test.zero_allocation_entry_points_;
+    if(std::find(zero_allocation.begin(), zero_allocation.end(), entry_point.name) != zero_allocation.end())
+      EXPECT_EQ(0u, entry_point.total.allocations) << entry_point.name << " is declared zero allocation";
+  }
 }
 
-
-
-
 int main(int argc, char **argv)
 {
   testing::InitGoogleTest(&argc, argv);
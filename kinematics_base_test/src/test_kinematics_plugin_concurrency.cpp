@@ -0,0 +1,261 @@
+#include <ros/ros.h>
+#include <gtest/gtest.h>
+#include <pluginlib/class_loader.h>
+#include <boost/thread.hpp>
+
+// MoveIt!
+#include <moveit/kinematics_base/kinematics_base.h>
+#include <moveit/robot_model/robot_model.h>
+#include <moveit/robot_state/robot_state.h>
+#include <moveit/rdf_loader/rdf_loader.h>
+#include <urdf/model.h>
+#include <srdfdom/model.h>
+
+#define IK_NEAR 1e-4
+
+typedef pluginlib::ClassLoader<kinematics::KinematicsBase> KinematicsLoader;
+
+const std::string PLUGIN_NAME_PARAM = "ik_plugin_name";
+const std::string GROUP_PARAM  = "group";
+const std::string TIP_LINK_PARAM = "tip_link";
+const std::string ROOT_LINK_PARAM = "root_link";
+const std::string ROBOT_DESCRIPTION_PARAM = "robot_description";
+const std::string NUM_THREADS = "num_threads";
+const std::string NUM_CONCURRENT_TESTS = "num_concurrent_tests";
+const std::string MIN_SCALING_EFFICIENCY = "min_scaling_efficiency";
+const double DEFAULT_SEARCH_DISCRETIZATION = 0.01f;
+
+/**
+ * Hammers a single plugin instance from several threads. Every thread solves the same poses
+ * as a single threaded reference run, so any state shared between concurrent queries shows
+ * up as a result that differs from the reference or as a throughput that doesn't scale.
+ */
+class ConcurrencyTest
+{
+public:
+
+  struct Query
+  {
+    geometry_msgs::Pose pose;
+    std::vector<double> fk_values;
+    std::vector<double> search_solution; // reference solution of the single threaded run
+  };
+
+  struct Result
+  {
+    Result(): num_queries(0), num_failures(0), num_mismatches(0) {}
+
+    int num_queries;
+    int num_failures;   // searchPositionIK failures and solutions that don't reach the pose
+    int num_mismatches; // queries whose solution differs from the single threaded one
+  };
+
+  bool initialize()
+  {
+    ros::NodeHandle ph("~");
+    std::string plugin_name;
+
+    // loading plugin
+    kinematics_loader_.reset(new KinematicsLoader("moveit_core", "kinematics::KinematicsBase"));
+    if(!ph.getParam(PLUGIN_NAME_PARAM,plugin_name))
+    {
+      ROS_ERROR_STREAM("The plugin name parameter was not found");
+      return false;
+    }
+
+    try
+    {
+      ROS_INFO_STREAM("Loading "<<plugin_name);
+      kinematics_solver_ = kinematics_loader_->createInstance(plugin_name);
+    }
+    catch(pluginlib::PluginlibException& e)
+    {
+      ROS_ERROR_STREAM("Plugin failed to load: "<<e.what());
+      return false;
+    }
+
+    // initializing plugin
+    if(!(ph.getParam(GROUP_PARAM,group_name_) && ph.getParam(TIP_LINK_PARAM,tip_link_) &&
+         ph.getParam(ROOT_LINK_PARAM,root_link_)))
+    {
+      ROS_ERROR_STREAM("Kinematics Solver parameters failed to load");
+      return false;
+    }
+
+    if(!kinematics_solver_->initialize(ROBOT_DESCRIPTION_PARAM,group_name_,root_link_,tip_link_,DEFAULT_SEARCH_DISCRETIZATION))
+    {
+      ROS_ERROR_STREAM("Kinematics Solver failed to initialize");
+      return false;
+    }
+
+    // loading test details parameters
+    ph.param(NUM_THREADS, num_threads_, (int)boost::thread::hardware_concurrency());
+    ph.param(NUM_CONCURRENT_TESTS, num_concurrent_tests_, 100);
+    ph.param(MIN_SCALING_EFFICIENCY, min_scaling_efficiency_, 0.0);
+    num_threads_ = std::max(num_threads_, 1);
+
+    return true;
+  }
+
+  /**
+   * @brief Generates the poses solved by every thread from random states
+   */
+  void generateQueries()
+  {
+    rdf_loader::RDFLoader rdf_loader(ROBOT_DESCRIPTION_PARAM);
+    robot_model::RobotModelPtr kinematic_model;
+    const boost::shared_ptr<srdf::Model> &srdf = rdf_loader.getSRDF();
+    const boost::shared_ptr<urdf::ModelInterface>& urdf_model = rdf_loader.getURDF();
+    kinematic_model.reset(new robot_model::RobotModel(urdf_model, srdf));
+    robot_model::JointModelGroup* joint_model_group = kinematic_model->getJointModelGroup(group_name_);
+    robot_state::RobotState kinematic_state(kinematic_model);
+
+    std::vector<std::string> fk_names(1, tip_link_);
+    std::vector<geometry_msgs::Pose> poses(1);
+
+    queries_.resize(num_concurrent_tests_);
+    for(unsigned int i = 0; i < queries_.size(); ++i)
+    {
+      kinematic_state.setToRandomPositions(joint_model_group);
+      kinematic_state.copyJointGroupPositions(joint_model_group, queries_[i].fk_values);
+      kinematics_solver_->getPositionFK(fk_names, queries_[i].fk_values, poses);
+      queries_[i].pose = poses[0];
+    }
+  }
+
+  /**
+   * @brief Runs every query once on the calling thread
+   * @param record Stores the solutions as reference instead of comparing against it
+   */
+  void runQueries(bool record, Result &result)
+  {
+    const kinematics::KinematicsBase &solver = *kinematics_solver_;
+    std::vector<std::string> fk_names(1, tip_link_);
+    std::vector<geometry_msgs::Pose> new_poses(1), ik_poses(1);
+    std::vector<double> seed(solver.getJointNames().size(), 0.0);
+    std::vector<double> solution;
+    std::vector< std::vector<double> > solutions;
+    moveit_msgs::MoveItErrorCodes error_code;
+    kinematics::KinematicsResult kinematics_result;
+    kinematics::KinematicsQueryOptions options;
+    options.discretization_method = kinematics::DiscretizationMethods::ALL_RANDOM_SAMPLED;
+
+    for(unsigned int i = 0; i < queries_.size(); ++i)
+    {
+      Query &query = queries_[i];
+      result.num_queries++;
+
+      solution.clear();
+      if(!solver.searchPositionIK(query.pose, seed, 5.0, solution, error_code) ||
+         !solver.getPositionFK(fk_names, solution, new_poses) || !near(query.pose, new_poses[0]))
+      {
+        result.num_failures++;
+        continue;
+      }
+
+      if(record)
+        query.search_solution = solution;
+      else if(!near(query.search_solution, solution))
+        result.num_mismatches++;
+
+      // random sampling of the redundant joint used to depend on the global std::rand() state, whether the samples
+      // solve the pose differs between runs, so only the solutions found are checked
+      ik_poses[0] = query.pose;
+      solutions.clear();
+      if(!solver.getPositionIK(ik_poses, query.fk_values, solutions, kinematics_result, options))
+        continue;
+
+      for(unsigned int s = 0; s < solutions.size(); ++s)
+      {
+        if(!solver.getPositionFK(fk_names, solutions[s], new_poses) || !near(query.pose, new_poses[0]))
+        {
+          result.num_failures++;
+          break;
+        }
+      }
+    }
+  }
+
+  static bool near(const geometry_msgs::Pose &a, const geometry_msgs::Pose &b)
+  {
+    return std::fabs(a.position.x - b.position.x) < IK_NEAR && std::fabs(a.position.y - b.position.y) < IK_NEAR &&
+           std::fabs(a.position.z - b.position.z) < IK_NEAR &&
+           std::fabs(a.orientation.x - b.orientation.x) < IK_NEAR && std::fabs(a.orientation.y - b.orientation.y) < IK_NEAR &&
+           std::fabs(a.orientation.z - b.orientation.z) < IK_NEAR && std::fabs(a.orientation.w - b.orientation.w) < IK_NEAR;
+  }
+
+  static bool near(const std::vector<double> &a, const std::vector<double> &b)
+  {
+    if(a.size() != b.size())
+      return false;
+    for(unsigned int i = 0; i < a.size(); ++i)
+      if(std::fabs(a[i] - b[i]) > IK_NEAR)
+        return false;
+    return true;
+  }
+
+public:
+
+  kinematics::KinematicsBasePtr kinematics_solver_;
+  boost::shared_ptr<KinematicsLoader> kinematics_loader_;
+  std::string root_link_;
+  std::string tip_link_;
+  std::string group_name_;
+  int num_threads_;
+  int num_concurrent_tests_;
+  double min_scaling_efficiency_;
+  std::vector<Query> queries_;
+};
+
+ConcurrencyTest concurrency_test;
+
+TEST(IKFastPlugin, initialize)
+{
+  ASSERT_TRUE(concurrency_test.initialize());
+  concurrency_test.generateQueries();
+}
+
+TEST(IKFastPlugin, concurrentQueries)
+{
+  // single threaded reference
+  ConcurrencyTest::Result reference;
+  ros::WallTime start_time = ros::WallTime::now();
+  concurrency_test.runQueries(true, reference);
+  double single_time = (ros::WallTime::now() - start_time).toSec();
+  EXPECT_GT(reference.num_queries - reference.num_failures, 0.99 * reference.num_queries);
+
+  // every thread solves all queries on the same plugin instance
+  const int num_threads = concurrency_test.num_threads_;
+  std::vector<ConcurrencyTest::Result> results(num_threads);
+  boost::thread_group threads;
+  start_time = ros::WallTime::now();
+  for(int t = 0; t < num_threads; ++t)
+    threads.create_thread(boost::bind(&ConcurrencyTest::runQueries, &concurrency_test, false, boost::ref(results[t])));
+  threads.join_all();
+  double concurrent_time = (ros::WallTime::now() - start_time).toSec();
+
+  for(int t = 0; t < num_threads; ++t)
+  {
+    EXPECT_EQ(reference.num_failures, results[t].num_failures) << "Thread " << t;
+    EXPECT_EQ(0, results[t].num_mismatches) << "Thread " << t;
+  }
+
+  double single_throughput = reference.num_queries / single_time;
+  double concurrent_throughput = num_threads * reference.num_queries / concurrent_time;
+  double efficiency = concurrent_throughput / (num_threads * single_throughput);
+  ROS_INFO_STREAM("Throughput: " << single_throughput << " queries/s on 1 thread, " << concurrent_throughput <<
+                  " queries/s on " << num_threads << " threads, scaling efficiency " << efficiency);
+
+  // scaling is only meaningful when every thread gets a core of its own, and only checked on request since it
+  // depends on the load of the machine
+  if(concurrency_test.min_scaling_efficiency_ > 0.0 && num_threads > 1 &&
+     num_threads <= (int)boost::thread::hardware_concurrency())
+    EXPECT_GT(efficiency, concurrency_test.min_scaling_efficiency_);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  ros::init (argc, argv, "kinematics_plugin_concurrency_test");
+  return RUN_ALL_TESTS();
+}
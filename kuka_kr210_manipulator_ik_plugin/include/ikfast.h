@@ -258,6 +258,74 @@ protected:
     std::list< IkSolution<T> > _listsolutions;
 };
 
+/// \brief Receives the solutions of an ik query one at a time as they are found, see \ref IkSolutionVisitorList
+template <typename T>
+class IkSolutionVisitorBase
+{
+public:
+    virtual ~IkSolutionVisitorBase() {
+    }
+
+    /// \brief called for every solution found
+    ///
+    /// \param solution the joint values of the solution
+    /// \param vinfos solution data for each degree of freedom, \ref IkSingleDOFSolutionBase::indices identifies the branch of the solution
+    /// \return false to stop the enumeration of the remaining solutions
+    virtual bool Visit(const T* solution, const std::vector<IkSingleDOFSolutionBase<T> >& vinfos) = 0;
+};
+
+/// \brief Implementation of \ref IkSolutionListBase that forwards every solution to a visitor instead of storing it
+///
+/// Only solutions without free parameters are supported, which is what the solvers return once the free joints are set.
+template <typename T>
+class IkSolutionVisitorList : public IkSolutionListBase<T>
+{
+public:
+    IkSolutionVisitorList(IkSolutionVisitorBase<T>& visitor) : _visitor(visitor), _numsolutions(0), _stop(false) {
+    }
+
+    virtual size_t AddSolution(const std::vector<IkSingleDOFSolutionBase<T> >& vinfos, const std::vector<int>& vfree)
+    {
+        if( vfree.size() > 0 ) {
+            throw std::runtime_error("IkSolutionVisitorList does not support solutions with free parameters");
+        }
+        _values.resize(vinfos.size());
+        for(std::size_t i = 0; i < vinfos.size(); ++i) {
+            _values[i] = vinfos[i].foffset;
+        }
+        size_t index = _numsolutions++;
+        if( !_stop && !_visitor.Visit(&_values[0], vinfos) ) {
+            _stop = true;
+        }
+        return index;
+    }
+
+    virtual const IkSolutionBase<T>& GetSolution(size_t /*index*/) const
+    {
+        throw std::runtime_error("IkSolutionVisitorList does not store solutions");
+    }
+
+    virtual size_t GetNumSolutions() const {
+        return _numsolutions;
+    }
+
+    virtual void Clear() {
+        _numsolutions = 0;
+        _stop = false;
+    }
+
+    /// \brief set once the visitor asked to stop, solvers check it to skip the remaining branches
+    const bool* GetStopFlag() const {
+        return &_stop;
+    }
+
+protected:
+    IkSolutionVisitorBase<T>& _visitor;
+    std::vector<T> _values;
+    size_t _numsolutions;
+    bool _stop;
+};
+
 }
 
 #endif // OPENRAVE_IKFAST_HEADER
@@ -298,10 +298,61 @@ public:
 IkReal j0,cj0,sj0,htj0,j1,cj1,sj1,htj1,j2,cj2,sj2,htj2,j3,cj3,sj3,htj3,j4,cj4,sj4,htj4,j5,cj5,sj5,htj5,new_r00,r00,rxp0_0,new_r01,r01,rxp0_1,new_r02,r02,rxp0_2,new_r10,r10,rxp1_0,new_r11,r11,rxp1_1,new_r12,r12,rxp1_2,new_r20,r20,rxp2_0,new_r21,r21,rxp2_1,new_r22,r22,rxp2_2,new_px,px,npx,new_py,py,npy,new_pz,pz,npz,pp;
 unsigned char _ij0[2], _nj0,_ij1[2], _nj1,_ij2[2], _nj2,_ij3[2], _nj3,_ij4[2], _nj4,_ij5[2], _nj5;
 
+const IkReal* _lowerlimits; ///< if not NULL, branches with joint values below these limits are pruned
+const IkReal* _upperlimits; ///< if not NULL, branches with joint values above these limits are pruned
+const bool* _stopsearch; ///< if not NULL and set, all remaining branches are skipped
+const unsigned short* _branchmasks; ///< if not NULL, bit i of _branchmasks[index] allows root i of joint ``index``, the other branches are pruned
+
+IKSolver() : _lowerlimits(NULL), _upperlimits(NULL), _stopsearch(NULL), _branchmasks(NULL) {
+}
+
+/// \brief the root indices of joint ``index`` in the branch being explored, see \ref IkSingleDOFSolutionBase::indices
+inline const unsigned char* _BranchIndices(int index) const {
+switch(index)
+{
+case 0:
+    return _ij0;
+case 1:
+    return _ij1;
+case 2:
+    return _ij2;
+case 3:
+    return _ij3;
+case 4:
+    return _ij4;
+case 5:
+    return _ij5;
+default:
+    return NULL;
+}
+}
+
+/// \brief true if the branch where joint ``index`` takes ``value`` does not have to be explored further
+inline bool _PruneBranch(int index, IkReal value) const {
+if( _stopsearch != NULL && *_stopsearch )
+{
+    return true;
+}
+if( _branchmasks != NULL )
+{
+    const unsigned char* ij = _BranchIndices(index);
+    bool allowed = ij[0] < 16 && ((_branchmasks[index] >> ij[0]) & 1);
+    allowed = allowed || (ij[1] < 16 && ((_branchmasks[index] >> ij[1]) & 1));
+    if( !allowed )
+    {
+        return true;
+    }
+}
+return _lowerlimits != NULL && (value < _lowerlimits[index] || value > _upperlimits[index]);
+}
+
 bool ComputeIk(const IkReal* eetrans, const IkReal* eerot, const IkReal* pfree, IkSolutionListBase<IkReal>& solutions) {
-j0=numeric_limits<IkReal>::quiet_NaN(); _ij0[0] = -1; _ij0[1] = -1; _nj0 = -1; j1=numeric_limits<IkReal>::quiet_NaN(); _ij1[0] = -1; _ij1[1] = -1; _nj1 = -1; j2=numeric_limits<IkReal>::quiet_NaN(); _ij2[0] = -1; _ij2[1] = -1; _nj2 = -1; j3=numeric_limits<IkReal>::quiet_NaN(); _ij3[0] = -1; _ij3[1] = -1; _nj3 = -1; j4=numeric_limits<IkReal>::quiet_NaN(); _ij4[0] = -1; _ij4[1] = -1; _nj4 = -1; j5=numeric_limits<IkReal>::quiet_NaN(); _ij5[0] = -1; _ij5[1] = -1; _nj5 = -1; 
-for(int dummyiter = 0; dummyiter < 1; ++dummyiter) {
-    solutions.Clear();
+PrepareIk(eetrans,eerot);
+return ComputeIkPrepared(pfree,solutions);
+}
+
+/// \brief pose-only part of ComputeIk, the results are kept in the solver so that ComputeIkPrepared can be called for any number of free values
+void PrepareIk(const IkReal* eetrans, const IkReal* eerot) {
 r00 = eerot[0*3+0];
 r01 = eerot[0*3+1];
 r02 = eerot[0*3+2];
@@ -312,7 +363,6 @@ r20 = eerot[2*3+0];
 r21 = eerot[2*3+1];
 r22 = eerot[2*3+2];
 px = eetrans[0]; py = eetrans[1]; pz = eetrans[2];
-
 new_r00=((IkReal(-1.00000000000000))*(r02));
 new_r01=r01;
 new_r02=r00;
@@ -339,6 +389,12 @@ rxp1_2=((((IkReal(-1.00000000000000))*(px)*(r11)))+(((py)*(r01))));
 rxp2_0=((((IkReal(-1.00000000000000))*(py)*(r22)))+(((pz)*(r12))));
 rxp2_1=((((px)*(r22)))+(((IkReal(-1.00000000000000))*(pz)*(r02))));
 rxp2_2=((((IkReal(-1.00000000000000))*(px)*(r12)))+(((py)*(r02))));
+}
+
+bool ComputeIkPrepared(const IkReal* pfree, IkSolutionListBase<IkReal>& solutions) {
+j0=numeric_limits<IkReal>::quiet_NaN(); _ij0[0] = -1; _ij0[1] = -1; _nj0 = -1; j1=numeric_limits<IkReal>::quiet_NaN(); _ij1[0] = -1; _ij1[1] = -1; _nj1 = -1; j2=numeric_limits<IkReal>::quiet_NaN(); _ij2[0] = -1; _ij2[1] = -1; _nj2 = -1; j3=numeric_limits<IkReal>::quiet_NaN(); _ij3[0] = -1; _ij3[1] = -1; _nj3 = -1; j4=numeric_limits<IkReal>::quiet_NaN(); _ij4[0] = -1; _ij4[1] = -1; _nj4 = -1; j5=numeric_limits<IkReal>::quiet_NaN(); _ij5[0] = -1; _ij5[1] = -1; _nj5 = -1; 
+for(int dummyiter = 0; dummyiter < 1; ++dummyiter) {
+    solutions.Clear();
 {
 IkReal dummyeval[1];
 dummyeval[0]=(((px)*(px))+((py)*(py)));
@@ -402,6 +458,10 @@ if( j0valid[iij0] && IKabs(cj0array[ij0]-cj0array[iij0]) < IKFAST_SOLUTION_THRES
 }
 }
 j0 = j0array[ij0]; cj0 = cj0array[ij0]; sj0 = sj0array[ij0];
+if( _PruneBranch(0,j0) )
+{
+    continue;
+}
 
 {
 IkReal j2array[2], cj2array[2], sj2array[2];
@@ -447,6 +507,10 @@ if( j2valid[iij2] && IKabs(cj2array[ij2]-cj2array[iij2]) < IKFAST_SOLUTION_THRES
 }
 }
 j2 = j2array[ij2]; cj2 = cj2array[ij2]; sj2 = sj2array[ij2];
+if( _PruneBranch(2,j2) )
+{
+    continue;
+}
 
 {
 IkReal dummyeval[1];
@@ -517,6 +581,10 @@ if( j1valid[iij1] && IKabs(cj1array[ij1]-cj1array[iij1]) < IKFAST_SOLUTION_THRES
 }
 }
 j1 = j1array[ij1]; cj1 = cj1array[ij1]; sj1 = sj1array[ij1];
+if( _PruneBranch(1,j1) )
+{
+    continue;
+}
 {
 IkReal evalcond[5];
 IkReal x84=IKsin(j1);
@@ -589,6 +657,10 @@ if( j1valid[iij1] && IKabs(cj1array[ij1]-cj1array[iij1]) < IKFAST_SOLUTION_THRES
 }
 }
 j1 = j1array[ij1]; cj1 = cj1array[ij1]; sj1 = sj1array[ij1];
+if( _PruneBranch(1,j1) )
+{
+    continue;
+}
 {
 IkReal evalcond[5];
 IkReal x240=IKsin(j1);
@@ -682,6 +754,10 @@ if( j0valid[iij0] && IKabs(cj0array[ij0]-cj0array[iij0]) < IKFAST_SOLUTION_THRES
 }
 }
 j0 = j0array[ij0]; cj0 = cj0array[ij0]; sj0 = sj0array[ij0];
+if( _PruneBranch(0,j0) )
+{
+    continue;
+}
 
 {
 IkReal j2array[2], cj2array[2], sj2array[2];
@@ -727,6 +803,10 @@ if( j2valid[iij2] && IKabs(cj2array[ij2]-cj2array[iij2]) < IKFAST_SOLUTION_THRES
 }
 }
 j2 = j2array[ij2]; cj2 = cj2array[ij2]; sj2 = sj2array[ij2];
+if( _PruneBranch(2,j2) )
+{
+    continue;
+}
 
 {
 IkReal dummyeval[1];
@@ -797,6 +877,10 @@ if( j1valid[iij1] && IKabs(cj1array[ij1]-cj1array[iij1]) < IKFAST_SOLUTION_THRES
 }
 }
 j1 = j1array[ij1]; cj1 = cj1array[ij1]; sj1 = sj1array[ij1];
+if( _PruneBranch(1,j1) )
+{
+    continue;
+}
 {
 IkReal evalcond[5];
 IkReal x275=IKsin(j1);
@@ -869,6 +953,10 @@ if( j1valid[iij1] && IKabs(cj1array[ij1]-cj1array[iij1]) < IKFAST_SOLUTION_THRES
 }
 }
 j1 = j1array[ij1]; cj1 = cj1array[ij1]; sj1 = sj1array[ij1];
+if( _PruneBranch(1,j1) )
+{
+    continue;
+}
 {
 IkReal evalcond[5];
 IkReal x292=IKsin(j1);
@@ -973,6 +1061,10 @@ if( j4valid[iij4] && IKabs(cj4array[ij4]-cj4array[iij4]) < IKFAST_SOLUTION_THRES
 }
 }
 j4 = j4array[ij4]; cj4 = cj4array[ij4]; sj4 = sj4array[ij4];
+if( _PruneBranch(4,j4) )
+{
+    continue;
+}
 
 {
 IkReal dummyeval[1];
@@ -1051,6 +1143,10 @@ if( j3valid[iij3] && IKabs(cj3array[ij3]-cj3array[iij3]) < IKFAST_SOLUTION_THRES
 }
 }
 j3 = j3array[ij3]; cj3 = cj3array[ij3]; sj3 = sj3array[ij3];
+if( _PruneBranch(3,j3) )
+{
+    continue;
+}
 {
 IkReal evalcond[1];
 evalcond[0]=((((IkReal(-1.00000000000000))*(new_r02)*(IKsin(j3))))+(((new_r12)*(IKcos(j3)))));
@@ -1092,6 +1188,10 @@ if( j5valid[iij5] && IKabs(cj5array[ij5]-cj5array[iij5]) < IKFAST_SOLUTION_THRES
 }
 }
 j5 = j5array[ij5]; cj5 = cj5array[ij5]; sj5 = sj5array[ij5];
+if( _PruneBranch(5,j5) )
+{
+    continue;
+}
 {
 IkReal evalcond[4];
 IkReal x113=IKsin(j5);
@@ -1202,6 +1302,10 @@ if( j3valid[iij3] && IKabs(cj3array[ij3]-cj3array[iij3]) < IKFAST_SOLUTION_THRES
 }
 }
 j3 = j3array[ij3]; cj3 = cj3array[ij3]; sj3 = sj3array[ij3];
+if( _PruneBranch(3,j3) )
+{
+    continue;
+}
 {
 IkReal evalcond[1];
 evalcond[0]=((((IkReal(-1.00000000000000))*(new_r02)*(IKsin(j3))))+(((new_r12)*(IKcos(j3)))));
@@ -1243,6 +1347,10 @@ if( j5valid[iij5] && IKabs(cj5array[ij5]-cj5array[iij5]) < IKFAST_SOLUTION_THRES
 }
 }
 j5 = j5array[ij5]; cj5 = cj5array[ij5]; sj5 = sj5array[ij5];
+if( _PruneBranch(5,j5) )
+{
+    continue;
+}
 {
 IkReal evalcond[4];
 IkReal x117=IKcos(j5);
@@ -1346,6 +1454,10 @@ if( j3valid[iij3] && IKabs(cj3array[ij3]-cj3array[iij3]) < IKFAST_SOLUTION_THRES
 }
 }
 j3 = j3array[ij3]; cj3 = cj3array[ij3]; sj3 = sj3array[ij3];
+if( _PruneBranch(3,j3) )
+{
+    continue;
+}
 {
 IkReal evalcond[6];
 IkReal x121=IKsin(j3);
@@ -1434,6 +1546,10 @@ if( j5valid[iij5] && IKabs(cj5array[ij5]-cj5array[iij5]) < IKFAST_SOLUTION_THRES
 }
 }
 j5 = j5array[ij5]; cj5 = cj5array[ij5]; sj5 = sj5array[ij5];
+if( _PruneBranch(5,j5) )
+{
+    continue;
+}
 {
 IkReal evalcond[4];
 IkReal x131=IKsin(j5);
@@ -1537,6 +1653,10 @@ if( j5valid[iij5] && IKabs(cj5array[ij5]-cj5array[iij5]) < IKFAST_SOLUTION_THRES
 }
 }
 j5 = j5array[ij5]; cj5 = cj5array[ij5]; sj5 = sj5array[ij5];
+if( _PruneBranch(5,j5) )
+{
+    continue;
+}
 {
 IkReal evalcond[4];
 IkReal x137=IKcos(j5);
@@ -1637,6 +1757,10 @@ if( j5valid[iij5] && IKabs(cj5array[ij5]-cj5array[iij5]) < IKFAST_SOLUTION_THRES
 }
 }
 j5 = j5array[ij5]; cj5 = cj5array[ij5]; sj5 = sj5array[ij5];
+if( _PruneBranch(5,j5) )
+{
+    continue;
+}
 {
 IkReal evalcond[8];
 IkReal x140=IKsin(j5);
@@ -1738,6 +1862,10 @@ if( j5valid[iij5] && IKabs(cj5array[ij5]-cj5array[iij5]) < IKFAST_SOLUTION_THRES
 }
 }
 j5 = j5array[ij5]; cj5 = cj5array[ij5]; sj5 = sj5array[ij5];
+if( _PruneBranch(5,j5) )
+{
+    continue;
+}
 {
 IkReal evalcond[8];
 IkReal x149=IKsin(j5);
@@ -1839,6 +1967,10 @@ if( j5valid[iij5] && IKabs(cj5array[ij5]-cj5array[iij5]) < IKFAST_SOLUTION_THRES
 }
 }
 j5 = j5array[ij5]; cj5 = cj5array[ij5]; sj5 = sj5array[ij5];
+if( _PruneBranch(5,j5) )
+{
+    continue;
+}
 {
 IkReal evalcond[8];
 IkReal x158=IKsin(j5);
@@ -1947,6 +2079,10 @@ if( j3valid[iij3] && IKabs(cj3array[ij3]-cj3array[iij3]) < IKFAST_SOLUTION_THRES
 }
 }
 j3 = j3array[ij3]; cj3 = cj3array[ij3]; sj3 = sj3array[ij3];
+if( _PruneBranch(3,j3) )
+{
+    continue;
+}
 {
 IkReal evalcond[6];
 IkReal x168=IKsin(j3);
@@ -2035,6 +2171,10 @@ if( j5valid[iij5] && IKabs(cj5array[ij5]-cj5array[iij5]) < IKFAST_SOLUTION_THRES
 }
 }
 j5 = j5array[ij5]; cj5 = cj5array[ij5]; sj5 = sj5array[ij5];
+if( _PruneBranch(5,j5) )
+{
+    continue;
+}
 {
 IkReal evalcond[4];
 IkReal x178=IKsin(j5);
@@ -2138,6 +2278,10 @@ if( j5valid[iij5] && IKabs(cj5array[ij5]-cj5array[iij5]) < IKFAST_SOLUTION_THRES
 }
 }
 j5 = j5array[ij5]; cj5 = cj5array[ij5]; sj5 = sj5array[ij5];
+if( _PruneBranch(5,j5) )
+{
+    continue;
+}
 {
 IkReal evalcond[4];
 IkReal x184=IKcos(j5);
@@ -2238,6 +2382,10 @@ if( j5valid[iij5] && IKabs(cj5array[ij5]-cj5array[iij5]) < IKFAST_SOLUTION_THRES
 }
 }
 j5 = j5array[ij5]; cj5 = cj5array[ij5]; sj5 = sj5array[ij5];
+if( _PruneBranch(5,j5) )
+{
+    continue;
+}
 {
 IkReal evalcond[8];
 IkReal x187=IKsin(j5);
@@ -2339,6 +2487,10 @@ if( j5valid[iij5] && IKabs(cj5array[ij5]-cj5array[iij5]) < IKFAST_SOLUTION_THRES
 }
 }
 j5 = j5array[ij5]; cj5 = cj5array[ij5]; sj5 = sj5array[ij5];
+if( _PruneBranch(5,j5) )
+{
+    continue;
+}
 {
 IkReal evalcond[8];
 IkReal x196=IKsin(j5);
@@ -2440,6 +2592,10 @@ if( j5valid[iij5] && IKabs(cj5array[ij5]-cj5array[iij5]) < IKFAST_SOLUTION_THRES
 }
 }
 j5 = j5array[ij5]; cj5 = cj5array[ij5]; sj5 = sj5array[ij5];
+if( _PruneBranch(5,j5) )
+{
+    continue;
+}
 {
 IkReal evalcond[8];
 IkReal x205=IKsin(j5);
@@ -2547,6 +2703,10 @@ if( j5valid[iij5] && IKabs(cj5array[ij5]-cj5array[iij5]) < IKFAST_SOLUTION_THRES
 }
 }
 j5 = j5array[ij5]; cj5 = cj5array[ij5]; sj5 = sj5array[ij5];
+if( _PruneBranch(5,j5) )
+{
+    continue;
+}
 {
 IkReal evalcond[2];
 evalcond[0]=((((sj4)*(IKcos(j5))))+(new_r20));
@@ -2608,6 +2768,10 @@ if( j3valid[iij3] && IKabs(cj3array[ij3]-cj3array[iij3]) < IKFAST_SOLUTION_THRES
 }
 }
 j3 = j3array[ij3]; cj3 = cj3array[ij3]; sj3 = sj3array[ij3];
+if( _PruneBranch(3,j3) )
+{
+    continue;
+}
 {
 IkReal evalcond[12];
 IkReal x215=IKsin(j3);
@@ -2715,6 +2879,10 @@ if( j3valid[iij3] && IKabs(cj3array[ij3]-cj3array[iij3]) < IKFAST_SOLUTION_THRES
 }
 }
 j3 = j3array[ij3]; cj3 = cj3array[ij3]; sj3 = sj3array[ij3];
+if( _PruneBranch(3,j3) )
+{
+    continue;
+}
 {
 IkReal evalcond[12];
 IkReal x226=IKsin(j3);
@@ -2805,6 +2973,55 @@ IKSolver solver;
 return solver.ComputeIk(eetrans,eerot,pfree,solutions);
 }
 
+/// \brief holds the terms of ComputeIk that only depend on the end effector pose.
+typedef IKSolver IkPreparedPose;
+
+/// \brief Computes the pose-only terms of ComputeIk once, see \ref ComputeIkPrepared.
+///
+/// Arguments are the same as \ref ComputeIk. The results are stored in ``prepared``.
+void PrepareIk(const IkReal* eetrans, const IkReal* eerot, IkPreparedPose& prepared) {
+prepared.PrepareIk(eetrans,eerot);
+}
+
+/// \brief Computes all IK solutions of a pose previously passed to \ref PrepareIk for the given free joints.
+///
+/// Equivalent to \ref ComputeIk without recomputing the pose-only terms, meant for sweeping the free joints of a single pose.
+bool ComputeIkPrepared(IkPreparedPose& prepared, const IkReal* pfree, IkSolutionListBase<IkReal>& solutions) {
+return prepared.ComputeIkPrepared(pfree,solutions);
+}
+
+/// \brief Enumerates the IK solutions of a pose previously passed to \ref PrepareIk, handing them to ``visitor`` as they are found.
+///
+/// A branch of the solution tree is abandoned as soon as one of its joints is solved outside of [``lower``,``upper``],
+/// so the remaining joints of that branch are never computed. The enumeration stops once the visitor returns false.
+/// \param lower lower joint limits indexed by joint, NULL to disable the pruning
+/// \param upper upper joint limits indexed by joint, NULL to disable the pruning
+/// \param branchmasks bit i of ``branchmasks[j]`` allows the branches where joint j takes root i, see \ref IkSingleDOFSolutionBase::indices, NULL allows all branches
+/// \return the number of solutions passed to the visitor
+size_t ComputeIkVisit(IkPreparedPose& prepared, const IkReal* pfree, const IkReal* lower, const IkReal* upper, IkSolutionVisitorBase<IkReal>& visitor, const unsigned short* branchmasks = NULL) {
+if( lower != NULL && upper != NULL )
+{
+    for(int i = 0; i < GetNumFreeParameters(); ++i)
+    {
+        int index = GetFreeParameters()[i];
+        if( pfree[i] < lower[index] || pfree[i] > upper[index] )
+        {
+            return 0;
+        }
+    }
+}
+IkSolutionVisitorList<IkReal> solutions(visitor);
+prepared._lowerlimits = lower != NULL && upper != NULL ? lower : NULL;
+prepared._upperlimits = upper;
+prepared._stopsearch = solutions.GetStopFlag();
+prepared._branchmasks = branchmasks;
+prepared.ComputeIkPrepared(pfree,solutions);
+prepared._lowerlimits = prepared._upperlimits = NULL;
+prepared._stopsearch = NULL;
+prepared._branchmasks = NULL;
+return solutions.GetNumSolutions();
+}
+
 IKFAST_API const char* GetKinematicsHash() { return "<robot:genericrobot - kuka_kr210 (328f5fa894ca1be3105acbe6b4ce997b)>"; }
 
 IKFAST_API const char* GetIkFastVersion() { return IKFAST_STRINGIZE(IKFAST_VERSION); }
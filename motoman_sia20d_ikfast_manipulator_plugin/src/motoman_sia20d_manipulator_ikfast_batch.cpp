@@ -0,0 +1,253 @@
+/*
+ * Batch IK tool for offline dataset generation
+ *
+ * Solves every pose of a binary pose file with the same IKFast solver used by the
+ * moveit plugin and writes the solutions into a binary solution file.
+ *
+ * Pose file: consecutive records of 12 + GetNumFreeParameters() float64 values laid out as
+ *   r00 r01 r02 t0 r10 r11 r12 t1 r20 r21 r22 t2 free0 ...
+ * which is the argument order of the generated ikfast main().
+ *
+ * Solution file: a BatchFileHeader followed by one fixed size record per pose holding a
+ * BatchRecordHeader and max_solutions * num_joints float64 joint values.
+ *
+ * Limits file: a "lower upper" pair per joint in the joint order of the solver, see
+ * JointLimitsTable::load(). The solver prunes the branches outside of the limits like the plugin does,
+ * without a limits file all joints are unlimited.
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <boost/thread.hpp>
+#include <ikfast_kinematics_extension/joint_limits_table.h>
+
+#define IKFAST_NO_MAIN // Don't include main() from IKFast
+
+// Code generated by IKFast56/61
+#include "motoman_sia20d_manipulator_ikfast_solver.cpp"
+
+namespace ikfast_batch
+{
+
+const char BATCH_FILE_MAGIC[4] = {'I','K','F','B'};
+const uint32_t BATCH_FILE_VERSION = 1;
+const uint32_t DEFAULT_MAX_SOLUTIONS = 8;
+
+/// \brief Status of each pose in the solution file
+enum BATCH_STATUS { SOLVED=0, NO_SOLUTION=1, TRUNCATED=2, SOLVER_ERROR=3 };
+
+struct BatchFileHeader
+{
+  char magic[4];
+  uint32_t version;
+  uint32_t num_joints;
+  uint32_t max_solutions;
+  uint64_t num_poses;
+  uint64_t record_size; // bytes per pose record, including its BatchRecordHeader
+};
+
+struct BatchRecordHeader
+{
+  int32_t status;         // BATCH_STATUS
+  uint32_t num_solutions; // number of valid joint vectors in the record
+};
+
+/// \brief Writes the solutions of one pose straight into its output record
+class RecordVisitor : public IkSolutionVisitorBase<IkReal>
+{
+public:
+  RecordVisitor(BatchRecordHeader *record, uint32_t max_solutions):
+    record_(record),
+    values_(reinterpret_cast<double*>(record + 1)),
+    max_solutions_(max_solutions)
+  {
+    record_->num_solutions = 0;
+    record_->status = NO_SOLUTION;
+  }
+
+  virtual bool Visit(const IkReal* sol, const std::vector<IkSingleDOFSolutionBase<IkReal> >& vinfos)
+  {
+    if(record_->num_solutions == max_solutions_)
+    {
+      record_->status = TRUNCATED;
+      return false;
+    }
+
+    double *dest = values_ + record_->num_solutions * vinfos.size();
+    for(std::size_t i = 0; i < vinfos.size(); ++i)
+      dest[i] = sol[i];
+    record_->num_solutions++;
+    record_->status = SOLVED;
+    return true;
+  }
+
+private:
+  BatchRecordHeader *record_;
+  double *values_;
+  uint32_t max_solutions_;
+};
+
+/// \brief Solves the poses in [begin,end), dropping the solutions outside of limits
+void solveRange(const double *poses, char *records, std::size_t record_size, uint32_t max_solutions,
+                const ikfast_kinematics_plugin::JointLimitsTable &limits, uint64_t begin, uint64_t end)
+{
+  const int num_free = GetNumFreeParameters();
+  const std::size_t stride = 12 + num_free;
+  IkPreparedPose context;
+  IkReal eerot[9], eetrans[3];
+
+  for(uint64_t p = begin; p < end; ++p)
+  {
+    const double *pose = poses + p * stride;
+    BatchRecordHeader *record = reinterpret_cast<BatchRecordHeader*>(records + p * record_size);
+
+    eerot[0] = pose[0]; eerot[1] = pose[1]; eerot[2] = pose[2];  eetrans[0] = pose[3];
+    eerot[3] = pose[4]; eerot[4] = pose[5]; eerot[5] = pose[6];  eetrans[1] = pose[7];
+    eerot[6] = pose[8]; eerot[7] = pose[9]; eerot[8] = pose[10]; eetrans[2] = pose[11];
+
+    RecordVisitor visitor(record, max_solutions);
+    try
+    {
+      PrepareIk(eetrans, eerot, context);
+      ComputeIkVisit(context, num_free > 0 ? pose + 12 : NULL, limits.lower, limits.upper, visitor);
+    }
+    catch(const std::exception &)
+    {
+      record->status = SOLVER_ERROR;
+      record->num_solutions = 0;
+    }
+  }
+}
+
+/// \brief Maps a file into memory, returns NULL on failure
+void* mapFile(const char *path, int flags, std::size_t size, int &fd)
+{
+  int prot = (flags & O_RDWR) ? PROT_READ | PROT_WRITE : PROT_READ;
+  fd = open(path, flags, 0644);
+  if(fd < 0)
+  {
+    perror(path);
+    return NULL;
+  }
+
+  if((flags & O_RDWR) && ftruncate(fd, size) != 0)
+  {
+    perror(path);
+    close(fd);
+    return NULL;
+  }
+
+  void *data = mmap(NULL, size, prot, MAP_SHARED, fd, 0);
+  if(data == MAP_FAILED)
+  {
+    perror(path);
+    close(fd);
+    return NULL;
+  }
+  return data;
+}
+
+} // end namespace
+
+using namespace ikfast_batch;
+
+int main(int argc, char** argv)
+{
+  if(argc < 3 || argc > 6)
+  {
+    printf("\nUsage: %s poses.bin solutions.bin [num_threads] [max_solutions] [limits.txt]\n\n"
+           "Solves every pose of poses.bin, a sequence of records of %d float64 values\n"
+           "(r00 r01 r02 t0 r10 r11 r12 t1 r20 r21 r22 t2 free0 ...), and writes up to\n"
+           "max_solutions (default %u) solutions of %d joints per pose into solutions.bin.\n"
+           "num_threads and max_solutions of 0 keep the defaults. limits.txt holds a\n"
+           "\"lower upper\" pair per joint, the solutions outside of them are dropped.\n\n",
+           argv[0], 12 + GetNumFreeParameters(), DEFAULT_MAX_SOLUTIONS, GetNumJoints());
+    return 1;
+  }
+
+  unsigned int num_threads = argc > 3 ? atoi(argv[3]) : 0;
+  uint32_t max_solutions = argc > 4 ? atoi(argv[4]) : 0;
+  num_threads = num_threads > 0 ? num_threads : std::max(boost::thread::hardware_concurrency(), 1u);
+  max_solutions = max_solutions > 0 ? max_solutions : DEFAULT_MAX_SOLUTIONS;
+
+  // joint limits, unlimited without a limits file
+  ikfast_kinematics_plugin::JointLimitsTable limits;
+  limits.num_joints = GetNumJoints();
+  if(argc > 5 && !limits.load(argv[5], GetNumJoints()))
+  {
+    fprintf(stderr, "%s: expected a \"lower upper\" pair for each of the %d joints\n", argv[5], GetNumJoints());
+    return 1;
+  }
+
+  // input poses
+  struct stat st;
+  if(stat(argv[1], &st) != 0)
+  {
+    perror(argv[1]);
+    return 1;
+  }
+
+  const std::size_t pose_size = (12 + GetNumFreeParameters()) * sizeof(double);
+  if(st.st_size == 0 || st.st_size % pose_size != 0)
+  {
+    fprintf(stderr, "%s: size is not a multiple of the %d bytes pose record\n", argv[1], (int)pose_size);
+    return 1;
+  }
+  const uint64_t num_poses = st.st_size / pose_size;
+
+  int poses_fd;
+  const double *poses = static_cast<const double*>(mapFile(argv[1], O_RDONLY, st.st_size, poses_fd));
+  if(poses == NULL)
+    return 1;
+  madvise(const_cast<double*>(poses), st.st_size, MADV_SEQUENTIAL);
+
+  // output solutions
+  BatchFileHeader header;
+  memcpy(header.magic, BATCH_FILE_MAGIC, sizeof(header.magic));
+  header.version = BATCH_FILE_VERSION;
+  header.num_joints = GetNumJoints();
+  header.max_solutions = max_solutions;
+  header.num_poses = num_poses;
+  header.record_size = sizeof(BatchRecordHeader) + max_solutions * GetNumJoints() * sizeof(double);
+
+  const std::size_t output_size = sizeof(BatchFileHeader) + num_poses * header.record_size;
+  int solutions_fd;
+  char *output = static_cast<char*>(mapFile(argv[2], O_RDWR | O_CREAT | O_TRUNC, output_size, solutions_fd));
+  if(output == NULL)
+    return 1;
+  memcpy(output, &header, sizeof(header));
+  char *records = output + sizeof(BatchFileHeader);
+
+  // contiguous chunks per thread keep each thread on its own pages of both files
+  boost::thread_group threads;
+  uint64_t chunk = (num_poses + num_threads - 1) / num_threads;
+  for(uint64_t begin = 0; begin < num_poses; begin += chunk)
+  {
+    uint64_t end = std::min(begin + chunk, num_poses);
+    threads.create_thread(boost::bind(&solveRange, poses, records, header.record_size, max_solutions,
+                                       boost::cref(limits), begin, end));
+  }
+  threads.join_all();
+
+  uint64_t solved = 0;
+  for(uint64_t p = 0; p < num_poses; ++p)
+  {
+    const BatchRecordHeader *record = reinterpret_cast<const BatchRecordHeader*>(records + p * header.record_size);
+    if(record->status == SOLVED || record->status == TRUNCATED)
+      solved++;
+  }
+  printf("Solved %llu of %llu poses using %u threads\n", (unsigned long long)solved, (unsigned long long)num_poses, num_threads);
+
+  munmap(const_cast<double*>(poses), st.st_size);
+  close(poses_fd);
+  msync(output, output_size, MS_SYNC);
+  munmap(output, output_size);
+  close(solutions_fd);
+  return 0;
+}
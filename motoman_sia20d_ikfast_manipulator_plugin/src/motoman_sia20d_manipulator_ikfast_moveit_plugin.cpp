@@ -47,13 +47,37 @@
 
 #include <ros/ros.h>
 #include <moveit/kinematics_base/kinematics_base.h>
+#include <ikfast_kinematics_extension/ikfast_kinematics_extension.h>
+#include <ikfast_kinematics_extension/joint_limits_table.h>
 #include <urdf/model.h>
 #include <tf_conversions/tf_kdl.h>
+#include <Eigen/Geometry>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_real_distribution.hpp>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <ikfast_kinematics_extension/ikfast_trace.h>
+#include <ikfast_kinematics_extension/free_joint_prior.h>
+#include <ikfast_kinematics_extension/callback_memo.h>
 
 // Need a floating point tolerance when checking joint limits, in case the joint starts at limit
 const double LIMIT_TOLERANCE = .0000001;
+// Free joint values of the learned prior tried before the sweep of searchPositionIK(), see free_joint_prior.h
+const int MAX_PRIOR_PROBES = 3;
+// Fewest sets of free joint values per thread of solveBatch(), smaller batches are solved by fewer threads
+const std::size_t MIN_CHUNK_SOLVES = 16;
+// Sets of free joint values the streaming getPositionIK() solves at a time, bounds the solutions it buffers
+const std::size_t STREAM_BLOCK_SOLVES = 64;
 /// \brief Search modes for searchPositionIK(), see there
-enum SEARCH_MODE { OPTIMIZE_FREE_JOINT=1, OPTIMIZE_MAX_JOINT=2 };
+///
+/// Every mode except OPTIMIZE_FREE_JOINT keeps the solution of lowest cost, see SearchModeCost
+enum SEARCH_MODE { OPTIMIZE_FREE_JOINT=1, OPTIMIZE_MAX_JOINT=2, OPTIMIZE_WEIGHTED_L2=4, OPTIMIZE_LIMIT_DISTANCE=8,
+                   OPTIMIZE_MANIPULABILITY=16 };
+
+// The search mode is selected at compile time, e.g. add_definitions(-DIKFAST_SEARCH_MODE=OPTIMIZE_MANIPULABILITY)
+#ifndef IKFAST_SEARCH_MODE
+#define IKFAST_SEARCH_MODE OPTIMIZE_MAX_JOINT
+#endif
 
 namespace ikfast_kinematics_plugin
 {
@@ -113,15 +137,528 @@ enum IkParameterizationType {
 // Code generated by IKFast56/61
 #include "motoman_sia20d_manipulator_ikfast_solver.cpp"
 
-class IKFastKinematicsPlugin : public kinematics::KinematicsBase
+/// \brief Gets the ConfigurationId of a solution of the solver
+inline ConfigurationId getConfigurationId(const std::vector<IkSingleDOFSolutionBase<IkReal> > &vinfos)
+{
+  ConfigurationId id = 0;
+  for(std::size_t j = 0; j < vinfos.size() && j < 32 / BRANCH_BITS; ++j)
+  {
+    if(vinfos[j].indices[0] < (1 << BRANCH_BITS))
+      id |= (ConfigurationId)vinfos[j].indices[0] << (BRANCH_BITS * j);
+  }
+  return id;
+}
+
+/// \brief Collects every solution and its configuration
+class CollectSolutionsVisitor : public SolutionStreamVisitor
+{
+public:
+  CollectSolutionsVisitor(std::size_t dof, std::vector< std::vector<double> > &solutions,
+                          std::vector<ConfigurationId> &configurations):
+    dof_(dof),
+    solutions_(solutions),
+    configurations_(configurations)
+  {
+  }
+
+  virtual bool visit(const double *solution, ConfigurationId configuration)
+  {
+    solutions_.push_back(std::vector<double>(solution, solution + dof_));
+    configurations_.push_back(configuration);
+    return true;
+  }
+
+private:
+  std::size_t dof_;
+  std::vector< std::vector<double> > &solutions_;
+  std::vector<ConfigurationId> &configurations_;
+};
+
+/// \brief Spatial hash of the cells of joint space that already hold a solution, see getPositionIK()
+///
+/// The joint values are quantized into cells of tolerance per joint and only the first solution of each cell and
+/// configuration is kept, so every dropped solution is within tolerance of a kept one of the same configuration in
+/// each joint. Cells are identified by a hash of their coordinates in an open addressing table, a collision drops a
+/// solution of another cell.
+class DuplicateFilter
+{
+public:
+  DuplicateFilter(double tolerance):
+    inverse_tolerance_(tolerance > 0.0 ? 1.0 / tolerance : 0.0),
+    size_(0)
+  {
+  }
+
+  /// \brief Marks the cell of a solution, returns false if it was marked before
+  bool insert(const double *solution, std::size_t dof, ConfigurationId configuration)
+  {
+    // FNV-1a, 0 marks empty slots
+    uint64_t key = (14695981039346656037ull ^ configuration) * 1099511628211ull;
+    for(std::size_t j = 0; j < dof; ++j)
+      key = (key ^ (uint32_t)(int32_t)floor(solution[j] * inverse_tolerance_)) * 1099511628211ull;
+    key = key == 0 ? 1 : key;
+
+    if(2 * (size_ + 1) > cells_.size())
+      grow();
+    for(std::size_t i = key & (cells_.size() - 1);; i = (i + 1) & (cells_.size() - 1))
+    {
+      if(cells_[i] == key)
+        return false;
+      if(cells_[i] == 0)
+      {
+        cells_[i] = key;
+        size_++;
+        return true;
+      }
+    }
+  }
+
+private:
+  void grow()
+  {
+    std::vector<uint64_t> cells(std::max<std::size_t>(64, 2 * cells_.size()), 0);
+    for(std::size_t i = 0; i < cells_.size(); ++i)
+    {
+      if(cells_[i] == 0)
+        continue;
+      std::size_t j = cells_[i] & (cells.size() - 1);
+      while(cells[j] != 0)
+        j = (j + 1) & (cells.size() - 1);
+      cells[j] = cells_[i];
+    }
+    cells_.swap(cells);
+  }
+
+  double inverse_tolerance_;
+  std::size_t size_;
+  std::vector<uint64_t> cells_; // a power of two, at most half full, allocated by the first insert()
+};
+
+/// \brief Passes the solutions of the solver, or the ones replayed from solveBatch(), on to a SolutionStreamVisitor
+/// until it stops or max_solutions were passed
+class StreamSolutionsVisitor : public IkSolutionVisitorBase<IkReal>
+{
+public:
+  StreamSolutionsVisitor(SolutionStreamVisitor &visitor, std::size_t max_solutions,
+                         DuplicateFilter *duplicates = NULL):
+    visitor_(visitor),
+    max_solutions_(max_solutions),
+    duplicates_(duplicates),
+    count(0),
+    num_duplicates(0),
+    stopped(false)
+  {
+  }
+
+  virtual bool Visit(const IkReal* sol, const std::vector<IkSingleDOFSolutionBase<IkReal> >& vinfos)
+  {
+    return add(sol, vinfos.size(), getConfigurationId(vinfos));
+  }
+
+  /// \brief Same as Visit() for solutions of dof joints that were collected beforehand, see BatchSolutionsVisitor
+  bool add(const IkReal* sol, std::size_t dof, ConfigurationId configuration)
+  {
+    if(stopped)
+      return false;
+
+    if(duplicates_ != NULL && !duplicates_->insert(sol, dof, configuration))
+    {
+      num_duplicates++;
+      return true;
+    }
+
+    if(IKFAST_TRACE_ENABLED(ikfast_trace::TRACE_SOLUTIONS))
+      ikfast_trace::record(ikfast_trace::SOLUTION, count, sol, dof);
+
+    count++;
+    stopped = !visitor_.visit(sol, configuration) || count == max_solutions_;
+    return !stopped;
+  }
+
+private:
+  SolutionStreamVisitor &visitor_;
+  std::size_t max_solutions_;
+  DuplicateFilter *duplicates_; // NULL passes every solution on
+
+public:
+  std::size_t count;          // solutions passed on
+  std::size_t num_duplicates; // solutions dropped by duplicates_
+  bool stopped;               // the visitor stopped or the cap was reached
+};
+
+/// \brief Collects the solutions of consecutive solver calls, see solveBatch()
+class BatchSolutionsVisitor : public IkSolutionVisitorBase<IkReal>
+{
+public:
+  virtual bool Visit(const IkReal* sol, const std::vector<IkSingleDOFSolutionBase<IkReal> >& vinfos)
+  {
+    candidates.insert(candidates.end(), sol, sol + vinfos.size());
+    configurations.push_back(getConfigurationId(vinfos));
+    return true;
+  }
+
+  std::vector<IkReal> candidates; // the joint values of all solutions, one after the other
+  std::vector<ConfigurationId> configurations; // one per solution
+  std::vector<std::size_t> ends;  // end of the values of each solver call in candidates
+};
+
+/// \brief Keeps the first solution passed by the solver and stops the enumeration
+class FirstSolutionVisitor : public IkSolutionVisitorBase<IkReal>
+{
+public:
+  FirstSolutionVisitor(std::vector<double> &solution):
+    solution_(solution),
+    found_(false)
+  {
+  }
+
+  virtual bool Visit(const IkReal* sol, const std::vector<IkSingleDOFSolutionBase<IkReal> >& vinfos)
+  {
+    solution_.assign(sol, sol + vinfos.size());
+    found_ = true;
+    return false;
+  }
+
+  bool found() const { return found_; }
+
+private:
+  std::vector<double> &solution_;
+  bool found_;
+};
+
+/// \brief Evaluates the solutions of searchPositionIK() as the solver finds them, see there
+///
+/// In OPTIMIZE_FREE_JOINT mode the callback is applied to each solution in solver order until one passes.
+/// In the other modes the solutions of one solver call are buffered and scored by Cost in a single pass
+/// in evaluate(), then handed to the callback by increasing cost until one passes or none can improve
+/// on best_costs anymore. With a BatchIKCallbackFn all buffered solutions that are candidates, in solver order or by
+/// increasing cost, are checked in one call and the first one that passes is taken. With a CallbackMemo, see useMemo(),
+/// candidates with a known verdict skip the callback.
+template<class Cost>
+class SearchSolutionVisitor : public IkSolutionVisitorBase<IkReal>
+{
+public:
+  SearchSolutionVisitor(const geometry_msgs::Pose &ik_pose,
+                        const kinematics::KinematicsBase::IKCallbackFn &solution_callback,
+                        SEARCH_MODE search_mode,
+                        const Cost &cost,
+                        std::vector<double> &solution,
+                        moveit_msgs::MoveItErrorCodes &error_code,
+                        const BatchIKCallbackFn *batch_callback = NULL):
+    ik_pose_(ik_pose),
+    solution_callback_(solution_callback),
+    batch_callback_(batch_callback),
+    search_mode_(search_mode),
+    cost_(cost),
+    solution_(solution),
+    error_code_(error_code),
+    dof_(0),
+    memo_(NULL),
+    scene_version_(0),
+    best_costs(std::numeric_limits<double>::infinity()),
+    found(false),
+    nattempts(0),
+    nvalid(0)
+  {
+  }
+
+  virtual bool Visit(const IkReal* sol, const std::vector<IkSingleDOFSolutionBase<IkReal> >& vinfos)
+  {
+    return add(sol, vinfos.size());
+  }
+
+  /// \brief Looks up the verdicts of the callback in memo before calling it and records the new ones, NULL for none
+  void useMemo(CallbackMemo *memo, uint64_t scene_version)
+  {
+    memo_ = memo != NULL && memo->configured() ? memo : NULL;
+    scene_version_ = scene_version;
+  }
+
+  /// \brief Same as Visit() for solutions of dof joints that were collected beforehand, see BatchSolutionsVisitor
+  bool add(const IkReal* sol, std::size_t dof)
+  {
+    // The solver only passes solutions within joint limits
+    dof_ = dof;
+    if(search_mode_ != OPTIMIZE_FREE_JOINT || batch_callback_ != NULL)
+    {
+      candidates_.insert(candidates_.end(), sol, sol + dof_);
+      return true;
+    }
+
+    // Return first feasible solution
+    found = check(sol);
+    return !found;
+  }
+
+  /// \brief Scores the solutions buffered since the last call and keeps the best feasible one
+  void evaluate()
+  {
+    if(candidates_.empty())
+      return;
+
+    const std::size_t count = candidates_.size() / dof_;
+    if(batch_callback_ != NULL)
+    {
+      evaluateBatch(count);
+      candidates_.clear();
+      return;
+    }
+
+    costs_.resize(count);
+    cost_(&candidates_[0], count, dof_, &costs_[0]);
+
+    ranked_.clear();
+    for(std::size_t i = 0; i < count; ++i)
+    {
+      if(costs_[i] < best_costs)
+        ranked_.push_back(std::make_pair(costs_[i], i));
+    }
+    std::sort(ranked_.begin(), ranked_.end());
+
+    for(std::size_t i = 0; i < ranked_.size(); ++i)
+    {
+      if(check(&candidates_[ranked_[i].second * dof_]))
+      {
+        best_costs = ranked_[i].first;
+        best_solution = solution_;
+        break;
+      }
+    }
+    candidates_.clear();
+  }
+
+private:
+  /// \brief evaluate() with the batch callback
+  void evaluateBatch(std::size_t count)
+  {
+    ranked_.clear();
+    if(search_mode_ == OPTIMIZE_FREE_JOINT)
+    {
+      for(std::size_t i = 0; i < count; ++i)
+        ranked_.push_back(std::make_pair(0.0, i));
+    }
+    else
+    {
+      costs_.resize(count);
+      cost_(&candidates_[0], count, dof_, &costs_[0]);
+      for(std::size_t i = 0; i < count; ++i)
+      {
+        if(costs_[i] < best_costs)
+          ranked_.push_back(std::make_pair(costs_[i], i));
+      }
+      std::sort(ranked_.begin(), ranked_.end());
+    }
+    if(ranked_.empty())
+      return;
+
+    batch_.resize(ranked_.size() * dof_);
+    for(std::size_t i = 0; i < ranked_.size(); ++i)
+      std::copy(&candidates_[ranked_[i].second * dof_], &candidates_[(ranked_[i].second + 1) * dof_], &batch_[i * dof_]);
+    valid_.assign(ranked_.size(), 0);
+
+    // known verdicts first, the candidates after the first known valid one can't be the result
+    std::size_t num_ranked = ranked_.size();
+    unknown_.clear();
+    for(std::size_t i = 0; i < num_ranked; ++i)
+    {
+      int32_t verdict;
+      if(memo_ == NULL || !memo_->lookup(&batch_[i * dof_], scene_version_, verdict))
+        unknown_.push_back(i);
+      else if((valid_[i] = verdict == error_code_.SUCCESS))
+        num_ranked = i + 1;
+    }
+
+    // the others in a single call of the callback
+    if(!unknown_.empty())
+    {
+      const double *checked = &batch_[0];
+      uint8_t *checked_valid = &valid_[0];
+      if(unknown_.size() < ranked_.size())
+      {
+        unknown_batch_.resize(unknown_.size() * dof_);
+        for(std::size_t i = 0; i < unknown_.size(); ++i)
+          std::copy(&batch_[unknown_[i] * dof_], &batch_[(unknown_[i] + 1) * dof_], &unknown_batch_[i * dof_]);
+        unknown_valid_.assign(unknown_.size(), 0);
+        checked = &unknown_batch_[0];
+        checked_valid = &unknown_valid_[0];
+      }
+      (*batch_callback_)(ik_pose_, checked, unknown_.size(), dof_, checked_valid);
+
+      for(std::size_t i = 0; i < unknown_.size(); ++i)
+      {
+        valid_[unknown_[i]] = checked_valid[i];
+        if(IKFAST_TRACE_ENABLED(ikfast_trace::TRACE_SOLUTIONS))
+          ikfast_trace::record(ikfast_trace::CALLBACK_RESULT,
+                               checked_valid[i] ? error_code_.SUCCESS : error_code_.NO_IK_SOLUTION,
+                               &checked[i * dof_], dof_);
+        if(memo_ != NULL)
+          memo_->store(&checked[i * dof_], scene_version_,
+                       checked_valid[i] ? error_code_.SUCCESS : error_code_.NO_IK_SOLUTION);
+      }
+    }
+    nattempts += num_ranked;
+
+    std::size_t first_valid = num_ranked;
+    for(std::size_t i = 0; i < num_ranked; ++i)
+    {
+      if(valid_[i])
+      {
+        nvalid++;
+        first_valid = std::min(first_valid, i);
+      }
+    }
+    if(first_valid == num_ranked)
+      return;
+
+    solution_.assign(&batch_[first_valid * dof_], &batch_[(first_valid + 1) * dof_]);
+    error_code_.val = error_code_.SUCCESS;
+    if(search_mode_ == OPTIMIZE_FREE_JOINT)
+    {
+      found = true;
+    }
+    else
+    {
+      best_costs = ranked_[first_valid].first;
+      best_solution = solution_;
+    }
+  }
+
+  /// \brief Applies the callback if provided, returns true if the solution passes
+  bool check(const IkReal* sol)
+  {
+    nattempts++;
+    solution_.assign(sol, sol + dof_);
+
+    // This solution is within joint limits, now check if in collision (if callback provided)
+    int32_t verdict;
+    if(!solution_callback_.empty() && memo_ != NULL && memo_->lookup(&solution_[0], scene_version_, verdict))
+    {
+      error_code_.val = verdict;
+    }
+    else if(!solution_callback_.empty())
+    {
+      solution_callback_(ik_pose_, solution_, error_code_);
+      if(IKFAST_TRACE_ENABLED(ikfast_trace::TRACE_SOLUTIONS))
+        ikfast_trace::record(ikfast_trace::CALLBACK_RESULT, error_code_.val, sol, dof_);
+      if(memo_ != NULL)
+        memo_->store(&solution_[0], scene_version_, error_code_.val);
+    }
+    else
+    {
+      error_code_.val = error_code_.SUCCESS;
+    }
+
+    if(error_code_.val != error_code_.SUCCESS)
+      return false;
+
+    nvalid++;
+    return true;
+  }
+
+  const geometry_msgs::Pose &ik_pose_;
+  const kinematics::KinematicsBase::IKCallbackFn &solution_callback_;
+  const BatchIKCallbackFn *batch_callback_; // replaces solution_callback_ unless NULL
+  SEARCH_MODE search_mode_;
+  const Cost &cost_;
+  std::vector<double> &solution_;
+  moveit_msgs::MoveItErrorCodes &error_code_;
+  std::size_t dof_;
+  std::vector<IkReal> candidates_;
+  std::vector<double> costs_;
+  std::vector<std::pair<double, std::size_t> > ranked_;
+  std::vector<double> batch_;   // the candidates handed to the batch callback, in the order of ranked_
+  std::vector<uint8_t> valid_;
+  std::vector<std::size_t> unknown_; // the candidates of batch_ without a verdict in memo_
+  std::vector<double> unknown_batch_;
+  std::vector<uint8_t> unknown_valid_;
+  CallbackMemo *memo_;
+  uint64_t scene_version_;
+
+public:
+  double best_costs;
+  std::vector<double> best_solution;
+  bool found;
+  int nattempts;
+  int nvalid;
+};
+
+class IKFastKinematicsPlugin;
+
+/// \brief What the cost functors may depend on, see SearchModeCost
+struct CostContext
+{
+  const IKFastKinematicsPlugin *kinematics;
+  const double *seed;    // ik_seed_state
+  const double *weights; // per joint weights of OPTIMIZE_WEIGHTED_L2
+  const double *max_joint_scales; // per joint factors of OPTIMIZE_MAX_JOINT, see max_joint_scales_
+  const IkReal *lower;   // joint limits, unbounded for joints without limits
+  const IkReal *upper;
+};
+
+/// \brief Transform from a link of the chain to its child link, taken from the URDF joint between them
+struct ChainSegment
+{
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  Eigen::Isometry3d origin; // joint origin in the parent link frame
+  Eigen::Vector3d axis;     // joint axis in the joint frame
+  int joint_index;          // index into the joint angles, -1 for fixed joints
+  bool prismatic;
+};
+
+/// \brief Records the QUERY_BEGIN and QUERY_END trace events of the query it is scoped to
+class QueryTrace
+{
+public:
+  QueryTrace(ikfast_trace::QUERY_TYPE type, const geometry_msgs::Pose &pose):
+    solved(false),
+    num_solutions(0),
+    num_solver_calls(0),
+    enabled_(IKFAST_TRACE_ENABLED(ikfast_trace::TRACE_QUERIES))
+  {
+    if(!enabled_)
+      return;
+    double values[7] = {pose.position.x, pose.position.y, pose.position.z, pose.orientation.x, pose.orientation.y,
+                        pose.orientation.z, pose.orientation.w};
+    ikfast_trace::record(ikfast_trace::QUERY_BEGIN, type, values, 7);
+  }
+
+  ~QueryTrace()
+  {
+    if(!enabled_)
+      return;
+    double values[2] = {(double)num_solutions, (double)num_solver_calls};
+    ikfast_trace::record(ikfast_trace::QUERY_END, solved ? 1 : 0, values, 2);
+  }
+
+  bool solved;
+  int num_solutions;
+  int num_solver_calls;
+
+private:
+  bool enabled_;
+};
+
+class IKFastKinematicsPlugin : public IKFastKinematicsExtension
 {
   std::vector<std::string> joint_names_;
   std::vector<double> joint_min_vector_;
   std::vector<double> joint_max_vector_;
   std::vector<bool> joint_has_limits_vector_;
+  JointLimitsTable solver_limits_; // Joint limits handed to the solver to prune branches, see getSolverLimits()
+  std::vector<int> configuration_; // The root each joint of the solver takes, -1 for any, see ConfigurationId
+  std::vector<double> cost_weights_; // Per joint weights of OPTIMIZE_WEIGHTED_L2
+  std::vector<double> max_joint_scales_; // Per joint 1/max_velocity of OPTIMIZE_MAX_JOINT with max_joint_time_scaling, ones otherwise
+  std::string trace_file_; // Receives the trace of all threads when the plugin is destroyed, see ikfast_trace.h
+  mutable FreeJointPrior free_joint_prior_; // Learned by searchPositionIK(), unused while not configured
+  std::string free_joint_prior_file_; // Loaded by initialize() and written when the plugin is destroyed
+  mutable CallbackMemo callback_memo_; // Verdicts of the searchPositionIK() callbacks, unused while not configured
   std::vector<std::string> link_names_;
+  std::vector<ChainSegment, Eigen::aligned_allocator<ChainSegment> > chain_segments_; // One per entry of link_names_
   size_t num_joints_;
   std::vector<int> free_params_;
+  int search_threads_; // Threads of solveBatch(), 1 solves in the calling thread only
+  double duplicate_tolerance_; // Joint distance below which the multi solution getPositionIK() drops solutions, 0 keeps all
   bool active_; // Internal variable that indicates whether solvers are configured and ready
 
   const std::vector<std::string>& getJointNames() const { return joint_names_; }
@@ -133,14 +670,23 @@ public:
    *  @brief Interface for an IKFast kinematics plugin
    */
   IKFastKinematicsPlugin():
+    search_threads_(1),
+    duplicate_tolerance_(0.0),
     active_(false)
   {
-    srand( time(NULL) );
     supported_methods_.push_back(kinematics::DiscretizationMethods::NO_DISCRETIZATION);
     supported_methods_.push_back(kinematics::DiscretizationMethods::ALL_DISCRETIZED);
     supported_methods_.push_back(kinematics::DiscretizationMethods::ALL_RANDOM_SAMPLED);
   }
 
+  ~IKFastKinematicsPlugin()
+  {
+    if(!trace_file_.empty() && !ikfast_trace::writeTrace(trace_file_))
+      ROS_ERROR_STREAM_NAMED("ikfast","Failed to write the trace to " << trace_file_);
+    if(!free_joint_prior_file_.empty() && free_joint_prior_.configured() && !free_joint_prior_.save(free_joint_prior_file_))
+      ROS_ERROR_STREAM_NAMED("ikfast","Failed to write the free joint prior to " << free_joint_prior_file_);
+  }
+
   /**
    * @brief Given a desired pose of the end-effector, compute the joint angles to reach it
    * @param ik_pose the desired pose of the link
@@ -257,11 +803,10 @@ public:
                      const std::vector<double> &joint_angles,
                      std::vector<geometry_msgs::Pose> &poses) const;
 
-
   /**
    * @brief Sets the discretization value for the redundant joint.
    *
-   * Since this ikfast implementation allows for one redundant joint then only the first entry will be in the discretization map will be used.
+   * Each free joint of the solver is a redundant joint, those missing from the map use the default discretization.
    * Calling this method replaces previous discretization settings.
    *
    * @param discretization a map of joint indices and discretization value pairs.
@@ -273,6 +818,78 @@ public:
    */
   bool setRedundantJoints(const std::vector<unsigned int> &redundant_joint_indices);
 
+  // IKFastKinematicsExtension, documented in ikfast_kinematics_extension.h
+  bool getPositionIK(const std::vector<geometry_msgs::Pose> &ik_poses,
+                     const std::vector<double> &ik_seed_state,
+                     const std::vector<int> &configuration,
+                     std::vector< std::vector<double> >& solutions,
+                     std::vector<ConfigurationId> &configurations,
+                     kinematics::KinematicsResult& result,
+                     const kinematics::KinematicsQueryOptions &options) const;
+
+  bool getPositionIK(const std::vector<geometry_msgs::Pose> &ik_poses,
+                     const std::vector<double> &ik_seed_state,
+                     const std::vector<int> &configuration,
+                     SolutionStreamVisitor &visitor,
+                     std::size_t max_solutions,
+                     kinematics::KinematicsResult& result,
+                     const kinematics::KinematicsQueryOptions &options) const;
+
+  bool searchPositionIK(const geometry_msgs::Pose &ik_pose,
+                        const std::vector<double> &ik_seed_state,
+                        double timeout,
+                        const std::vector<double> &consistency_limits,
+                        std::vector<double> &solution,
+                        const BatchIKCallbackFn &batch_callback,
+                        moveit_msgs::MoveItErrorCodes &error_code,
+                        const kinematics::KinematicsQueryOptions &options = kinematics::KinematicsQueryOptions()) const;
+
+  bool searchPositionIK(const geometry_msgs::Pose &ik_pose,
+                        const std::vector<double> &ik_seed_state,
+                        double timeout,
+                        const std::vector<double> &consistency_limits,
+                        std::vector<double> &solution,
+                        const IKCallbackFn &solution_callback,
+                        moveit_msgs::MoveItErrorCodes &error_code,
+                        bool &definitive,
+                        const kinematics::KinematicsQueryOptions &options = kinematics::KinematicsQueryOptions()) const;
+
+  bool searchPositionIKWithRestarts(const geometry_msgs::Pose &ik_pose,
+                                    const std::vector<double> &ik_seed_state,
+                                    double timeout,
+                                    const std::vector<double> &consistency_limits,
+                                    std::vector<double> &solution,
+                                    const IKCallbackFn &solution_callback,
+                                    moveit_msgs::MoveItErrorCodes &error_code,
+                                    unsigned int attempts,
+                                    const kinematics::KinematicsQueryOptions &options = kinematics::KinematicsQueryOptions()) const;
+
+  bool getPositionFK(const double *joint_angles, double *transform) const;
+
+  bool getPositionFK(const double *joint_angles, Eigen::Isometry3d &pose) const;
+
+  bool getPositionFK(const double *joint_angles, std::size_t count, double *transforms) const;
+
+  bool getChainFK(const double *joint_angles, double *transforms) const;
+
+  bool getChainFK(const double *joint_angles, std::size_t count, double *transforms) const;
+
+  bool getJacobian(const double *joint_angles, double *jacobian) const;
+
+  bool getJacobian(const double *joint_angles, std::size_t count, double *jacobians) const;
+
+  bool getManipulability(const double *joint_angles, double &manipulability) const;
+
+  bool getManipulability(const double *joint_angles, std::size_t count, double *manipulability) const;
+
+  bool getVelocityIK(const double *joint_angles, const double *twist, double damping, double *joint_velocities) const;
+
+  void setCallbackMemoSceneVersion(uint64_t version) { callback_memo_.setSceneVersion(version); }
+
+  CallbackMemoStats getCallbackMemoStats() const { return callback_memo_.getStats(); }
+
+  void clearCallbackMemo() { callback_memo_.clear(); }
+
 
 private:
 
@@ -288,6 +905,88 @@ private:
    */
   int solve(KDL::Frame &pose_frame, const std::vector<double> &vfree, IkSolutionList<IkReal> &solutions) const;
 
+  /**
+   * @brief Computes the pose dependent terms of the IKFast solver once so that solveWithFree()
+   * can be called for several values of the free joints
+   * @return False if the IkParameterizationType of the solver isn't supported
+   */
+  bool prepare(const KDL::Frame &pose_frame, IkPreparedPose &context) const;
+
+  /**
+   * @brief Calls the IK solver from IKFast on a pose previously passed to prepare()
+   * @return The number of solutions found
+   */
+  int solveWithFree(IkPreparedPose &context, const std::vector<double> &vfree, IkSolutionList<IkReal> &solutions) const;
+
+  /**
+   * @brief Calls the IK solver from IKFast on a pose previously passed to prepare(), pruning the branches
+   * outside of the limits and passing the remaining solutions to the visitor until it returns false
+   * @return The number of solutions passed to the visitor
+   */
+  int solveWithFree(IkPreparedPose &context, const std::vector<double> &vfree, const JointLimitsTable &limits,
+                    IkSolutionVisitorBase<IkReal> &visitor) const;
+
+  /**
+   * @brief Calls the IK solver for several sets of free joint values of a pose previously passed to prepare()
+   *
+   * The sets are split into contiguous chunks that up to search_threads_ threads solve concurrently, each one on its
+   * own copy of the prepared pose. Reading the chunks in order gives the solutions in the order of the sets, so the
+   * result doesn't depend on the number of threads.
+   * @param free_values the sets one after the other, free_params_.size() values each
+   * @param chunks receives the solutions of each chunk, see BatchSolutionsVisitor
+   */
+  void solveBatch(const IkPreparedPose &context, const std::vector<double> &free_values, const JointLimitsTable &limits,
+                  std::vector<BatchSolutionsVisitor> &chunks) const;
+
+  /// \brief Solves the sets [begin, end) of free_values, the chunk of one thread of solveBatch()
+  void solveChunk(IkPreparedPose context, const std::vector<double> &free_values, std::size_t begin, std::size_t end,
+                  const JointLimitsTable &limits, BatchSolutionsVisitor &visitor) const;
+
+  /**
+   * @brief searchPositionIK() for solvers with several free joints
+   *
+   * The free joints are stepped by search_discretization_ in shells around the seed, shell r holding the increments
+   * whose largest one is r, which generalizes the getCount() sweep of a single free joint. Each shell is solved by
+   * solveBatch() and evaluated in order. The search ends at the first feasible solution in OPTIMIZE_FREE_JOINT mode,
+   * in OPTIMIZE_MAX_JOINT mode at the first shell that can't improve on the best solution, otherwise after the last
+   * shell or at the timeout.
+   */
+  bool searchFreeSpace(const geometry_msgs::Pose &ik_pose, const std::vector<double> &ik_seed_state, double timeout,
+                       const std::vector<double> &consistency_limits, IkPreparedPose &context,
+                       std::vector<double> &solution, const IKCallbackFn &solution_callback,
+                       const BatchIKCallbackFn *batch_callback, moveit_msgs::MoveItErrorCodes &error_code,
+                       QueryTrace &trace) const;
+
+  /**
+   * @brief The searchPositionIK() overloads with callbacks, batch_callback replaces solution_callback unless NULL
+   * @param definitive receives whether a failure is definitive if not NULL, see there
+   */
+  bool searchPositionIK(const geometry_msgs::Pose &ik_pose, const std::vector<double> &ik_seed_state, double timeout,
+                        const std::vector<double> &consistency_limits, std::vector<double> &solution,
+                        const IKCallbackFn &solution_callback, const BatchIKCallbackFn *batch_callback,
+                        moveit_msgs::MoveItErrorCodes &error_code, bool *definitive,
+                        const kinematics::KinematicsQueryOptions &options) const;
+
+  /**
+   * @brief Gets the increments of the free joints in one shell of searchFreeSpace()
+   * @param min_counts, max_counts range of the increments of each free joint, min_counts <= 0 <= max_counts
+   * @param counts receives the points of the shell, free_params_.size() increments each
+   */
+  void getFreeShell(int shell, const std::vector<int> &min_counts, const std::vector<int> &max_counts,
+                    std::vector<int> &counts) const;
+
+  /**
+   * @brief Gets the joint limits and the configuration parameter in the form expected by the solver, joints without
+   * limits are left unbounded
+   * @param tolerance added on both sides of each limit
+   */
+  void getSolverLimits(double tolerance, JointLimitsTable &limits) const;
+
+  /**
+   * @brief Gets the data the cost functors of the search modes depend on for the given seed
+   */
+  CostContext getCostContext(const std::vector<double> &ik_seed_state) const;
+
   /**
    * @brief Gets a specific solution from the set
    */
@@ -299,9 +998,148 @@ private:
   void fillFreeParams(int count, int *array);
   bool getCount(int &count, const int &max_count, const int &min_count) const;
 
-  bool sampleRedundantJoint(kinematics::DiscretizationMethod method, std::vector<double>& sampled_joint_vals) const;
+  /**
+   * @brief Steps through the probes of the free joint prior and then the getCount() sweep from the
+   * seed, skipping the increments that were probed
+   * @param probe index of the current probe, num_probes once sweeping
+   */
+  bool getNextCount(int &count, int &probe, const int *probes, int num_probes, int max_count, int min_count) const;
+
+  /**
+   * @brief Appends samples of the redundant joints for the multi solution getPositionIK()
+   * @param sampled_joint_vals receives the samples one after the other, redundant_joint_indices_.size() values each
+   */
+  bool sampleRedundantJoint(kinematics::DiscretizationMethod method, std::vector<double>& sampled_joint_vals) const;
+
+}; // end class
+
+/**
+ * Cost functors for the search modes. Each one scores count candidate solutions of dof joints
+ * stored contiguously in a single pass, lower costs are better.
+ */
+
+/// \brief The candidates of a cost functor as the columns of a dof x count array
+typedef Eigen::Map<const Eigen::Array<double,Eigen::Dynamic,Eigen::Dynamic> > CandidatesArray;
+typedef Eigen::Map<const Eigen::ArrayXd> JointArray;
+typedef Eigen::Map<Eigen::Array<double,1,Eigen::Dynamic> > CostsArray;
+
+/// \brief Largest joint motion from the seed
+struct MaxJointDeltaCost
+{
+  MaxJointDeltaCost(const CostContext &context): context_(context) {}
+
+  void operator()(const double *candidates, std::size_t count, std::size_t dof, double *costs) const
+  {
+    const CandidatesArray candidate(candidates, dof, count);
+    const JointArray seed(context_.seed, dof), scales(context_.max_joint_scales, dof);
+    CostsArray(costs, count) = ((candidate.colwise() - seed).abs().colwise() * scales).colwise().maxCoeff();
+  }
+
+  CostContext context_;
+};
+
+/// \brief Weighted squared distance to the seed
+struct WeightedL2Cost
+{
+  WeightedL2Cost(const CostContext &context): context_(context) {}
+
+  void operator()(const double *candidates, std::size_t count, std::size_t dof, double *costs) const
+  {
+    const CandidatesArray candidate(candidates, dof, count);
+    const JointArray seed(context_.seed, dof), weights(context_.weights, dof);
+    CostsArray(costs, count) = ((candidate.colwise() - seed).square().colwise() * weights).colwise().sum();
+  }
+
+  CostContext context_;
+};
+
+/// \brief Negated distance to the closest joint limit, relative to the range of each joint
+struct LimitDistanceCost
+{
+  LimitDistanceCost(const CostContext &context): context_(context) {}
+
+  void operator()(const double *candidates, std::size_t count, std::size_t dof, double *costs) const
+  {
+    for(std::size_t i = 0; i < count; ++i)
+    {
+      const double *candidate = candidates + i*dof;
+      double distance = 1.0;
+      for(std::size_t j = 0; j < dof; ++j)
+      {
+        const double range = context_.upper[j] - context_.lower[j];
+        if(range < std::numeric_limits<double>::infinity())
+        {
+          distance = std::min(distance, (candidate[j] - context_.lower[j]) / range);
+          distance = std::min(distance, (context_.upper[j] - candidate[j]) / range);
+        }
+      }
+      costs[i] = -distance;
+    }
+  }
+
+  CostContext context_;
+};
+
+/// \brief Negated manipulability, see IKFastKinematicsPlugin::getManipulability()
+struct ManipulabilityCost
+{
+  ManipulabilityCost(const CostContext &context): context_(context) {}
+
+  void operator()(const double *candidates, std::size_t count, std::size_t dof, double *costs) const
+  {
+    if(!context_.kinematics->getManipulability(candidates, count, costs))
+    {
+      std::fill(costs, costs + count, 0.0);
+      return;
+    }
+    for(std::size_t i = 0; i < count; ++i)
+      costs[i] = -costs[i];
+  }
+
+  CostContext context_;
+};
+
+/// \brief Maps each SEARCH_MODE to its cost functor
+template<int MODE> struct SearchModeCost { typedef MaxJointDeltaCost type; };
+template<> struct SearchModeCost<OPTIMIZE_WEIGHTED_L2> { typedef WeightedL2Cost type; };
+template<> struct SearchModeCost<OPTIMIZE_LIMIT_DISTANCE> { typedef LimitDistanceCost type; };
+template<> struct SearchModeCost<OPTIMIZE_MANIPULABILITY> { typedef ManipulabilityCost type; };
+
+typedef SearchModeCost<IKFAST_SEARCH_MODE>::type SearchCost;
+
+/// \brief Orders solutions by increasing cost, ties keep the solver order
+/// \param configurations if not NULL, the configuration of each solution, reordered along with the solutions
+template<class Cost>
+void sortSolutions(const Cost &cost, std::vector< std::vector<double> > &solutions,
+                   std::vector<ConfigurationId> *configurations = NULL)
+{
+  if(solutions.size() < 2)
+    return;
+
+  const std::size_t dof = solutions[0].size();
+  std::vector<double> candidates;
+  candidates.reserve(solutions.size() * dof);
+  for(std::size_t i = 0; i < solutions.size(); ++i)
+    candidates.insert(candidates.end(), solutions[i].begin(), solutions[i].end());
 
-}; // end class
+  std::vector<double> costs(solutions.size());
+  cost(&candidates[0], solutions.size(), dof, &costs[0]);
+
+  std::vector<std::pair<double, std::size_t> > ranked(solutions.size());
+  for(std::size_t i = 0; i < solutions.size(); ++i)
+    ranked[i] = std::make_pair(costs[i], i);
+  std::sort(ranked.begin(), ranked.end());
+
+  for(std::size_t i = 0; i < ranked.size(); ++i)
+    solutions[i].assign(candidates.begin() + ranked[i].second * dof, candidates.begin() + (ranked[i].second + 1) * dof);
+
+  if(configurations != NULL && configurations->size() == solutions.size())
+  {
+    std::vector<ConfigurationId> unsorted(*configurations);
+    for(std::size_t i = 0; i < ranked.size(); ++i)
+      (*configurations)[i] = unsorted[ranked[i].second];
+  }
+}
 
 bool IKFastKinematicsPlugin::initialize(const std::string &robot_description,
                                         const std::string& group_name,
@@ -320,15 +1158,9 @@ bool IKFastKinematicsPlugin::initialize(const std::string &robot_description,
   fillFreeParams( GetNumFreeParameters(), GetFreeParameters() );
   num_joints_ = GetNumJoints();
 
-  if(free_params_.size() > 1)
-  {
-    ROS_FATAL("Only one free joint parameter supported!");
-    return false;
-  }
-  else if(free_params_.size() == 1)
+  if(!free_params_.empty())
   {
-    redundant_joint_indices_.clear();
-    redundant_joint_indices_.push_back(free_params_[0]);
+    redundant_joint_indices_.assign(free_params_.begin(), free_params_.end());
     KinematicsBase::setSearchDiscretization(DEFAULT_SEARCH_DISCRETIZATION);
   }
 
@@ -359,6 +1191,18 @@ bool IKFastKinematicsPlugin::initialize(const std::string &robot_description,
     boost::shared_ptr<urdf::Joint> joint = link->parent_joint;
     if(joint)
     {
+      const urdf::Pose &origin = joint->parent_to_joint_origin_transform;
+      double qx, qy, qz, qw;
+      origin.rotation.getQuaternion(qx, qy, qz, qw);
+
+      ChainSegment segment;
+      segment.origin = Eigen::Translation3d(origin.position.x, origin.position.y, origin.position.z) *
+                       Eigen::Quaterniond(qw, qx, qy, qz);
+      segment.axis = Eigen::Vector3d(joint->axis.x, joint->axis.y, joint->axis.z);
+      segment.joint_index = joint->type != urdf::Joint::UNKNOWN && joint->type != urdf::Joint::FIXED ? 0 : -1;
+      segment.prismatic = joint->type == urdf::Joint::PRISMATIC;
+      chain_segments_.push_back(segment);
+
       if (joint->type != urdf::Joint::UNKNOWN && joint->type != urdf::Joint::FIXED)
       {
         ROS_DEBUG_STREAM_NAMED("ikfast","Adding joint " << joint->name );
@@ -400,6 +1244,7 @@ bool IKFastKinematicsPlugin::initialize(const std::string &robot_description,
     } else
     {
       ROS_WARN_NAMED("ikfast","no joint corresponding to %s",link->name.c_str());
+      chain_segments_.clear();
     }
     link = link->getParent();
   }
@@ -411,14 +1256,152 @@ bool IKFastKinematicsPlugin::initialize(const std::string &robot_description,
   }
 
   std::reverse(link_names_.begin(),link_names_.end());
+  std::reverse(chain_segments_.begin(),chain_segments_.end());
   std::reverse(joint_names_.begin(),joint_names_.end());
   std::reverse(joint_min_vector_.begin(),joint_min_vector_.end());
   std::reverse(joint_max_vector_.begin(),joint_max_vector_.end());
   std::reverse(joint_has_limits_vector_.begin(), joint_has_limits_vector_.end());
 
+  // Number the actuated joints from the base, a link without parent joint leaves the chain incomplete
+  if(chain_segments_.size() == link_names_.size() && num_joints_ <= MAX_CHAIN_JOINTS)
+  {
+    int joint_index = 0;
+    for(size_t i=0; i < chain_segments_.size(); ++i)
+      if(chain_segments_[i].joint_index >= 0)
+        chain_segments_[i].joint_index = joint_index++;
+  }
+  else
+  {
+    chain_segments_.clear();
+  }
+
+  // Position limits from joint_limits.yaml (robot_description_planning) may only narrow the ones in the URDF
+  ros::NodeHandle planning_handle(robot_description + "_planning/joint_limits");
+  for(size_t i=0; i <num_joints_; ++i)
+  {
+    bool has_position_limits = true;
+    planning_handle.param(joint_names_[i] + "/has_position_limits", has_position_limits, has_position_limits);
+    if(!has_position_limits)
+      continue;
+
+    double min_position, max_position;
+    if(planning_handle.getParam(joint_names_[i] + "/min_position", min_position) && min_position > joint_min_vector_[i])
+    {
+      joint_min_vector_[i] = min_position;
+      joint_has_limits_vector_[i] = true;
+    }
+    if(planning_handle.getParam(joint_names_[i] + "/max_position", max_position) && max_position < joint_max_vector_[i])
+    {
+      joint_max_vector_[i] = max_position;
+      joint_has_limits_vector_[i] = true;
+    }
+  }
+
   for(size_t i=0; i <num_joints_; ++i)
     ROS_DEBUG_STREAM_NAMED("ikfast",joint_names_[i] << " " << joint_min_vector_[i] << " " << joint_max_vector_[i] << " " << joint_has_limits_vector_[i]);
 
+  node_handle.param("cost_weights", cost_weights_, std::vector<double>(num_joints_, 1.0));
+  if(cost_weights_.size() != num_joints_)
+  {
+    ROS_WARN_STREAM_NAMED("ikfast","cost_weights must have size " << num_joints_ << ", using unit weights");
+    cost_weights_.assign(num_joints_, 1.0);
+  }
+
+  // OPTIMIZE_MAX_JOINT compares the time each joint needs at its velocity limit instead of the joint motion
+  bool max_joint_time_scaling;
+  node_handle.param("max_joint_time_scaling", max_joint_time_scaling, false);
+  max_joint_scales_.assign(num_joints_, 1.0);
+  for(size_t i=0; max_joint_time_scaling && i < num_joints_; ++i)
+  {
+    bool has_velocity_limits = false;
+    double max_velocity;
+    if(planning_handle.getParam(joint_names_[i] + "/has_velocity_limits", has_velocity_limits) && has_velocity_limits &&
+       planning_handle.getParam(joint_names_[i] + "/max_velocity", max_velocity) && max_velocity > 0.0)
+      max_joint_scales_[i] = 1.0 / max_velocity;
+    else
+      ROS_WARN_STREAM_NAMED("ikfast","No velocity limit for " << joint_names_[i] << ", max_joint_time_scaling assumes 1 rad/s");
+  }
+
+  // The trace level is process wide, TRACE_OFF leaves a single comparison per event on the query paths
+  int trace_level;
+  node_handle.param("trace_level", trace_level, (int)ikfast_trace::TRACE_OFF);
+  node_handle.param("trace_file", trace_file_, std::string());
+  if(trace_level != ikfast_trace::TRACE_OFF)
+  {
+    if(!IKFAST_TRACE)
+      ROS_WARN_NAMED("ikfast","trace_level is set but tracing was compiled out with IKFAST_TRACE=0");
+    ikfast_trace::setTraceLevel(trace_level);
+  }
+
+  // Poses close to ones solved before start the free joint sweep at the values that solved those
+  bool free_joint_prior;
+  node_handle.param("free_joint_prior", free_joint_prior, false);
+  node_handle.param("free_joint_prior_file", free_joint_prior_file_, std::string());
+  if(free_joint_prior && free_params_.size() > 1)
+    ROS_WARN_NAMED("ikfast","free_joint_prior only supports a single free joint, it is disabled");
+  else if(free_joint_prior && !free_params_.empty())
+  {
+    double position_cell, orientation_cell;
+    node_handle.param("free_joint_prior_position_cell", position_cell, 0.05);
+    node_handle.param("free_joint_prior_orientation_cell", orientation_cell, 0.1);
+    free_joint_prior_.configure(joint_min_vector_[free_params_[0]], joint_max_vector_[free_params_[0]], position_cell,
+                                orientation_cell);
+    if(!free_joint_prior_.configured())
+      ROS_WARN_NAMED("ikfast","free_joint_prior needs positive cell sizes and a free joint with limits, it is disabled");
+    else if(!free_joint_prior_file_.empty() && !free_joint_prior_.load(free_joint_prior_file_))
+      ROS_WARN_STREAM_NAMED("ikfast","No free joint prior loaded from " << free_joint_prior_file_ << ", starting empty");
+    else if(!free_joint_prior_file_.empty())
+      ROS_INFO_STREAM_NAMED("ikfast","Loaded the free joint prior of " << free_joint_prior_.size() << " pose cells");
+  }
+
+  // Sweeps over the free joints solve large batches of free joint values on several threads, 0 uses all cores
+  node_handle.param("search_threads", search_threads_, 1);
+  if(search_threads_ <= 0)
+    search_threads_ = std::max(1u, boost::thread::hardware_concurrency());
+
+  // Closely spaced free joint samples give nearly identical solutions, only one per cell of this size is returned
+  node_handle.param("duplicate_tolerance", duplicate_tolerance_, 0.0);
+  if(duplicate_tolerance_ < 0.0)
+  {
+    ROS_WARN_STREAM_NAMED("ikfast","duplicate_tolerance must not be negative, keeping all solutions");
+    duplicate_tolerance_ = 0.0;
+  }
+
+  // Configurations checked before skip the callback of searchPositionIK(), until the scene version changes
+  int callback_memo_size;
+  double callback_memo_resolution;
+  node_handle.param("callback_memo_size", callback_memo_size, 0);
+  node_handle.param("callback_memo_resolution", callback_memo_resolution, 0.0001);
+  callback_memo_.configure(num_joints_, callback_memo_resolution, std::max(callback_memo_size, 0));
+  if(callback_memo_size > 0 && !callback_memo_.configured())
+    ROS_WARN_NAMED("ikfast","callback_memo_resolution must be positive, the callback memo is disabled");
+  else if(callback_memo_.configured())
+    ROS_DEBUG_STREAM_NAMED("ikfast","Callback memo of " << callback_memo_.size() << " configurations");
+
+  // A fixed configuration keeps the solver from computing the branches of the other configurations at all
+  node_handle.param("configuration", configuration_, std::vector<int>());
+  if(!configuration_.empty() && configuration_.size() != num_joints_)
+  {
+    ROS_WARN_STREAM_NAMED("ikfast","configuration must have size " << num_joints_ << ", allowing all configurations");
+    configuration_.clear();
+  }
+  else if(!isValidConfiguration(configuration_))
+  {
+    ROS_WARN_STREAM_NAMED("ikfast","configuration roots must be -1 or below " << (1 << BRANCH_BITS) << ", allowing all configurations");
+    configuration_.clear();
+  }
+
+  // The solver rejects every branch outside of these as soon as the offending joint is solved
+  getSolverLimits(LIMIT_TOLERANCE, solver_limits_);
+
+  // Checked once here rather than in searchPositionIK(), which keeps no state between calls
+  for(size_t i=0; i < free_params_.size(); ++i)
+  {
+    if(IKFAST_SEARCH_MODE != OPTIMIZE_FREE_JOINT &&
+       (joint_max_vector_[free_params_[i]] - joint_min_vector_[free_params_[i]]) / search_discretization_ > 1000)
+      ROS_WARN_STREAM_NAMED("ikfast", "Large search space, consider increasing the search discretization");
+  }
+
   active_ = true;
   return true;
 }
@@ -438,23 +1421,30 @@ void IKFastKinematicsPlugin::setSearchDiscretization(const std::map<int,double>&
     return;
   }
 
-  if(discretization.begin()->first != redundant_joint_indices_[0])
+  for(std::map<int,double>::const_iterator it = discretization.begin(); it != discretization.end(); ++it)
   {
-    std::string redundant_joint = joint_names_[free_params_[0]];
-    ROS_ERROR_STREAM("Attempted to discretize a non-redundant joint "<<discretization.begin()->first<<", only joint '"<<
-                     redundant_joint<<"' with index " <<redundant_joint_indices_[0]<<" is redundant.");
-    return;
-  }
+    if(std::find(redundant_joint_indices_.begin(), redundant_joint_indices_.end(), (unsigned int)it->first) ==
+       redundant_joint_indices_.end())
+    {
+      std::stringstream indices;
+      for(std::size_t i = 0; i < free_params_.size(); ++i)
+        indices << " " << free_params_[i];
+      ROS_ERROR_STREAM("Attempted to discretize a non-redundant joint "<<it->first<<", only the joints with indices"<<
+                       indices.str()<<" are redundant.");
+      return;
+    }
 
-  if(discretization.begin()->second <= 0.0)
-  {
-	  ROS_ERROR_STREAM("Discretization can not takes values that are <= 0");
-	  return;
+    if(it->second <= 0.0)
+    {
+      ROS_ERROR_STREAM("Discretization can not takes values that are <= 0");
+      return;
+    }
   }
 
-
-  redundant_joint_discretization_.clear();
-  redundant_joint_discretization_[redundant_joint_indices_[0]] = discretization.begin()->second;
+  // redundant joints missing from the map keep the default discretization
+  KinematicsBase::setSearchDiscretization(DEFAULT_SEARCH_DISCRETIZATION);
+  for(std::map<int,double>::const_iterator it = discretization.begin(); it != discretization.end(); ++it)
+    redundant_joint_discretization_[it->first] = it->second;
 }
 
 bool IKFastKinematicsPlugin::setRedundantJoints(const std::vector<unsigned int> &redundant_joint_indices)
@@ -466,9 +1456,19 @@ bool IKFastKinematicsPlugin::setRedundantJoints(const std::vector<unsigned int>
 
 int IKFastKinematicsPlugin::solve(KDL::Frame &pose_frame, const std::vector<double> &vfree, IkSolutionList<IkReal> &solutions) const
 {
-  // IKFast56/61
-  solutions.Clear();
+  IkPreparedPose context;
+  if(!prepare(pose_frame, context))
+  {
+    solutions.Clear();
+    return 0;
+  }
+
+  return solveWithFree(context, vfree, solutions);
+}
 
+bool IKFastKinematicsPlugin::prepare(const KDL::Frame &pose_frame, IkPreparedPose &context) const
+{
+  // IKFast56/61
   double trans[3];
   trans[0] = pose_frame.p[0];//-.18;
   trans[1] = pose_frame.p[1];
@@ -497,8 +1497,8 @@ int IKFastKinematicsPlugin::solve(KDL::Frame &pose_frame, const std::vector<doub
       vals[8] = mult(2,2);
 
       // IKFast56/61
-      ComputeIk(trans, vals, vfree.size() > 0 ? &vfree[0] : NULL, solutions);
-      return solutions.GetNumSolutions();
+      PrepareIk(trans, vals, context);
+      return true;
 
     case IKP_Direction3D:
     case IKP_Ray4D:
@@ -506,20 +1506,20 @@ int IKFastKinematicsPlugin::solve(KDL::Frame &pose_frame, const std::vector<doub
       // For **Direction3D**, **Ray4D**, and **TranslationDirection5D**, the first 3 values represent the target direction.
 
       direction = pose_frame.M * KDL::Vector(0, 0, 1);
-      ComputeIk(trans, direction.data, vfree.size() > 0 ? &vfree[0] : NULL, solutions);
-      return solutions.GetNumSolutions();
+      PrepareIk(trans, direction.data, context);
+      return true;
 
     case IKP_TranslationXAxisAngle4D:
     case IKP_TranslationYAxisAngle4D:
     case IKP_TranslationZAxisAngle4D:
       // For **TranslationXAxisAngle4D**, **TranslationYAxisAngle4D**, and **TranslationZAxisAngle4D**, the first value represents the angle.
       ROS_ERROR_NAMED("ikfast", "IK for this IkParameterizationType not implemented yet.");
-      return 0;
+      return false;
 
     case IKP_TranslationLocalGlobal6D:
       // For **TranslationLocalGlobal6D**, the diagonal elements ([0],[4],[8]) are the local translation inside the end effector coordinate system.
       ROS_ERROR_NAMED("ikfast", "IK for this IkParameterizationType not implemented yet.");
-      return 0;
+      return false;
 
     case IKP_Rotation3D:
     case IKP_Lookat3D:
@@ -529,12 +1529,135 @@ int IKFastKinematicsPlugin::solve(KDL::Frame &pose_frame, const std::vector<doub
     case IKP_TranslationYAxisAngleXNorm4D:
     case IKP_TranslationZAxisAngleYNorm4D:
       ROS_ERROR_NAMED("ikfast", "IK for this IkParameterizationType not implemented yet.");
-      return 0;
+      return false;
 
     default:
       ROS_ERROR_NAMED("ikfast", "Unknown IkParameterizationType! Was the solver generated with an incompatible version of Openrave?");
-      return 0;
+      return false;
+  }
+}
+
+int IKFastKinematicsPlugin::solveWithFree(IkPreparedPose &context, const std::vector<double> &vfree, IkSolutionList<IkReal> &solutions) const
+{
+  // IKFast56/61
+  ComputeIkPrepared(context, vfree.size() > 0 ? &vfree[0] : NULL, solutions);
+  return solutions.GetNumSolutions();
+}
+
+int IKFastKinematicsPlugin::solveWithFree(IkPreparedPose &context, const std::vector<double> &vfree,
+                                          const JointLimitsTable &limits, IkSolutionVisitorBase<IkReal> &visitor) const
+{
+  // IKFast56/61
+  return ComputeIkVisit(context, vfree.size() > 0 ? &vfree[0] : NULL, limits.lower, limits.upper, visitor,
+                        limits.branchMasks());
+}
+
+void IKFastKinematicsPlugin::solveBatch(const IkPreparedPose &context, const std::vector<double> &free_values,
+                                        const JointLimitsTable &limits, std::vector<BatchSolutionsVisitor> &chunks) const
+{
+  const std::size_t count = free_values.size() / free_params_.size();
+  std::size_t num_chunks = std::min((std::size_t)search_threads_, (count + MIN_CHUNK_SOLVES - 1) / MIN_CHUNK_SOLVES);
+  num_chunks = std::max(num_chunks, (std::size_t)1);
+  const std::size_t chunk_size = (count + num_chunks - 1) / num_chunks;
+  chunks.resize(num_chunks);
+
+  // the calling thread solves the first chunk
+  boost::thread_group threads;
+  for(std::size_t i = 1; i < num_chunks; ++i)
+  {
+    threads.create_thread(boost::bind(&IKFastKinematicsPlugin::solveChunk, this, context, boost::cref(free_values),
+                                      std::min(count, i * chunk_size), std::min(count, (i + 1) * chunk_size),
+                                      boost::cref(limits), boost::ref(chunks[i])));
+  }
+  solveChunk(context, free_values, 0, std::min(count, chunk_size), limits, chunks[0]);
+  threads.join_all();
+}
+
+void IKFastKinematicsPlugin::solveChunk(IkPreparedPose context, const std::vector<double> &free_values,
+                                        std::size_t begin, std::size_t end, const JointLimitsTable &limits,
+                                        BatchSolutionsVisitor &visitor) const
+{
+  visitor.candidates.clear();
+  visitor.configurations.clear();
+  visitor.ends.clear();
+  std::vector<double> vfree(free_params_.size());
+  for(std::size_t i = begin; i < end; ++i)
+  {
+    std::copy(free_values.begin() + i * vfree.size(), free_values.begin() + (i + 1) * vfree.size(), vfree.begin());
+    solveWithFree(context, vfree, limits, visitor);
+    visitor.ends.push_back(visitor.candidates.size());
+  }
+}
+
+void IKFastKinematicsPlugin::getFreeShell(int shell, const std::vector<int> &min_counts, const std::vector<int> &max_counts,
+                                          std::vector<int> &counts) const
+{
+  const std::size_t num_free = min_counts.size();
+  counts.clear();
+
+  // steps through the box [-shell, shell] of the increments except for the last free joint, which is either
+  // stepped through the whole box as well, if another free joint is on the surface of the shell, or only takes
+  // the values -shell and shell
+  int lower[MAX_CHAIN_JOINTS], upper[MAX_CHAIN_JOINTS], count[MAX_CHAIN_JOINTS];
+  for(std::size_t i = 0; i < num_free; ++i)
+  {
+    lower[i] = std::max(-shell, min_counts[i]);
+    upper[i] = std::min(shell, max_counts[i]);
+    count[i] = lower[i];
+  }
+
+  const std::size_t last = num_free - 1;
+  while(true)
+  {
+    bool surface = false;
+    for(std::size_t i = 0; i < last; ++i)
+      surface = surface || std::abs(count[i]) == shell;
+
+    // -shell and shell, only 0 in shell 0
+    const int step = surface ? 1 : std::max(2 * shell, 1);
+    for(int c = surface ? lower[last] : -shell; c <= upper[last]; c += step)
+    {
+      if(c >= lower[last])
+      {
+        count[last] = c;
+        counts.insert(counts.end(), count, count + num_free);
+      }
+    }
+
+    std::size_t i = 0;
+    for(; i < last && count[i] == upper[i]; ++i)
+      count[i] = lower[i];
+    if(i == last)
+      break;
+    count[i]++;
+  }
+}
+
+void IKFastKinematicsPlugin::getSolverLimits(double tolerance, JointLimitsTable &limits) const
+{
+  limits = JointLimitsTable();
+  limits.num_joints = num_joints_;
+  for(std::size_t i = 0; i < num_joints_; ++i)
+  {
+    if(joint_has_limits_vector_[i])
+    {
+      limits.lower[i] = joint_min_vector_[i] - tolerance;
+      limits.upper[i] = joint_max_vector_[i] + tolerance;
+    }
   }
+  limits.setConfiguration(configuration_);
+}
+
+CostContext IKFastKinematicsPlugin::getCostContext(const std::vector<double> &ik_seed_state) const
+{
+  CostContext context;
+  context.kinematics = this;
+  context.seed = &ik_seed_state[0];
+  context.weights = &cost_weights_[0];
+  context.max_joint_scales = &max_joint_scales_[0];
+  context.lower = solver_limits_.lower;
+  context.upper = solver_limits_.upper;
+  return context;
 }
 
 void IKFastKinematicsPlugin::getSolution(const IkSolutionList<IkReal> &solutions, int i, std::vector<double>& solution) const
@@ -667,50 +1790,303 @@ bool IKFastKinematicsPlugin::getCount(int &count, const int &max_count, const in
   }
 }
 
-bool IKFastKinematicsPlugin::getPositionFK(const std::vector<std::string> &link_names,
-                                           const std::vector<double> &joint_angles,
-                                           std::vector<geometry_msgs::Pose> &poses) const
+bool IKFastKinematicsPlugin::getNextCount(int &count, int &probe, const int *probes, int num_probes, int max_count,
+                                          int min_count) const
+{
+  if(probe < num_probes)
+  {
+    if(++probe < num_probes)
+    {
+      count = probes[probe];
+      return true;
+    }
+
+    // the sweep starts at the seed
+    count = 0;
+    if(std::find(probes, probes + num_probes, 0) == probes + num_probes)
+      return true;
+  }
+
+  do
+  {
+    if(!getCount(count, max_count, min_count))
+      return false;
+  }
+  while(std::find(probes, probes + num_probes, count) != probes + num_probes);
+  return true;
+}
+
+bool IKFastKinematicsPlugin::getPositionFK(const std::vector<std::string> &link_names,
+                                           const std::vector<double> &joint_angles,
+                                           std::vector<geometry_msgs::Pose> &poses) const
+{
+  if (GetIkType() != IKP_Transform6D) {
+    // ComputeFk() is the inverse function of ComputeIk(), so the format of
+    // eerot differs depending on IK type. The Transform6D IK type is the only
+    // one for which a 3x3 rotation matrix is returned, which means we can only
+    // compute FK for that IK type.
+    ROS_ERROR_NAMED("ikfast", "Can only compute FK for Transform6D IK type!");
+    return false;
+  }
+
+  KDL::Frame p_out;
+  if(link_names.size() == 0) {
+    ROS_WARN_STREAM_NAMED("ikfast","Link names with nothing");
+    return false;
+  }
+
+  if(joint_angles.size() != num_joints_)
+  {
+    ROS_ERROR_STREAM_NAMED("ikfast","Joint angles must have size " << num_joints_ << " instead of size " << joint_angles.size());
+    return false;
+  }
+
+  if(link_names.size() == 1 && link_names[0] == getTipFrame())
+  {
+    // IKFast56/61
+    ComputeFk(&joint_angles[0],p_out.p.data,p_out.M.data);
+
+    poses.resize(1);
+    tf::poseKDLToMsg(p_out,poses[0]);
+    return true;
+  }
+
+  // Any other subset of the chain comes from one pass over all links
+  std::vector<int> link_indices(link_names.size());
+  for(size_t i = 0; i < link_names.size(); ++i)
+  {
+    std::vector<std::string>::const_iterator it = std::find(link_names_.begin(), link_names_.end(), link_names[i]);
+    if(it == link_names_.end())
+    {
+      ROS_ERROR_NAMED("ikfast","Can compute FK for the links between %s and %s only",getBaseFrame().c_str(),getTipFrame().c_str());
+      return false;
+    }
+    link_indices[i] = it - link_names_.begin();
+  }
+
+  std::vector<double> transforms(12 * link_names_.size());
+  if(!getChainFK(&joint_angles[0], &transforms[0]))
+    return false;
+
+  poses.resize(link_names.size());
+  for(size_t i = 0; i < link_names.size(); ++i)
+  {
+    const double *t = &transforms[12 * link_indices[i]];
+    p_out.M = KDL::Rotation(t[0], t[1], t[2], t[4], t[5], t[6], t[8], t[9], t[10]);
+    p_out.p = KDL::Vector(t[3], t[7], t[11]);
+    tf::poseKDLToMsg(p_out,poses[i]);
+  }
+
+  return true;
+}
+
+bool IKFastKinematicsPlugin::getPositionFK(const double *joint_angles, double *transform) const
+{
+  if (GetIkType() != IKP_Transform6D)
+  {
+    ROS_ERROR_NAMED("ikfast", "Can only compute FK for Transform6D IK type!");
+    return false;
+  }
+
+  IkReal eerot[9],eetrans[3];
+
+  // IKFast56/61
+  ComputeFk(joint_angles,eetrans,eerot);
+
+  for(int r = 0; r < 3; ++r)
+  {
+    transform[4*r] = eerot[3*r];
+    transform[4*r + 1] = eerot[3*r + 1];
+    transform[4*r + 2] = eerot[3*r + 2];
+    transform[4*r + 3] = eetrans[r];
+  }
+  return true;
+}
+
+bool IKFastKinematicsPlugin::getPositionFK(const double *joint_angles, Eigen::Isometry3d &pose) const
+{
+  if (GetIkType() != IKP_Transform6D)
+  {
+    ROS_ERROR_NAMED("ikfast", "Can only compute FK for Transform6D IK type!");
+    return false;
+  }
+
+  IkReal eerot[9],eetrans[3];
+
+  // IKFast56/61
+  ComputeFk(joint_angles,eetrans,eerot);
+
+  pose.linear() = Eigen::Map<const Eigen::Matrix<IkReal,3,3,Eigen::RowMajor> >(eerot);
+  pose.translation() = Eigen::Map<const Eigen::Matrix<IkReal,3,1> >(eetrans);
+  pose.makeAffine();
+  return true;
+}
+
+bool IKFastKinematicsPlugin::getPositionFK(const double *joint_angles, std::size_t count, double *transforms) const
+{
+  if (GetIkType() != IKP_Transform6D)
+  {
+    ROS_ERROR_NAMED("ikfast", "Can only compute FK for Transform6D IK type!");
+    return false;
+  }
+
+  for(std::size_t i = 0; i < count; ++i)
+    getPositionFK(joint_angles + i*num_joints_, transforms + i*12);
+
+  return true;
+}
+
+bool IKFastKinematicsPlugin::getChainFK(const double *joint_angles, double *transforms) const
+{
+  if(chain_segments_.empty())
+  {
+    ROS_ERROR_NAMED("ikfast","The links of the chain couldn't be read from the URDF");
+    return false;
+  }
+
+  // Each link pose extends the one of its parent, so every joint is visited once
+  Eigen::Isometry3d pose = Eigen::Isometry3d::Identity();
+  for(std::size_t i = 0; i < chain_segments_.size(); ++i)
+  {
+    const ChainSegment &segment = chain_segments_[i];
+    pose = pose * segment.origin;
+    if(segment.joint_index >= 0)
+    {
+      const double q = joint_angles[segment.joint_index];
+      if(segment.prismatic)
+        pose.translate(q * segment.axis);
+      else
+        pose.rotate(Eigen::AngleAxisd(q, segment.axis));
+    }
+
+    Eigen::Map<Eigen::Matrix<double,3,4,Eigen::RowMajor> > transform(transforms + 12*i);
+    transform = pose.affine();
+  }
+  return true;
+}
+
+bool IKFastKinematicsPlugin::getChainFK(const double *joint_angles, std::size_t count, double *transforms) const
+{
+  if(chain_segments_.empty())
+  {
+    ROS_ERROR_NAMED("ikfast","The links of the chain couldn't be read from the URDF");
+    return false;
+  }
+
+  const std::size_t stride = 12 * chain_segments_.size();
+  for(std::size_t i = 0; i < count; ++i)
+    getChainFK(joint_angles + i*num_joints_, transforms + i*stride);
+
+  return true;
+}
+
+bool IKFastKinematicsPlugin::getJacobian(const double *joint_angles, double *jacobian) const
+{
+  if(chain_segments_.empty())
+  {
+    ROS_ERROR_NAMED("ikfast","The links of the chain couldn't be read from the URDF");
+    return false;
+  }
+
+  typedef Eigen::Matrix<double,6,1> Column;
+
+  // First pass stores the joint origin in the linear part of each column, it's replaced
+  // by the velocity of the tip origin once the tip position is known
+  Eigen::Isometry3d pose = Eigen::Isometry3d::Identity();
+  for(std::size_t i = 0; i < chain_segments_.size(); ++i)
+  {
+    const ChainSegment &segment = chain_segments_[i];
+    pose = pose * segment.origin;
+    if(segment.joint_index < 0)
+      continue;
+
+    Eigen::Map<Column> column(jacobian + 6*segment.joint_index);
+    const double q = joint_angles[segment.joint_index];
+    const Eigen::Vector3d axis = pose.linear() * segment.axis;
+    if(segment.prismatic)
+    {
+      column << axis, Eigen::Vector3d::Zero();
+      pose.translate(q * segment.axis);
+    }
+    else
+    {
+      column << pose.translation(), axis;
+      pose.rotate(Eigen::AngleAxisd(q, segment.axis));
+    }
+  }
+
+  const Eigen::Vector3d tip = pose.translation();
+  for(std::size_t i = 0; i < chain_segments_.size(); ++i)
+  {
+    const ChainSegment &segment = chain_segments_[i];
+    if(segment.joint_index < 0 || segment.prismatic)
+      continue;
+
+    Eigen::Map<Column> column(jacobian + 6*segment.joint_index);
+    column.head<3>() = column.tail<3>().cross(tip - column.head<3>());
+  }
+  return true;
+}
+
+bool IKFastKinematicsPlugin::getJacobian(const double *joint_angles, std::size_t count, double *jacobians) const
 {
-  if (GetIkType() != IKP_Transform6D) {
-    // ComputeFk() is the inverse function of ComputeIk(), so the format of
-    // eerot differs depending on IK type. The Transform6D IK type is the only
-    // one for which a 3x3 rotation matrix is returned, which means we can only
-    // compute FK for that IK type.
-    ROS_ERROR_NAMED("ikfast", "Can only compute FK for Transform6D IK type!");
+  if(chain_segments_.empty())
+  {
+    ROS_ERROR_NAMED("ikfast","The links of the chain couldn't be read from the URDF");
     return false;
   }
 
-  KDL::Frame p_out;
-  if(link_names.size() == 0) {
-    ROS_WARN_STREAM_NAMED("ikfast","Link names with nothing");
-    return false;
-  }
+  for(std::size_t i = 0; i < count; ++i)
+    getJacobian(joint_angles + i*num_joints_, jacobians + i*6*num_joints_);
+
+  return true;
+}
 
-  if(link_names.size()!=1 || link_names[0]!=getTipFrame()){
-    ROS_ERROR_NAMED("ikfast","Can compute FK for %s only",getTipFrame().c_str());
+bool IKFastKinematicsPlugin::getManipulability(const double *joint_angles, double &manipulability) const
+{
+  double buffer[6*MAX_CHAIN_JOINTS];
+  if(!getJacobian(joint_angles, buffer))
     return false;
-  }
 
-  bool valid = true;
+  Eigen::Map<const Eigen::Matrix<double,6,Eigen::Dynamic> > jacobian(buffer, 6, num_joints_);
+  Eigen::Matrix<double,6,6> jjt;
+  jjt.noalias() = jacobian.lazyProduct(jacobian.transpose());
 
-  IkReal eerot[9],eetrans[3];
-  IkReal angles[joint_angles.size()];
-  for (unsigned char i=0; i < joint_angles.size(); i++)
-    angles[i] = joint_angles[i];
+  // J*J^T is positive semi-definite, rounding can make the determinant slightly negative at singularities
+  manipulability = std::sqrt(std::max(jjt.determinant(), 0.0));
+  return true;
+}
 
-  // IKFast56/61
-  ComputeFk(angles,eetrans,eerot);
+bool IKFastKinematicsPlugin::getManipulability(const double *joint_angles, std::size_t count, double *manipulability) const
+{
+  if(chain_segments_.empty())
+  {
+    ROS_ERROR_NAMED("ikfast","The links of the chain couldn't be read from the URDF");
+    return false;
+  }
 
-  for(int i=0; i<3;++i)
-    p_out.p.data[i] = eetrans[i];
+  for(std::size_t i = 0; i < count; ++i)
+    getManipulability(joint_angles + i*num_joints_, manipulability[i]);
+
+  return true;
+}
 
-  for(int i=0; i<9;++i)
-    p_out.M.data[i] = eerot[i];
+bool IKFastKinematicsPlugin::getVelocityIK(const double *joint_angles, const double *twist, double damping,
+                                           double *joint_velocities) const
+{
+  double buffer[6*MAX_CHAIN_JOINTS];
+  if(!getJacobian(joint_angles, buffer))
+    return false;
 
-  poses.resize(1);
-  tf::poseKDLToMsg(p_out,poses[0]);
+  Eigen::Map<const Eigen::Matrix<double,6,Eigen::Dynamic> > jacobian(buffer, 6, num_joints_);
+  Eigen::Matrix<double,6,6> jjt;
+  jjt.noalias() = jacobian.lazyProduct(jacobian.transpose());
+  jjt.diagonal().array() += damping * damping;
 
-  return valid;
+  const Eigen::Matrix<double,6,1> y = jjt.ldlt().solve(Eigen::Map<const Eigen::Matrix<double,6,1> >(twist));
+  Eigen::Map<Eigen::VectorXd> qdot(joint_velocities, num_joints_);
+  qdot.noalias() = jacobian.transpose().lazyProduct(y);
+  return true;
 }
 
 bool IKFastKinematicsPlugin::searchPositionIK(const geometry_msgs::Pose &ik_pose,
@@ -780,44 +2156,91 @@ bool IKFastKinematicsPlugin::searchPositionIK(const geometry_msgs::Pose &ik_pose
                                               moveit_msgs::MoveItErrorCodes &error_code,
                                               const kinematics::KinematicsQueryOptions &options) const
 {
-  ROS_DEBUG_STREAM_NAMED("ikfast","searchPositionIK");
+  return searchPositionIK(ik_pose, ik_seed_state, timeout, consistency_limits, solution, solution_callback, NULL,
+                          error_code, NULL, options);
+}
 
-  /// search_mode is currently fixed during code generation
-  SEARCH_MODE search_mode = OPTIMIZE_MAX_JOINT;
+bool IKFastKinematicsPlugin::searchPositionIK(const geometry_msgs::Pose &ik_pose,
+                                              const std::vector<double> &ik_seed_state,
+                                              double timeout,
+                                              const std::vector<double> &consistency_limits,
+                                              std::vector<double> &solution,
+                                              const BatchIKCallbackFn &batch_callback,
+                                              moveit_msgs::MoveItErrorCodes &error_code,
+                                              const kinematics::KinematicsQueryOptions &options) const
+{
+  const IKCallbackFn solution_callback = 0;
+  return searchPositionIK(ik_pose, ik_seed_state, timeout, consistency_limits, solution, solution_callback,
+                          batch_callback.empty() ? NULL : &batch_callback, error_code, NULL, options);
+}
 
-  // Check if there are no redundant joints
-  if(free_params_.size()==0)
-  {
-    ROS_DEBUG_STREAM_NAMED("ikfast","No need to search since no free params/redundant joints");
+bool IKFastKinematicsPlugin::searchPositionIK(const geometry_msgs::Pose &ik_pose,
+                                              const std::vector<double> &ik_seed_state,
+                                              double timeout,
+                                              const std::vector<double> &consistency_limits,
+                                              std::vector<double> &solution,
+                                              const IKCallbackFn &solution_callback,
+                                              moveit_msgs::MoveItErrorCodes &error_code,
+                                              bool &definitive,
+                                              const kinematics::KinematicsQueryOptions &options) const
+{
+  return searchPositionIK(ik_pose, ik_seed_state, timeout, consistency_limits, solution, solution_callback, NULL,
+                          error_code, &definitive, options);
+}
 
-    // Find first IK solution, within joint limits
-    if(!getPositionIK(ik_pose, ik_seed_state, solution, error_code))
+bool IKFastKinematicsPlugin::searchPositionIKWithRestarts(const geometry_msgs::Pose &ik_pose,
+                                                          const std::vector<double> &ik_seed_state,
+                                                          double timeout,
+                                                          const std::vector<double> &consistency_limits,
+                                                          std::vector<double> &solution,
+                                                          const IKCallbackFn &solution_callback,
+                                                          moveit_msgs::MoveItErrorCodes &error_code,
+                                                          unsigned int attempts,
+                                                          const kinematics::KinematicsQueryOptions &options) const
+{
+  // A generator per call keeps concurrent queries from sharing the state of std::rand()
+  boost::random::mt19937 generator(static_cast<boost::uint32_t>(ros::WallTime::now().toNSec()));
+  std::vector<double> seed = ik_seed_state;
+  error_code.val = moveit_msgs::MoveItErrorCodes::NO_IK_SOLUTION;
+  for(unsigned int attempt = 0; attempt < attempts; ++attempt)
+  {
+    if(attempt > 0)
     {
-      ROS_DEBUG_STREAM_NAMED("ikfast","No solution whatsoever");
-      error_code.val = moveit_msgs::MoveItErrorCodes::NO_IK_SOLUTION;
-      return false;
+      for(std::size_t i = 0; i < num_joints_ && i < seed.size(); ++i)
+        seed[i] = boost::random::uniform_real_distribution<double>(joint_min_vector_[i], joint_max_vector_[i])(generator);
     }
 
-    // check for collisions if a callback is provided
-    if( !solution_callback.empty() )
-    {
-      solution_callback(ik_pose, solution, error_code);
-      if(error_code.val == moveit_msgs::MoveItErrorCodes::SUCCESS)
-      {
-        ROS_DEBUG_STREAM_NAMED("ikfast","Solution passes callback");
-        return true;
-      }
-      else
-      {
-        ROS_DEBUG_STREAM_NAMED("ikfast","Solution has error code " << error_code);
-        return false;
-      }
-    }
-    else
+    bool definitive = false;
+    if(searchPositionIK(ik_pose, seed, timeout, consistency_limits, solution, solution_callback, NULL, error_code,
+                        &definitive, options))
+      return true;
+    if(definitive)
     {
-      return true; // no collision check callback provided
+      ROS_DEBUG_STREAM_NAMED("ikfast","No solution after " << attempt + 1 << " of " << attempts << " attempts, skipping the rest");
+      break;
     }
   }
+  return false;
+}
+
+bool IKFastKinematicsPlugin::searchPositionIK(const geometry_msgs::Pose &ik_pose,
+                                              const std::vector<double> &ik_seed_state,
+                                              double timeout,
+                                              const std::vector<double> &consistency_limits,
+                                              std::vector<double> &solution,
+                                              const IKCallbackFn &solution_callback,
+                                              const BatchIKCallbackFn *batch_callback,
+                                              moveit_msgs::MoveItErrorCodes &error_code, bool *definitive,
+                                              const kinematics::KinematicsQueryOptions &options) const
+{
+  ROS_DEBUG_STREAM_NAMED("ikfast","searchPositionIK");
+  if(definitive != NULL)
+    *definitive = false;
+
+  /// search_mode is fixed at compile time, see IKFAST_SEARCH_MODE
+  const SEARCH_MODE search_mode = static_cast<SEARCH_MODE>(IKFAST_SEARCH_MODE);
+
+  QueryTrace trace(ikfast_trace::SEARCH_POSITION_IK, ik_pose);
 
   // -------------------------------------------------------------------------------------------------
   // Error Checking
@@ -849,6 +2272,48 @@ bool IKFastKinematicsPlugin::searchPositionIK(const geometry_msgs::Pose &ik_pose
   KDL::Frame frame;
   tf::poseMsgToKDL(ik_pose,frame);
 
+  // the pose terms of the solver are computed once and reused for every free joint increment
+  IkPreparedPose context;
+  if(!prepare(frame, context))
+  {
+    error_code.val = moveit_msgs::MoveItErrorCodes::NO_IK_SOLUTION;
+    return false;
+  }
+
+  // The free joint sweeps below step from the seed, so another seed samples other free joint values and may
+  // succeed where they failed, their failures are never definitive
+  if(free_params_.size() > 1)
+    return searchFreeSpace(ik_pose, ik_seed_state, timeout, consistency_limits, context, solution,
+                           solution_callback, batch_callback, error_code, trace);
+
+  if(free_params_.empty())
+  {
+    // No need to search without free params/redundant joints, all solutions of the pose are ranked by cost with or
+    // without a callback, and checked by increasing cost or with a single call of the batch callback
+    const SearchCost cost(getCostContext(ik_seed_state));
+    SearchSolutionVisitor<SearchCost> visitor(ik_pose, solution_callback, search_mode, cost, solution, error_code,
+                                              batch_callback);
+    visitor.useMemo(&callback_memo_, callback_memo_.configured() ? callback_memo_.getSceneVersion() : 0);
+    std::vector<double> vfree;
+    trace.num_solutions = solveWithFree(context, vfree, solver_limits_, visitor);
+    trace.num_solver_calls++;
+    visitor.evaluate();
+    ROS_DEBUG_STREAM_NAMED("ikfast", "Valid solutions: " << visitor.nvalid << "/" << visitor.nattempts);
+
+    if(!visitor.found && visitor.best_solution.empty())
+    {
+      error_code.val = moveit_msgs::MoveItErrorCodes::NO_IK_SOLUTION;
+      if(definitive != NULL)
+        *definitive = true;
+      return false;
+    }
+    if(!visitor.found)
+      solution = visitor.best_solution;
+    error_code.val = error_code.SUCCESS;
+    trace.solved = true;
+    return true;
+  }
+
   std::vector<double> vfree(free_params_.size());
 
   ros::Time maxTime = ros::Time::now() + ros::Duration(timeout);
@@ -882,106 +2347,239 @@ bool IKFastKinematicsPlugin::searchPositionIK(const geometry_msgs::Pose &ik_pose
   // Begin searching
 
   ROS_DEBUG_STREAM_NAMED("ikfast","Free param is " << free_params_[0] << " initial guess is " << initial_guess << ", # positive increments: " << num_positive_increments << ", # negative increments: " << num_negative_increments);
-  if ((search_mode & OPTIMIZE_MAX_JOINT) && (num_positive_increments + num_negative_increments) > 1000)
-      ROS_WARN_STREAM_ONCE_NAMED("ikfast", "Large search space, consider increasing the search discretization");
-  
-  double best_costs = -1.0;
-  std::vector<double> best_solution;
-  int nattempts = 0, nvalid = 0;
+  // branches outside of the joint limits are pruned inside the solver, and in OPTIMIZE_FREE_JOINT
+  // mode the enumeration stops at the first feasible solution
+  const SearchCost cost(getCostContext(ik_seed_state));
+  SearchSolutionVisitor<SearchCost> visitor(ik_pose, solution_callback, search_mode, cost, solution, error_code,
+                                            batch_callback);
+  visitor.useMemo(&callback_memo_, callback_memo_.configured() ? callback_memo_.getSceneVersion() : 0);
+
+  // Branch and bound of OPTIMIZE_MAX_JOINT: a candidate costs at least the scaled motion of any of its
+  // joints and only candidates cheaper than best_costs are accepted. So once a solution is found the
+  // solver prunes every branch moving a joint by more than best_costs, and the sweep stops at the first
+  // increment whose free joint motion alone reaches best_costs, getCount() never moves closer to the seed
+  // again. LIMIT_TOLERANCE keeps rounding from pruning a candidate the cost would have accepted.
+  const bool bound_search = search_mode == OPTIMIZE_MAX_JOINT;
+  const double free_scale = max_joint_scales_[free_params_[0]];
+  JointLimitsTable limits = solver_limits_;
+  std::vector<double> radius(num_joints_);
+  double bounded_costs = std::numeric_limits<double>::infinity();
+
+  // The free joint values that solved poses of the same cell are probed before the sweep, which then
+  // skips them, so the same increments are searched in a different order
+  uint64_t prior_cell = 0;
+  int probes[MAX_PRIOR_PROBES];
+  int num_probes = 0;
+  if(free_joint_prior_.configured())
+  {
+    double pose[7] = {ik_pose.position.x, ik_pose.position.y, ik_pose.position.z, ik_pose.orientation.x,
+                      ik_pose.orientation.y, ik_pose.orientation.z, ik_pose.orientation.w};
+    prior_cell = free_joint_prior_.cell(pose);
+    double values[MAX_PRIOR_PROBES];
+    int num_values = free_joint_prior_.mostFrequent(prior_cell, values, MAX_PRIOR_PROBES);
+    for(int i = 0; i < num_values; ++i)
+    {
+      int count = (int)floor((values[i] - initial_guess) / search_discretization_ + 0.5);
+      count = std::max(-num_negative_increments, std::min(count, num_positive_increments));
+      if(std::find(probes, probes + num_probes, count) == probes + num_probes)
+        probes[num_probes++] = count;
+    }
+  }
+  int probe = 0;
+  counter = num_probes > 0 ? probes[0] : 0;
+  vfree[0] = initial_guess+search_discretization_*counter;
 
   while(true)
   {
-    IkSolutionList<IkReal> solutions;
-    int numsol = solve(frame,vfree, solutions);
-
-    ROS_DEBUG_STREAM_NAMED("ikfast","Found " << numsol << " solutions from IKFast");
-
-    //ROS_INFO("%f",vfree[0]);
-
-    if( numsol > 0 )
+    if(bound_search && visitor.best_costs < bounded_costs)
     {
-      for(int s = 0; s < numsol; ++s)
-      {
-        nattempts++;
-        std::vector<double> sol;
-        getSolution(solutions,s,sol);
+      bounded_costs = visitor.best_costs;
+      for(size_t j = 0; j < num_joints_; ++j)
+        radius[j] = bounded_costs / max_joint_scales_[j] + LIMIT_TOLERANCE;
+      limits.narrow(&ik_seed_state[0], &radius[0]);
+    }
 
-        bool obeys_limits = true;
-        for(unsigned int i = 0; i < sol.size(); i++)
-        {
-          if(joint_has_limits_vector_[i] && (sol[i] < joint_min_vector_[i] || sol[i] > joint_max_vector_[i]))
-          {
-            obeys_limits = false;
-            break;
-          }
-          //ROS_INFO_STREAM_NAMED("ikfast","Num " << i << " value " << sol[i] << " has limits " << joint_has_limits_vector_[i] << " " << joint_min_vector_[i] << " " << joint_max_vector_[i]);
-        }
-        if(obeys_limits)
-        {
-          getSolution(solutions,s,solution);
+    int numsol = solveWithFree(context, vfree, limits, visitor);
+    visitor.evaluate();
+    trace.num_solver_calls++;
+    trace.num_solutions += numsol;
 
-          // This solution is within joint limits, now check if in collision (if callback provided)
-          if(!solution_callback.empty())
-          {
-            solution_callback(ik_pose, solution, error_code);
-          }
-          else
-          {
-            error_code.val = error_code.SUCCESS;
-          }
+    if(IKFAST_TRACE_ENABLED(ikfast_trace::TRACE_SEARCH))
+      ikfast_trace::record(ikfast_trace::SOLVER_RESULT, numsol);
 
-          if(error_code.val == error_code.SUCCESS)
-          {
-            nvalid++;
-            if (search_mode & OPTIMIZE_MAX_JOINT)
-            {
-              // Costs for solution: Largest joint motion
-              double costs = 0.0;
-              for(unsigned int i = 0; i < solution.size(); i++)
-              {
-                double d = fabs(ik_seed_state[i] - solution[i]);
-                if (d > costs)
-                  costs = d;
-              }
-              if (costs < best_costs || best_costs == -1.0)
-              {
-                best_costs = costs;
-                best_solution = solution;
-              }
-            }
-            else
-              // Return first feasible solution
-              return true;
-          }
-        }
-      }
+    if(visitor.found)
+    {
+      // Return first feasible solution
+      if(free_joint_prior_.configured())
+        free_joint_prior_.record(prior_cell, solution[free_params_[0]]);
+      trace.solved = true;
+      return true;
     }
 
-    if(!getCount(counter, num_positive_increments, -num_negative_increments))
+    if(!getNextCount(counter, probe, probes, num_probes, num_positive_increments, -num_negative_increments))
     {
       // Everything searched
       error_code.val = moveit_msgs::MoveItErrorCodes::NO_IK_SOLUTION;
       break;
     }
 
+    if(bound_search && probe == num_probes &&
+       (search_discretization_*std::abs(counter) - LIMIT_TOLERANCE) * free_scale >= visitor.best_costs)
+    {
+      // No remaining increment can improve on the best solution
+      break;
+    }
+
     vfree[0] = initial_guess+search_discretization_*counter;
-    //ROS_DEBUG_STREAM_NAMED("ikfast","Attempt " << counter << " with 0th free joint having value " << vfree[0]);
+    if(IKFAST_TRACE_ENABLED(ikfast_trace::TRACE_SEARCH))
+      ikfast_trace::record(ikfast_trace::FREE_JOINT_STEP, counter, &vfree[0], vfree.size());
   }
 
-  ROS_DEBUG_STREAM_NAMED("ikfast", "Valid solutions: " << nvalid << "/" << nattempts);
+  ROS_DEBUG_STREAM_NAMED("ikfast", "Valid solutions: " << visitor.nvalid << "/" << visitor.nattempts);
 
-  if ((search_mode & OPTIMIZE_MAX_JOINT) && best_costs != -1.0)
+  if (search_mode != OPTIMIZE_FREE_JOINT && !visitor.best_solution.empty())
   {
-    solution = best_solution;
+    solution = visitor.best_solution;
     error_code.val = error_code.SUCCESS;
+    if(free_joint_prior_.configured())
+      free_joint_prior_.record(prior_cell, solution[free_params_[0]]);
+    trace.solved = true;
     return true;
   }
 
-  // No solution found
+  // No solution found at the free joint values stepped from the seed
   error_code.val = moveit_msgs::MoveItErrorCodes::NO_IK_SOLUTION;
   return false;
 }
 
+bool IKFastKinematicsPlugin::searchFreeSpace(const geometry_msgs::Pose &ik_pose, const std::vector<double> &ik_seed_state,
+                                             double timeout, const std::vector<double> &consistency_limits,
+                                             IkPreparedPose &context, std::vector<double> &solution,
+                                             const IKCallbackFn &solution_callback,
+                                             const BatchIKCallbackFn *batch_callback,
+                                             moveit_msgs::MoveItErrorCodes &error_code, QueryTrace &trace) const
+{
+  const SEARCH_MODE search_mode = static_cast<SEARCH_MODE>(IKFAST_SEARCH_MODE);
+  const std::size_t num_free = free_params_.size();
+  ros::Time max_time = ros::Time::now() + ros::Duration(timeout);
+
+  // the increments of each free joint within its limits, and its consistency limits if given
+  std::vector<int> min_counts(num_free), max_counts(num_free);
+  int num_shells = 0;
+  double free_scale = std::numeric_limits<double>::infinity();
+  for(std::size_t i = 0; i < num_free; ++i)
+  {
+    int p = free_params_[i];
+    double max_limit = joint_max_vector_[p];
+    double min_limit = joint_min_vector_[p];
+    if(!consistency_limits.empty())
+    {
+      max_limit = fmin(max_limit, ik_seed_state[p] + consistency_limits[p]);
+      min_limit = fmax(min_limit, ik_seed_state[p] - consistency_limits[p]);
+    }
+    max_counts[i] = std::max(0, (int)((max_limit - ik_seed_state[p]) / search_discretization_));
+    min_counts[i] = -std::max(0, (int)((ik_seed_state[p] - min_limit) / search_discretization_));
+    num_shells = std::max(num_shells, std::max(max_counts[i], -min_counts[i]) + 1);
+    free_scale = std::min(free_scale, max_joint_scales_[p]);
+  }
+
+  ROS_DEBUG_STREAM_NAMED("ikfast","Searching " << num_free << " free params in " << num_shells << " shells");
+  const SearchCost cost(getCostContext(ik_seed_state));
+  SearchSolutionVisitor<SearchCost> visitor(ik_pose, solution_callback, search_mode, cost, solution, error_code,
+                                            batch_callback);
+  visitor.useMemo(&callback_memo_, callback_memo_.configured() ? callback_memo_.getSceneVersion() : 0);
+
+  // Branch and bound of OPTIMIZE_MAX_JOINT as in searchPositionIK(), every point of shell r moves one of the
+  // free joints by r increments
+  const bool bound_search = search_mode == OPTIMIZE_MAX_JOINT;
+  JointLimitsTable limits = solver_limits_;
+  std::vector<double> radius(num_joints_);
+  double bounded_costs = std::numeric_limits<double>::infinity();
+
+  std::vector<int> counts;
+  std::vector<double> free_values;
+  std::vector<BatchSolutionsVisitor> chunks;
+  bool timed_out = false;
+  for(int shell = 0; shell < num_shells; ++shell)
+  {
+    if(bound_search && (search_discretization_*shell - LIMIT_TOLERANCE) * free_scale >= visitor.best_costs)
+    {
+      // No remaining shell can improve on the best solution
+      break;
+    }
+
+    if(shell > 0 && ros::Time::now() > max_time)
+    {
+      timed_out = true;
+      break;
+    }
+
+    if(bound_search && visitor.best_costs < bounded_costs)
+    {
+      bounded_costs = visitor.best_costs;
+      for(size_t j = 0; j < num_joints_; ++j)
+        radius[j] = bounded_costs / max_joint_scales_[j] + LIMIT_TOLERANCE;
+      limits.narrow(&ik_seed_state[0], &radius[0]);
+    }
+
+    getFreeShell(shell, min_counts, max_counts, counts);
+    free_values.resize(counts.size());
+    for(std::size_t i = 0; i < counts.size(); ++i)
+      free_values[i] = ik_seed_state[free_params_[i % num_free]] + search_discretization_ * counts[i];
+    solveBatch(context, free_values, limits, chunks);
+
+    // evaluated point by point in shell order, as if solved one after the other, or all at once with a batch callback
+    std::size_t point = 0;
+    for(std::size_t c = 0; c < chunks.size(); ++c)
+    {
+      const BatchSolutionsVisitor &chunk = chunks[c];
+      for(std::size_t j = 0, begin = 0; j < chunk.ends.size(); begin = chunk.ends[j++], ++point)
+      {
+        for(std::size_t k = begin; k < chunk.ends[j] && !visitor.found; k += num_joints_)
+          visitor.add(&chunk.candidates[k], num_joints_);
+        if(batch_callback == NULL)
+          visitor.evaluate();
+
+        int numsol = (chunk.ends[j] - begin) / num_joints_;
+        trace.num_solver_calls++;
+        trace.num_solutions += numsol;
+        if(IKFAST_TRACE_ENABLED(ikfast_trace::TRACE_SEARCH))
+        {
+          ikfast_trace::record(ikfast_trace::FREE_JOINT_STEP, shell, &free_values[point * num_free], num_free);
+          ikfast_trace::record(ikfast_trace::SOLVER_RESULT, numsol);
+        }
+
+        if(visitor.found)
+        {
+          // Return first feasible solution
+          trace.solved = true;
+          return true;
+        }
+      }
+    }
+
+    visitor.evaluate();
+    if(visitor.found)
+    {
+      trace.solved = true;
+      return true;
+    }
+  }
+
+  ROS_DEBUG_STREAM_NAMED("ikfast", "Valid solutions: " << visitor.nvalid << "/" << visitor.nattempts);
+
+  if (search_mode != OPTIMIZE_FREE_JOINT && !visitor.best_solution.empty())
+  {
+    solution = visitor.best_solution;
+    error_code.val = error_code.SUCCESS;
+    trace.solved = true;
+    return true;
+  }
+
+  error_code.val = timed_out ? moveit_msgs::MoveItErrorCodes::TIMED_OUT : moveit_msgs::MoveItErrorCodes::NO_IK_SOLUTION;
+  return false;
+}
+
 // Used when there are no redundant joints - aka no free params
 bool IKFastKinematicsPlugin::getPositionIK(const geometry_msgs::Pose &ik_pose,
                                            const std::vector<double> &ik_seed_state,
@@ -990,6 +2588,7 @@ bool IKFastKinematicsPlugin::getPositionIK(const geometry_msgs::Pose &ik_pose,
                                            const kinematics::KinematicsQueryOptions &options) const
 {
   ROS_DEBUG_STREAM_NAMED("ikfast","getPositionIK");
+  QueryTrace trace(ikfast_trace::GET_POSITION_IK, ik_pose);
 
   if(!active_)
   {
@@ -1008,46 +2607,28 @@ bool IKFastKinematicsPlugin::getPositionIK(const geometry_msgs::Pose &ik_pose,
   KDL::Frame frame;
   tf::poseMsgToKDL(ik_pose,frame);
 
-  IkSolutionList<IkReal> solutions;
-  int numsol = solve(frame,vfree,solutions);
-
-  ROS_DEBUG_STREAM_NAMED("ikfast","Found " << numsol << " solutions from IKFast");
-
-  if(numsol)
+  IkPreparedPose context;
+  if(!prepare(frame, context))
   {
-    for(int s = 0; s < numsol; ++s)
-    {
-      std::vector<double> sol;
-      getSolution(solutions,s,sol);
-      ROS_DEBUG_NAMED("ikfast","Sol %d: %e   %e   %e   %e   %e   %e", s, sol[0], sol[1], sol[2], sol[3], sol[4], sol[5]);
-
-      bool obeys_limits = true;
-      for(unsigned int i = 0; i < sol.size(); i++)
-      {
-        // Add tolerance to limit check
-        if(joint_has_limits_vector_[i] && ( (sol[i] < (joint_min_vector_[i]-LIMIT_TOLERANCE)) ||
-                                            (sol[i] > (joint_max_vector_[i]+LIMIT_TOLERANCE)) ) )
-        {
-          // One element of solution is not within limits
-          obeys_limits = false;
-          ROS_DEBUG_STREAM_NAMED("ikfast","Not in limits! " << i << " value " << sol[i] << " has limit: " << joint_has_limits_vector_[i] << "  being  " << joint_min_vector_[i] << " to " << joint_max_vector_[i]);
-          break;
-        }
-      }
-      if(obeys_limits)
-      {
-        // All elements of solution obey limits
-        getSolution(solutions,s,solution);
-        error_code.val = moveit_msgs::MoveItErrorCodes::SUCCESS;
-        return true;
-      }
-    }
+    error_code.val = moveit_msgs::MoveItErrorCodes::NO_IK_SOLUTION;
+    return false;
   }
-  else
+
+  // Find the first IK solution within joint limits, the solver skips the branches outside of them
+  FirstSolutionVisitor visitor(solution);
+  solveWithFree(context, vfree, solver_limits_, visitor);
+  trace.num_solver_calls++;
+
+  if(visitor.found())
   {
-    ROS_DEBUG_STREAM_NAMED("ikfast","No IK solution");
+    // All elements of solution obey limits
+    error_code.val = moveit_msgs::MoveItErrorCodes::SUCCESS;
+    trace.solved = true;
+    trace.num_solutions = 1;
+    return true;
   }
 
+  ROS_DEBUG_STREAM_NAMED("ikfast","No IK solution within joint limits");
   error_code.val = moveit_msgs::MoveItErrorCodes::NO_IK_SOLUTION;
   return false;
 }
@@ -1057,6 +2638,35 @@ bool IKFastKinematicsPlugin::getPositionIK(const std::vector<geometry_msgs::Pose
                                            std::vector< std::vector<double> >& solutions,
                                            kinematics::KinematicsResult& result,
                                            const kinematics::KinematicsQueryOptions &options) const
+{
+  std::vector<ConfigurationId> configurations;
+  return getPositionIK(ik_poses, ik_seed_state, std::vector<int>(), solutions, configurations, result, options);
+}
+
+bool IKFastKinematicsPlugin::getPositionIK(const std::vector<geometry_msgs::Pose> &ik_poses,
+                                           const std::vector<double> &ik_seed_state,
+                                           const std::vector<int> &configuration,
+                                           std::vector< std::vector<double> >& solutions,
+                                           std::vector<ConfigurationId> &configurations,
+                                           kinematics::KinematicsResult& result,
+                                           const kinematics::KinematicsQueryOptions &options) const
+{
+  CollectSolutionsVisitor visitor(num_joints_, solutions, configurations);
+  if(!getPositionIK(ik_poses, ik_seed_state, configuration, visitor, 0, result, options))
+    return false;
+
+  if(IKFAST_SEARCH_MODE != OPTIMIZE_FREE_JOINT)
+    sortSolutions(SearchCost(getCostContext(ik_seed_state)), solutions, &configurations);
+  return true;
+}
+
+bool IKFastKinematicsPlugin::getPositionIK(const std::vector<geometry_msgs::Pose> &ik_poses,
+                                           const std::vector<double> &ik_seed_state,
+                                           const std::vector<int> &configuration,
+                                           SolutionStreamVisitor &solution_visitor,
+                                           std::size_t max_solutions,
+                                           kinematics::KinematicsResult& result,
+                                           const kinematics::KinematicsQueryOptions &options) const
 {
   ROS_DEBUG_STREAM_NAMED("ikfast","getPositionIK with multiple solutions");
 
@@ -1087,154 +2697,163 @@ bool IKFastKinematicsPlugin::getPositionIK(const std::vector<geometry_msgs::Pose
     return false;
   }
 
+  if(!isValidConfiguration(configuration))
+  {
+    ROS_WARN_STREAM_NAMED("ikfast","configuration roots must be -1 or below " << (1 << BRANCH_BITS));
+    result.kinematic_error = kinematics::KinematicErrors::NO_SOLUTION;
+    return false;
+  }
+
+  QueryTrace trace(ikfast_trace::GET_POSITION_IK_MULTIPLE, ik_poses[0]);
+
   KDL::Frame frame;
   tf::poseMsgToKDL(ik_poses[0],frame);
 
-  // solving ik
-  std::vector< IkSolutionList<IkReal> > solution_set;
-  IkSolutionList<IkReal> ik_solutions;
+  IkPreparedPose context;
+  if(!prepare(frame, context))
+  {
+    result.kinematic_error = kinematics::KinematicErrors::NO_SOLUTION;
+    return false;
+  }
+
+  // solving ik, the solver only returns the solutions within joint limits and in the configuration
+  JointLimitsTable limits = solver_limits_;
+  if(!configuration.empty())
+    limits.setConfiguration(configuration);
+  DuplicateFilter duplicates(duplicate_tolerance_);
+  StreamSolutionsVisitor visitor(solution_visitor, max_solutions > 0 ? max_solutions : (std::size_t)-1,
+                                 duplicate_tolerance_ > 0.0 ? &duplicates : NULL);
   std::vector<double> vfree;
-  int numsol = 0;
   std::vector<double> sampled_joint_vals;
   if(!redundant_joint_indices_.empty())
   {
     // initializing from seed
-    sampled_joint_vals.push_back(ik_seed_state[redundant_joint_indices_[0]]);
-
-    // checking joint limits when using no discretization
-    if(options.discretization_method == kinematics::DiscretizationMethods::NO_DISCRETIZATION &&
-        joint_has_limits_vector_[redundant_joint_indices_.front()])
+    const std::size_t num_redundant = redundant_joint_indices_.size();
+    for(std::size_t i = 0; i < num_redundant; ++i)
     {
-      double joint_min = joint_min_vector_[redundant_joint_indices_.front()];
-      double joint_max = joint_max_vector_[redundant_joint_indices_.front()];
+      sampled_joint_vals.push_back(ik_seed_state[redundant_joint_indices_[i]]);
 
-      double jv = sampled_joint_vals[0];
-      if(!( (jv > (joint_min - LIMIT_TOLERANCE)) && (jv < (joint_max + LIMIT_TOLERANCE)) ))
+      // checking joint limits when using no discretization, joints without limits are unbounded in the table
+      if(options.discretization_method == kinematics::DiscretizationMethods::NO_DISCRETIZATION &&
+         !solver_limits_.withinLimits(redundant_joint_indices_[i], sampled_joint_vals[i]))
       {
         result.kinematic_error = kinematics::KinematicErrors::IK_SEED_OUTSIDE_LIMITS;
         ROS_ERROR_STREAM("ik seed is out of bounds");
         return false;
       }
-
     }
 
-
-    // computing all solutions sets for each sampled value of the redundant joint
+    // computing all solutions sets for each sampled value of the redundant joints
     if(!sampleRedundantJoint(options.discretization_method,sampled_joint_vals))
     {
       result.kinematic_error = kinematics::KinematicErrors::UNSUPORTED_DISCRETIZATION_REQUESTED;
       return false;
     }
 
-    for(unsigned int i = 0; i < sampled_joint_vals.size(); i++)
-    {
-      vfree.clear();
-      vfree.push_back(sampled_joint_vals[i]);
-      numsol += solve(frame,vfree,ik_solutions);
-      solution_set.push_back(ik_solutions);
-    }
-  }
-  else
-  {
-    // computing for single solution set
-    numsol = solve(frame,vfree,ik_solutions);
-    solution_set.push_back(ik_solutions);
-  }
-
-  ROS_DEBUG_STREAM_NAMED("ikfast","Found " << numsol << " solutions from IKFast");
-  bool solutions_found = false;
-  std::stringstream ss;
-  if( numsol > 0 )
-  {
-    for(unsigned int r = 0; r < solution_set.size() ; r++)
+    // the samples are solved a block at a time, in parallel for large blocks, and streamed in sample order
+    const std::size_t num_samples = sampled_joint_vals.size() / num_redundant;
+    const std::size_t block_size = std::max(STREAM_BLOCK_SOLVES, (std::size_t)search_threads_ * MIN_CHUNK_SOLVES);
+    std::vector<double> block;
+    std::vector<BatchSolutionsVisitor> chunks;
+    for(std::size_t sample = 0; sample < num_samples && !visitor.stopped;)
     {
+      const std::size_t block_end = std::min(num_samples, sample + block_size);
+      block.assign(sampled_joint_vals.begin() + sample * num_redundant, sampled_joint_vals.begin() + block_end * num_redundant);
+      solveBatch(context, block, limits, chunks);
 
-      ik_solutions = solution_set[r];
-      numsol = ik_solutions.GetNumSolutions();
-      for(int s = 0; s < numsol; ++s)
+      for(std::size_t c = 0; c < chunks.size() && !visitor.stopped; ++c)
       {
-        std::vector<double> sol;
-        getSolution(ik_solutions,s,sol);
-        ss.str("");
-        ss<<"[";
-        for(unsigned int i = 0 ; i < sol.size() ; i++)
+        const BatchSolutionsVisitor &chunk = chunks[c];
+        for(std::size_t j = 0, begin = 0; j < chunk.ends.size() && !visitor.stopped; begin = chunk.ends[j++], ++sample)
         {
-          ss<<sol[i]<<" ";
-        }
-        ss<<"]";
-        ROS_DEBUG_NAMED("ikfast","Sol %d: %s", s, ss.str().c_str());
+          for(std::size_t k = begin; k < chunk.ends[j] && visitor.add(&chunk.candidates[k], num_joints_,
+                                                                      chunk.configurations[k / num_joints_]);)
+            k += num_joints_;
+          trace.num_solver_calls++;
 
-        bool obeys_limits = true;
-        for(unsigned int i = 0; i < sol.size(); i++)
-        {
-          // Add tolerance to limit check
-          if(joint_has_limits_vector_[i] && ( (sol[i] < (joint_min_vector_[i]-LIMIT_TOLERANCE)) ||
-                                              (sol[i] > (joint_max_vector_[i]+LIMIT_TOLERANCE)) ) )
+          if(IKFAST_TRACE_ENABLED(ikfast_trace::TRACE_SEARCH))
           {
-            // One element of solution is not within limits
-            obeys_limits = false;
-            ROS_DEBUG_STREAM_NAMED("ikfast","Not in limits! " << i << " value " << sol[i] << " has limit: " << joint_has_limits_vector_[i] << "  being  " << joint_min_vector_[i] << " to " << joint_max_vector_[i]);
-            break;
+            ikfast_trace::record(ikfast_trace::FREE_JOINT_STEP, sample, &sampled_joint_vals[sample * num_redundant],
+                                 num_redundant);
+            ikfast_trace::record(ikfast_trace::SOLVER_RESULT, (chunk.ends[j] - begin) / num_joints_);
           }
         }
-        if(obeys_limits)
-        {
-          // All elements of solution obey limits
-          solutions_found = true;
-          solutions.push_back(sol);
-        }
       }
     }
-
-    if(solutions_found)
-    {
-      result.kinematic_error = kinematics::KinematicErrors::OK;
-      return true;
-    }
   }
   else
   {
-    ROS_DEBUG_STREAM_NAMED("ikfast","No IK solution");
+    // computing for single solution set
+    solveWithFree(context, vfree, limits, visitor);
+    trace.num_solver_calls++;
+  }
+  trace.num_solutions = visitor.count;
+
+  ROS_DEBUG_STREAM_NAMED("ikfast","Passed " << visitor.count << " solutions within limits from IKFast, dropped " <<
+                         visitor.num_duplicates << " duplicates");
+
+  if(visitor.count > 0)
+  {
+    result.kinematic_error = kinematics::KinematicErrors::OK;
+    trace.solved = true;
+    return true;
   }
 
+  ROS_DEBUG_STREAM_NAMED("ikfast","No IK solution");
   result.kinematic_error = kinematics::KinematicErrors::NO_SOLUTION;
   return false;
 }
 
 bool IKFastKinematicsPlugin::sampleRedundantJoint(kinematics::DiscretizationMethod method, std::vector<double>& sampled_joint_vals) const
 {
-  double joint_min = -M_PI;
-  double joint_max = M_PI;
-  int index =  redundant_joint_indices_.front();
-  double joint_dscrt = redundant_joint_discretization_.at(index);
-
-  if(joint_has_limits_vector_[redundant_joint_indices_.front()])
+  const std::size_t num_redundant = redundant_joint_indices_.size();
+  std::vector<double> joint_min(num_redundant, -M_PI);
+  std::vector<double> joint_max(num_redundant, M_PI);
+  std::vector<int> steps(num_redundant);
+  std::size_t num_samples = 1;
+  for(std::size_t i = 0; i < num_redundant; ++i)
   {
-    joint_min = joint_min_vector_[index];
-    joint_max = joint_max_vector_[index];
+    int index = redundant_joint_indices_[i];
+    if(joint_has_limits_vector_[index])
+    {
+      joint_min[i] = joint_min_vector_[index];
+      joint_max[i] = joint_max_vector_[index];
+    }
+    steps[i] = std::max((int)std::ceil((joint_max[i] - joint_min[i])/redundant_joint_discretization_.at(index)), 1);
+    num_samples *= steps[i];
   }
 
-
   switch(method)
   {
     case kinematics::DiscretizationMethods::ALL_DISCRETIZED:
     {
-      int steps = std::ceil((joint_max - joint_min)/joint_dscrt);
-      for(unsigned int i = 0; i < steps;i++)
+      // every combination of the discretized values of the redundant joints, the last one varies fastest
+      std::vector<int> step(num_redundant, 0);
+      while(true)
       {
-        sampled_joint_vals.push_back(joint_min + joint_dscrt*i);
+        for(std::size_t i = 0; i < num_redundant; ++i)
+        {
+          double joint_dscrt = redundant_joint_discretization_.at(redundant_joint_indices_[i]);
+          sampled_joint_vals.push_back(step[i] < steps[i] ? joint_min[i] + joint_dscrt*step[i] : joint_max[i]);
+        }
+
+        std::size_t i = num_redundant;
+        while(i > 0 && step[i - 1] == steps[i - 1])
+          step[--i] = 0;
+        if(i == 0)
+          break;
+        step[i - 1]++;
       }
-      sampled_joint_vals.push_back(joint_max);
     }
       break;
     case kinematics::DiscretizationMethods::ALL_RANDOM_SAMPLED:
     {
-      int steps = std::ceil((joint_max - joint_min)/joint_dscrt);
-      steps = steps > 0 ? steps : 1;
-      double diff = joint_max - joint_min;
-      for(int i = 0; i < steps; i++)
+      // A generator per call keeps concurrent queries from sharing the state of std::rand()
+      boost::random::mt19937 generator(static_cast<boost::uint32_t>(ros::WallTime::now().toNSec()));
+      for(std::size_t n = 0; n < num_samples; n++)
       {
-        sampled_joint_vals.push_back( ((diff*std::rand())/(static_cast<double>(RAND_MAX))) + joint_min );
+        for(std::size_t i = 0; i < num_redundant; ++i)
+          sampled_joint_vals.push_back(boost::random::uniform_real_distribution<double>(joint_min[i], joint_max[i])(generator));
       }
     }
 
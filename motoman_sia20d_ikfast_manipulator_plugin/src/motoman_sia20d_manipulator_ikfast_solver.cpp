@@ -300,11 +300,63 @@ public:
 IkReal j0,cj0,sj0,htj0,j1,cj1,sj1,htj1,j2,cj2,sj2,htj2,j3,cj3,sj3,htj3,j5,cj5,sj5,htj5,j6,cj6,sj6,htj6,j4,cj4,sj4,htj4,new_r00,r00,rxp0_0,new_r01,r01,rxp0_1,new_r02,r02,rxp0_2,new_r10,r10,rxp1_0,new_r11,r11,rxp1_1,new_r12,r12,rxp1_2,new_r20,r20,rxp2_0,new_r21,r21,rxp2_1,new_r22,r22,rxp2_2,new_px,px,npx,new_py,py,npy,new_pz,pz,npz,pp;
 unsigned char _ij0[2], _nj0,_ij1[2], _nj1,_ij2[2], _nj2,_ij3[2], _nj3,_ij5[2], _nj5,_ij6[2], _nj6,_ij4[2], _nj4;
 
+const IkReal* _lowerlimits; ///< if not NULL, branches with joint values below these limits are pruned
+const IkReal* _upperlimits; ///< if not NULL, branches with joint values above these limits are pruned
+const bool* _stopsearch; ///< if not NULL and set, all remaining branches are skipped
+const unsigned short* _branchmasks; ///< if not NULL, bit i of _branchmasks[index] allows root i of joint ``index``, the other branches are pruned
+
+IKSolver() : _lowerlimits(NULL), _upperlimits(NULL), _stopsearch(NULL), _branchmasks(NULL) {
+}
+
+/// \brief the root indices of joint ``index`` in the branch being explored, see \ref IkSingleDOFSolutionBase::indices
+inline const unsigned char* _BranchIndices(int index) const {
+switch(index)
+{
+case 0:
+    return _ij0;
+case 1:
+    return _ij1;
+case 2:
+    return _ij2;
+case 3:
+    return _ij3;
+case 4:
+    return _ij4;
+case 5:
+    return _ij5;
+case 6:
+    return _ij6;
+default:
+    return NULL;
+}
+}
+
+/// \brief true if the branch where joint ``index`` takes ``value`` does not have to be explored further
+inline bool _PruneBranch(int index, IkReal value) const {
+if( _stopsearch != NULL && *_stopsearch )
+{
+    return true;
+}
+if( _branchmasks != NULL )
+{
+    const unsigned char* ij = _BranchIndices(index);
+    bool allowed = ij[0] < 16 && ((_branchmasks[index] >> ij[0]) & 1);
+    allowed = allowed || (ij[1] < 16 && ((_branchmasks[index] >> ij[1]) & 1));
+    if( !allowed )
+    {
+        return true;
+    }
+}
+return _lowerlimits != NULL && (value < _lowerlimits[index] || value > _upperlimits[index]);
+}
+
 bool ComputeIk(const IkReal* eetrans, const IkReal* eerot, const IkReal* pfree, IkSolutionListBase<IkReal>& solutions) {
-j0=numeric_limits<IkReal>::quiet_NaN(); _ij0[0] = -1; _ij0[1] = -1; _nj0 = -1; j1=numeric_limits<IkReal>::quiet_NaN(); _ij1[0] = -1; _ij1[1] = -1; _nj1 = -1; j2=numeric_limits<IkReal>::quiet_NaN(); _ij2[0] = -1; _ij2[1] = -1; _nj2 = -1; j3=numeric_limits<IkReal>::quiet_NaN(); _ij3[0] = -1; _ij3[1] = -1; _nj3 = -1; j5=numeric_limits<IkReal>::quiet_NaN(); _ij5[0] = -1; _ij5[1] = -1; _nj5 = -1; j6=numeric_limits<IkReal>::quiet_NaN(); _ij6[0] = -1; _ij6[1] = -1; _nj6 = -1;  _ij4[0] = -1; _ij4[1] = -1; _nj4 = 0; 
-for(int dummyiter = 0; dummyiter < 1; ++dummyiter) {
-    solutions.Clear();
-j4=pfree[0]; cj4=cos(pfree[0]); sj4=sin(pfree[0]);
+PrepareIk(eetrans,eerot);
+return ComputeIkPrepared(pfree,solutions);
+}
+
+/// \brief pose-only part of ComputeIk, the results are kept in the solver so that ComputeIkPrepared can be called for any number of free values
+void PrepareIk(const IkReal* eetrans, const IkReal* eerot) {
 r00 = eerot[0*3+0];
 r01 = eerot[0*3+1];
 r02 = eerot[0*3+2];
@@ -315,7 +367,6 @@ r20 = eerot[2*3+0];
 r21 = eerot[2*3+1];
 r22 = eerot[2*3+2];
 px = eetrans[0]; py = eetrans[1]; pz = eetrans[2];
-
 new_r00=((IkReal(-1.00000000000000))*(r00));
 new_r01=r01;
 new_r02=((IkReal(-1.00000000000000))*(r02));
@@ -342,6 +393,13 @@ rxp1_2=((((IkReal(-1.00000000000000))*(px)*(r11)))+(((py)*(r01))));
 rxp2_0=((((IkReal(-1.00000000000000))*(py)*(r22)))+(((pz)*(r12))));
 rxp2_1=((((px)*(r22)))+(((IkReal(-1.00000000000000))*(pz)*(r02))));
 rxp2_2=((((IkReal(-1.00000000000000))*(px)*(r12)))+(((py)*(r02))));
+}
+
+bool ComputeIkPrepared(const IkReal* pfree, IkSolutionListBase<IkReal>& solutions) {
+j0=numeric_limits<IkReal>::quiet_NaN(); _ij0[0] = -1; _ij0[1] = -1; _nj0 = -1; j1=numeric_limits<IkReal>::quiet_NaN(); _ij1[0] = -1; _ij1[1] = -1; _nj1 = -1; j2=numeric_limits<IkReal>::quiet_NaN(); _ij2[0] = -1; _ij2[1] = -1; _nj2 = -1; j3=numeric_limits<IkReal>::quiet_NaN(); _ij3[0] = -1; _ij3[1] = -1; _nj3 = -1; j5=numeric_limits<IkReal>::quiet_NaN(); _ij5[0] = -1; _ij5[1] = -1; _nj5 = -1; j6=numeric_limits<IkReal>::quiet_NaN(); _ij6[0] = -1; _ij6[1] = -1; _nj6 = -1;  _ij4[0] = -1; _ij4[1] = -1; _nj4 = 0; 
+for(int dummyiter = 0; dummyiter < 1; ++dummyiter) {
+    solutions.Clear();
+j4=pfree[0]; cj4=cos(pfree[0]); sj4=sin(pfree[0]);
 {
 IkReal j3array[2], cj3array[2], sj3array[2];
 bool j3valid[2]={false};
@@ -377,6 +435,10 @@ if( j3valid[iij3] && IKabs(cj3array[ij3]-cj3array[iij3]) < IKFAST_SOLUTION_THRES
 }
 }
 j3 = j3array[ij3]; cj3 = cj3array[ij3]; sj3 = sj3array[ij3];
+if( _PruneBranch(3,j3) )
+{
+    continue;
+}
 
 {
 IkReal dummyeval[1];
@@ -447,6 +509,10 @@ if( j5valid[iij5] && IKabs(cj5array[ij5]-cj5array[iij5]) < IKFAST_SOLUTION_THRES
 }
 }
 j5 = j5array[ij5]; cj5 = cj5array[ij5]; sj5 = sj5array[ij5];
+if( _PruneBranch(5,j5) )
+{
+    continue;
+}
 
 {
 IkReal dummyeval[1];
@@ -546,6 +612,10 @@ if( j6valid[iij6] && IKabs(cj6array[ij6]-cj6array[iij6]) < IKFAST_SOLUTION_THRES
 }
 }
 j6 = j6array[ij6]; cj6 = cj6array[ij6]; sj6 = sj6array[ij6];
+if( _PruneBranch(6,j6) )
+{
+    continue;
+}
 {
 IkReal evalcond[2];
 IkReal x76=IKcos(j6);
@@ -621,6 +691,10 @@ if( j6valid[iij6] && IKabs(cj6array[ij6]-cj6array[iij6]) < IKFAST_SOLUTION_THRES
 }
 }
 j6 = j6array[ij6]; cj6 = cj6array[ij6]; sj6 = sj6array[ij6];
+if( _PruneBranch(6,j6) )
+{
+    continue;
+}
 {
 IkReal evalcond[2];
 IkReal x237=IKcos(j6);
@@ -691,6 +765,10 @@ if( j6valid[iij6] && IKabs(cj6array[ij6]-cj6array[iij6]) < IKFAST_SOLUTION_THRES
 }
 }
 j6 = j6array[ij6]; cj6 = cj6array[ij6]; sj6 = sj6array[ij6];
+if( _PruneBranch(6,j6) )
+{
+    continue;
+}
 {
 IkReal evalcond[4];
 IkReal x242=IKcos(j6);
@@ -755,6 +833,10 @@ if( j6valid[iij6] && IKabs(cj6array[ij6]-cj6array[iij6]) < IKFAST_SOLUTION_THRES
 }
 }
 j6 = j6array[ij6]; cj6 = cj6array[ij6]; sj6 = sj6array[ij6];
+if( _PruneBranch(6,j6) )
+{
+    continue;
+}
 {
 IkReal evalcond[4];
 IkReal x252=IKcos(j6);
@@ -864,6 +946,10 @@ if( j6valid[iij6] && IKabs(cj6array[ij6]-cj6array[iij6]) < IKFAST_SOLUTION_THRES
 }
 }
 j6 = j6array[ij6]; cj6 = cj6array[ij6]; sj6 = sj6array[ij6];
+if( _PruneBranch(6,j6) )
+{
+    continue;
+}
 {
 IkReal evalcond[2];
 IkReal x266=IKcos(j6);
@@ -939,6 +1025,10 @@ if( j6valid[iij6] && IKabs(cj6array[ij6]-cj6array[iij6]) < IKFAST_SOLUTION_THRES
 }
 }
 j6 = j6array[ij6]; cj6 = cj6array[ij6]; sj6 = sj6array[ij6];
+if( _PruneBranch(6,j6) )
+{
+    continue;
+}
 {
 IkReal evalcond[2];
 IkReal x271=IKcos(j6);
@@ -1010,6 +1100,10 @@ if( j6valid[iij6] && IKabs(cj6array[ij6]-cj6array[iij6]) < IKFAST_SOLUTION_THRES
 }
 }
 j6 = j6array[ij6]; cj6 = cj6array[ij6]; sj6 = sj6array[ij6];
+if( _PruneBranch(6,j6) )
+{
+    continue;
+}
 {
 IkReal evalcond[4];
 IkReal x277=IKcos(j6);
@@ -1074,6 +1168,10 @@ if( j6valid[iij6] && IKabs(cj6array[ij6]-cj6array[iij6]) < IKFAST_SOLUTION_THRES
 }
 }
 j6 = j6array[ij6]; cj6 = cj6array[ij6]; sj6 = sj6array[ij6];
+if( _PruneBranch(6,j6) )
+{
+    continue;
+}
 {
 IkReal evalcond[4];
 IkReal x287=IKcos(j6);
@@ -1152,6 +1250,10 @@ if( j6valid[iij6] && IKabs(cj6array[ij6]-cj6array[iij6]) < IKFAST_SOLUTION_THRES
 }
 }
 j6 = j6array[ij6]; cj6 = cj6array[ij6]; sj6 = sj6array[ij6];
+if( _PruneBranch(6,j6) )
+{
+    continue;
+}
 {
 IkReal evalcond[6];
 IkReal x298=IKcos(j6);
@@ -1225,6 +1327,10 @@ if( j6valid[iij6] && IKabs(cj6array[ij6]-cj6array[iij6]) < IKFAST_SOLUTION_THRES
 }
 }
 j6 = j6array[ij6]; cj6 = cj6array[ij6]; sj6 = sj6array[ij6];
+if( _PruneBranch(6,j6) )
+{
+    continue;
+}
 {
 IkReal evalcond[6];
 IkReal x315=IKcos(j6);
@@ -1317,6 +1423,10 @@ if( j6valid[iij6] && IKabs(cj6array[ij6]-cj6array[iij6]) < IKFAST_SOLUTION_THRES
 }
 }
 j6 = j6array[ij6]; cj6 = cj6array[ij6]; sj6 = sj6array[ij6];
+if( _PruneBranch(6,j6) )
+{
+    continue;
+}
 {
 IkReal evalcond[2];
 IkReal x330=(npx)*(npx);
@@ -1401,6 +1511,10 @@ if( j5valid[iij5] && IKabs(cj5array[ij5]-cj5array[iij5]) < IKFAST_SOLUTION_THRES
 }
 }
 j5 = j5array[ij5]; cj5 = cj5array[ij5]; sj5 = sj5array[ij5];
+if( _PruneBranch(5,j5) )
+{
+    continue;
+}
 {
 IkReal evalcond[6];
 IkReal x354=IKcos(j5);
@@ -1471,6 +1585,10 @@ if( j5valid[iij5] && IKabs(cj5array[ij5]-cj5array[iij5]) < IKFAST_SOLUTION_THRES
 }
 }
 j5 = j5array[ij5]; cj5 = cj5array[ij5]; sj5 = sj5array[ij5];
+if( _PruneBranch(5,j5) )
+{
+    continue;
+}
 {
 IkReal evalcond[6];
 IkReal x368=IKcos(j5);
@@ -1562,6 +1680,10 @@ if( j6valid[iij6] && IKabs(cj6array[ij6]-cj6array[iij6]) < IKFAST_SOLUTION_THRES
 }
 }
 j6 = j6array[ij6]; cj6 = cj6array[ij6]; sj6 = sj6array[ij6];
+if( _PruneBranch(6,j6) )
+{
+    continue;
+}
 
 {
 IkReal dummyeval[1];
@@ -1628,6 +1750,10 @@ if( j5valid[iij5] && IKabs(cj5array[ij5]-cj5array[iij5]) < IKFAST_SOLUTION_THRES
 }
 }
 j5 = j5array[ij5]; cj5 = cj5array[ij5]; sj5 = sj5array[ij5];
+if( _PruneBranch(5,j5) )
+{
+    continue;
+}
 {
 IkReal evalcond[6];
 IkReal x397=IKcos(j5);
@@ -1698,6 +1824,10 @@ if( j5valid[iij5] && IKabs(cj5array[ij5]-cj5array[iij5]) < IKFAST_SOLUTION_THRES
 }
 }
 j5 = j5array[ij5]; cj5 = cj5array[ij5]; sj5 = sj5array[ij5];
+if( _PruneBranch(5,j5) )
+{
+    continue;
+}
 {
 IkReal evalcond[6];
 IkReal x411=IKcos(j5);
@@ -1808,6 +1938,10 @@ if( j1valid[iij1] && IKabs(cj1array[ij1]-cj1array[iij1]) < IKFAST_SOLUTION_THRES
 }
 }
 j1 = j1array[ij1]; cj1 = cj1array[ij1]; sj1 = sj1array[ij1];
+if( _PruneBranch(1,j1) )
+{
+    continue;
+}
 
 {
 IkReal dummyeval[1];
@@ -1869,6 +2003,10 @@ if( j0valid[iij0] && IKabs(cj0array[ij0]-cj0array[iij0]) < IKFAST_SOLUTION_THRES
 }
 }
 j0 = j0array[ij0]; cj0 = cj0array[ij0]; sj0 = sj0array[ij0];
+if( _PruneBranch(0,j0) )
+{
+    continue;
+}
 {
 IkReal evalcond[2];
 evalcond[0]=((((IkReal(-1.00000000000000))*(IKcos(j0))))+(new_r20));
@@ -1930,6 +2068,10 @@ if( j2valid[iij2] && IKabs(cj2array[ij2]-cj2array[iij2]) < IKFAST_SOLUTION_THRES
 }
 }
 j2 = j2array[ij2]; cj2 = cj2array[ij2]; sj2 = sj2array[ij2];
+if( _PruneBranch(2,j2) )
+{
+    continue;
+}
 {
 IkReal evalcond[6];
 IkReal x99=IKsin(j2);
@@ -2028,6 +2170,10 @@ if( j2valid[iij2] && IKabs(cj2array[ij2]-cj2array[iij2]) < IKFAST_SOLUTION_THRES
 }
 }
 j2 = j2array[ij2]; cj2 = cj2array[ij2]; sj2 = sj2array[ij2];
+if( _PruneBranch(2,j2) )
+{
+    continue;
+}
 {
 IkReal evalcond[6];
 IkReal x102=IKsin(j2);
@@ -2133,6 +2279,10 @@ if( j0valid[iij0] && IKabs(cj0array[ij0]-cj0array[iij0]) < IKFAST_SOLUTION_THRES
 }
 }
 j0 = j0array[ij0]; cj0 = cj0array[ij0]; sj0 = sj0array[ij0];
+if( _PruneBranch(0,j0) )
+{
+    continue;
+}
 {
 IkReal evalcond[2];
 evalcond[0]=((IKcos(j0))+(new_r20));
@@ -2193,6 +2343,10 @@ if( j2valid[iij2] && IKabs(cj2array[ij2]-cj2array[iij2]) < IKFAST_SOLUTION_THRES
 }
 }
 j2 = j2array[ij2]; cj2 = cj2array[ij2]; sj2 = sj2array[ij2];
+if( _PruneBranch(2,j2) )
+{
+    continue;
+}
 {
 IkReal evalcond[6];
 IkReal x105=IKsin(j2);
@@ -2292,6 +2446,10 @@ if( j2valid[iij2] && IKabs(cj2array[ij2]-cj2array[iij2]) < IKFAST_SOLUTION_THRES
 }
 }
 j2 = j2array[ij2]; cj2 = cj2array[ij2]; sj2 = sj2array[ij2];
+if( _PruneBranch(2,j2) )
+{
+    continue;
+}
 {
 IkReal evalcond[6];
 IkReal x109=IKsin(j2);
@@ -2413,6 +2571,10 @@ if( j2valid[iij2] && IKabs(cj2array[ij2]-cj2array[iij2]) < IKFAST_SOLUTION_THRES
 }
 }
 j2 = j2array[ij2]; cj2 = cj2array[ij2]; sj2 = sj2array[ij2];
+if( _PruneBranch(2,j2) )
+{
+    continue;
+}
 {
 IkReal evalcond[1];
 evalcond[0]=((((IkReal(-1.00000000000000))*(new_r12)*(IKsin(j2))))+(((new_r02)*(IKcos(j2)))));
@@ -2454,6 +2616,10 @@ if( j0valid[iij0] && IKabs(cj0array[ij0]-cj0array[iij0]) < IKFAST_SOLUTION_THRES
 }
 }
 j0 = j0array[ij0]; cj0 = cj0array[ij0]; sj0 = sj0array[ij0];
+if( _PruneBranch(0,j0) )
+{
+    continue;
+}
 {
 IkReal evalcond[4];
 IkReal x113=IKsin(j0);
@@ -2570,6 +2736,10 @@ if( j2valid[iij2] && IKabs(cj2array[ij2]-cj2array[iij2]) < IKFAST_SOLUTION_THRES
 }
 }
 j2 = j2array[ij2]; cj2 = cj2array[ij2]; sj2 = sj2array[ij2];
+if( _PruneBranch(2,j2) )
+{
+    continue;
+}
 {
 IkReal evalcond[1];
 evalcond[0]=((((IkReal(-1.00000000000000))*(new_r12)*(IKsin(j2))))+(((new_r02)*(IKcos(j2)))));
@@ -2611,6 +2781,10 @@ if( j0valid[iij0] && IKabs(cj0array[ij0]-cj0array[iij0]) < IKFAST_SOLUTION_THRES
 }
 }
 j0 = j0array[ij0]; cj0 = cj0array[ij0]; sj0 = sj0array[ij0];
+if( _PruneBranch(0,j0) )
+{
+    continue;
+}
 {
 IkReal evalcond[4];
 IkReal x118=IKcos(j0);
@@ -2721,6 +2895,10 @@ if( j2valid[iij2] && IKabs(cj2array[ij2]-cj2array[iij2]) < IKFAST_SOLUTION_THRES
 }
 }
 j2 = j2array[ij2]; cj2 = cj2array[ij2]; sj2 = sj2array[ij2];
+if( _PruneBranch(2,j2) )
+{
+    continue;
+}
 {
 IkReal evalcond[6];
 IkReal x122=IKcos(j2);
@@ -2808,6 +2986,10 @@ if( j0valid[iij0] && IKabs(cj0array[ij0]-cj0array[iij0]) < IKFAST_SOLUTION_THRES
 }
 }
 j0 = j0array[ij0]; cj0 = cj0array[ij0]; sj0 = sj0array[ij0];
+if( _PruneBranch(0,j0) )
+{
+    continue;
+}
 {
 IkReal evalcond[4];
 IkReal x131=IKsin(j0);
@@ -2917,6 +3099,10 @@ if( j0valid[iij0] && IKabs(cj0array[ij0]-cj0array[iij0]) < IKFAST_SOLUTION_THRES
 }
 }
 j0 = j0array[ij0]; cj0 = cj0array[ij0]; sj0 = sj0array[ij0];
+if( _PruneBranch(0,j0) )
+{
+    continue;
+}
 {
 IkReal evalcond[4];
 IkReal x138=IKcos(j0);
@@ -3022,6 +3208,10 @@ if( j0valid[iij0] && IKabs(cj0array[ij0]-cj0array[iij0]) < IKFAST_SOLUTION_THRES
 }
 }
 j0 = j0array[ij0]; cj0 = cj0array[ij0]; sj0 = sj0array[ij0];
+if( _PruneBranch(0,j0) )
+{
+    continue;
+}
 {
 IkReal evalcond[8];
 IkReal x141=IKsin(j0);
@@ -3128,6 +3318,10 @@ if( j0valid[iij0] && IKabs(cj0array[ij0]-cj0array[iij0]) < IKFAST_SOLUTION_THRES
 }
 }
 j0 = j0array[ij0]; cj0 = cj0array[ij0]; sj0 = sj0array[ij0];
+if( _PruneBranch(0,j0) )
+{
+    continue;
+}
 {
 IkReal evalcond[8];
 IkReal x150=IKsin(j0);
@@ -3234,6 +3428,10 @@ if( j0valid[iij0] && IKabs(cj0array[ij0]-cj0array[iij0]) < IKFAST_SOLUTION_THRES
 }
 }
 j0 = j0array[ij0]; cj0 = cj0array[ij0]; sj0 = sj0array[ij0];
+if( _PruneBranch(0,j0) )
+{
+    continue;
+}
 {
 IkReal evalcond[8];
 IkReal x159=IKsin(j0);
@@ -3347,6 +3545,10 @@ if( j2valid[iij2] && IKabs(cj2array[ij2]-cj2array[iij2]) < IKFAST_SOLUTION_THRES
 }
 }
 j2 = j2array[ij2]; cj2 = cj2array[ij2]; sj2 = sj2array[ij2];
+if( _PruneBranch(2,j2) )
+{
+    continue;
+}
 {
 IkReal evalcond[6];
 IkReal x169=IKcos(j2);
@@ -3434,6 +3636,10 @@ if( j0valid[iij0] && IKabs(cj0array[ij0]-cj0array[iij0]) < IKFAST_SOLUTION_THRES
 }
 }
 j0 = j0array[ij0]; cj0 = cj0array[ij0]; sj0 = sj0array[ij0];
+if( _PruneBranch(0,j0) )
+{
+    continue;
+}
 {
 IkReal evalcond[4];
 IkReal x178=IKsin(j0);
@@ -3543,6 +3749,10 @@ if( j0valid[iij0] && IKabs(cj0array[ij0]-cj0array[iij0]) < IKFAST_SOLUTION_THRES
 }
 }
 j0 = j0array[ij0]; cj0 = cj0array[ij0]; sj0 = sj0array[ij0];
+if( _PruneBranch(0,j0) )
+{
+    continue;
+}
 {
 IkReal evalcond[4];
 IkReal x185=IKcos(j0);
@@ -3648,6 +3858,10 @@ if( j0valid[iij0] && IKabs(cj0array[ij0]-cj0array[iij0]) < IKFAST_SOLUTION_THRES
 }
 }
 j0 = j0array[ij0]; cj0 = cj0array[ij0]; sj0 = sj0array[ij0];
+if( _PruneBranch(0,j0) )
+{
+    continue;
+}
 {
 IkReal evalcond[8];
 IkReal x188=IKsin(j0);
@@ -3754,6 +3968,10 @@ if( j0valid[iij0] && IKabs(cj0array[ij0]-cj0array[iij0]) < IKFAST_SOLUTION_THRES
 }
 }
 j0 = j0array[ij0]; cj0 = cj0array[ij0]; sj0 = sj0array[ij0];
+if( _PruneBranch(0,j0) )
+{
+    continue;
+}
 {
 IkReal evalcond[8];
 IkReal x197=IKsin(j0);
@@ -3860,6 +4078,10 @@ if( j0valid[iij0] && IKabs(cj0array[ij0]-cj0array[iij0]) < IKFAST_SOLUTION_THRES
 }
 }
 j0 = j0array[ij0]; cj0 = cj0array[ij0]; sj0 = sj0array[ij0];
+if( _PruneBranch(0,j0) )
+{
+    continue;
+}
 {
 IkReal evalcond[8];
 IkReal x206=IKsin(j0);
@@ -3972,6 +4194,10 @@ if( j0valid[iij0] && IKabs(cj0array[ij0]-cj0array[iij0]) < IKFAST_SOLUTION_THRES
 }
 }
 j0 = j0array[ij0]; cj0 = cj0array[ij0]; sj0 = sj0array[ij0];
+if( _PruneBranch(0,j0) )
+{
+    continue;
+}
 {
 IkReal evalcond[2];
 IkReal x215=((IkReal(1.00000000000000))*(sj1));
@@ -4034,6 +4260,10 @@ if( j2valid[iij2] && IKabs(cj2array[ij2]-cj2array[iij2]) < IKFAST_SOLUTION_THRES
 }
 }
 j2 = j2array[ij2]; cj2 = cj2array[ij2]; sj2 = sj2array[ij2];
+if( _PruneBranch(2,j2) )
+{
+    continue;
+}
 {
 IkReal evalcond[12];
 IkReal x217=IKsin(j2);
@@ -4144,6 +4374,10 @@ if( j2valid[iij2] && IKabs(cj2array[ij2]-cj2array[iij2]) < IKFAST_SOLUTION_THRES
 }
 }
 j2 = j2array[ij2]; cj2 = cj2array[ij2]; sj2 = sj2array[ij2];
+if( _PruneBranch(2,j2) )
+{
+    continue;
+}
 {
 IkReal evalcond[12];
 IkReal x226=IKsin(j2);
@@ -4237,6 +4471,55 @@ IKSolver solver;
 return solver.ComputeIk(eetrans,eerot,pfree,solutions);
 }
 
+/// \brief holds the terms of ComputeIk that only depend on the end effector pose.
+typedef IKSolver IkPreparedPose;
+
+/// \brief Computes the pose-only terms of ComputeIk once, see \ref ComputeIkPrepared.
+///
+/// Arguments are the same as \ref ComputeIk. The results are stored in ``prepared``.
+void PrepareIk(const IkReal* eetrans, const IkReal* eerot, IkPreparedPose& prepared) {
+prepared.PrepareIk(eetrans,eerot);
+}
+
+/// \brief Computes all IK solutions of a pose previously passed to \ref PrepareIk for the given free joints.
+///
+/// Equivalent to \ref ComputeIk without recomputing the pose-only terms, meant for sweeping the free joints of a single pose.
+bool ComputeIkPrepared(IkPreparedPose& prepared, const IkReal* pfree, IkSolutionListBase<IkReal>& solutions) {
+return prepared.ComputeIkPrepared(pfree,solutions);
+}
+
+/// \brief Enumerates the IK solutions of a pose previously passed to \ref PrepareIk, handing them to ``visitor`` as they are found.
+///
+/// A branch of the solution tree is abandoned as soon as one of its joints is solved outside of [``lower``,``upper``],
+/// so the remaining joints of that branch are never computed. The enumeration stops once the visitor returns false.
+/// \param lower lower joint limits indexed by joint, NULL to disable the pruning
+/// \param upper upper joint limits indexed by joint, NULL to disable the pruning
+/// \param branchmasks bit i of ``branchmasks[j]`` allows the branches where joint j takes root i, see \ref IkSingleDOFSolutionBase::indices, NULL allows all branches
+/// \return the number of solutions passed to the visitor
+size_t ComputeIkVisit(IkPreparedPose& prepared, const IkReal* pfree, const IkReal* lower, const IkReal* upper, IkSolutionVisitorBase<IkReal>& visitor, const unsigned short* branchmasks = NULL) {
+if( lower != NULL && upper != NULL )
+{
+    for(int i = 0; i < GetNumFreeParameters(); ++i)
+    {
+        int index = GetFreeParameters()[i];
+        if( pfree[i] < lower[index] || pfree[i] > upper[index] )
+        {
+            return 0;
+        }
+    }
+}
+IkSolutionVisitorList<IkReal> solutions(visitor);
+prepared._lowerlimits = lower != NULL && upper != NULL ? lower : NULL;
+prepared._upperlimits = upper;
+prepared._stopsearch = solutions.GetStopFlag();
+prepared._branchmasks = branchmasks;
+prepared.ComputeIkPrepared(pfree,solutions);
+prepared._lowerlimits = prepared._upperlimits = NULL;
+prepared._stopsearch = NULL;
+prepared._branchmasks = NULL;
+return solutions.GetNumSolutions();
+}
+
 IKFAST_API const char* GetKinematicsHash() { return "<robot:genericrobot - motoman_sia20d (72a5dabf099b6c11c75f8620052123af)>"; }
 
 IKFAST_API const char* GetIkFastVersion() { return IKFAST_STRINGIZE(IKFAST_VERSION); }
@@ -1 +1,21 @@
-rosrun moveit_ikfast create_ikfast_moveit_plugin.py motoman_sia20d manipulator motoman_sia20d_ikfast_manipulator_plugin /home/rosindustrial/ros/indigo/moveit_kinematics_ws/src/kinematics_base_tests/motoman_sia20d_ikfast_manipulator_plugin/src/motoman_sia20d_manipulator_ikfast_solver.cpp
\ No newline at end of file
+#!/bin/sh
+# Regenerates the plugin from the solver generated by OpenRAVE (config/ikfast_sia20d_manipulator.cpp) and reapplies the
+# edits of the solver and ikfast.h kept in patches/ikfast_solver.patch, see "Regenerating the ikfast plugins" in README.md
+set -e
+cd "$(dirname "$0")"
+
+# the generator overwrites these with its templates, they hold the plugin itself
+KEEP="src/motoman_sia20d_manipulator_ikfast_moveit_plugin.cpp CMakeLists.txt package.xml motoman_sia20d_manipulator_moveit_ikfast_plugin_description.xml"
+BACKUP=$(mktemp -d)
+trap 'rm -rf "$BACKUP"' EXIT
+for f in $KEEP; do mkdir -p "$BACKUP/$(dirname $f)"; cp "$f" "$BACKUP/$f"; done
+
+rosrun moveit_ikfast create_ikfast_moveit_plugin.py motoman_sia20d manipulator motoman_sia20d_ikfast_manipulator_plugin "$(pwd)/config/ikfast_sia20d_manipulator.cpp"
+
+for f in $KEEP; do cp "$BACKUP/$f" "$f"; done
+
+if ! patch -p1 --forward --no-backup-if-mismatch < patches/ikfast_solver.patch; then
+  echo "update_ikfast_plugin.sh: patches/ikfast_solver.patch doesn't apply to the regenerated src/motoman_sia20d_manipulator_ikfast_solver.cpp" >&2
+  echo "and include/ikfast.h, port the rejected hunks (*.rej) by hand and refresh the patch" >&2
+  exit 1
+fi